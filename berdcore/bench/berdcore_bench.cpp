@@ -0,0 +1,277 @@
+// ============================================================================
+// berdcore_bench - prefill/decode benchmark for berdcore models
+// ============================================================================
+// Loads each requested model at each context size, runs one generation per
+// prompt length and reports time-to-first-token, prefill and decode rates
+// and peak RSS as JSON. Run it before and after a Cactus update or a change
+// of build flags to catch regressions.
+//
+// Usage:
+//   berdcore_bench --model gemma=/path/to/gemma --model qwen=/path/to/qwen
+//                  [--prompt-lengths 64,256,1024] [--context-sizes 2048]
+//                  [--decode-tokens 128] [--repeats 3] [--output out.json]
+// ============================================================================
+
+#include <berdcore.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include <sys/resource.h>
+#include <json/json.h>
+
+struct BenchModel {
+    berdcore_model_type_t type;
+    std::string name;
+    std::string path;
+};
+
+struct BenchConfig {
+    std::vector<BenchModel> models;
+    std::vector<int> prompt_lengths;
+    std::vector<int> context_sizes;
+    int decode_tokens;
+    int repeats;
+    std::string output;
+
+    BenchConfig() : prompt_lengths{64, 256, 1024}, context_sizes{2048},
+                    decode_tokens(128), repeats(3) {}
+};
+
+// Token arrival times for one generation (TTFT as the app sees it)
+struct BenchRun {
+    uint64_t first_ns;
+    uint64_t last_ns;
+    size_t tokens;
+
+    BenchRun() : first_ns(0), last_ns(0), tokens(0) {}
+};
+
+// Helper: Monotonic clock on the same base as token timestamps
+static uint64_t now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Helper: Peak resident set size of this process in bytes
+static uint64_t peak_rss_bytes() {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+    return static_cast<uint64_t>(usage.ru_maxrss);
+#else
+    return static_cast<uint64_t>(usage.ru_maxrss) * 1024;
+#endif
+}
+
+// Helper: Parse "64,256,1024"
+static std::vector<int> parse_int_list(const char* arg) {
+    std::vector<int> values;
+    for (const char* p = arg; *p;) {
+        values.push_back(atoi(p));
+        const char* comma = strchr(p, ',');
+        if (!comma) break;
+        p = comma + 1;
+    }
+    return values;
+}
+
+// Helper: Parse "gemma=/path" or "qwen=/path"
+static bool parse_model(const char* arg, BenchModel* model) {
+    const char* eq = strchr(arg, '=');
+    if (!eq) return false;
+
+    model->name.assign(arg, eq - arg);
+    model->path = eq + 1;
+    if (model->name == "gemma") {
+        model->type = BERDCORE_MODEL_GEMMA3_1B_Q4;
+    } else if (model->name == "qwen") {
+        model->type = BERDCORE_MODEL_QWEN_4B_Q4;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+// Helper: Chat messages with a user prompt of roughly `tokens` tokens.
+// " the" is a single token in both the Gemma and Qwen vocabularies.
+static std::string make_prompt(int tokens) {
+    std::string text = "Summarize the following text.";
+    for (int i = 0; i < tokens; i++) {
+        text += " the";
+    }
+
+    Json::Value messages(Json::arrayValue);
+    Json::Value message;
+    message["role"] = "user";
+    message["content"] = text;
+    messages.append(message);
+
+    Json::StreamWriterBuilder writer;
+    writer["indentation"] = "";
+    return Json::writeString(writer, messages);
+}
+
+static void on_batch(const berdcore_token_batch_t* batch, void* user_data) {
+    auto run = static_cast<BenchRun*>(user_data);
+    if (batch->num_tokens == 0) return;
+
+    if (run->tokens == 0) run->first_ns = batch->timestamps_ns[0];
+    run->last_ns = batch->timestamps_ns[batch->num_tokens - 1];
+    run->tokens += batch->num_tokens;
+}
+
+static void usage() {
+    fprintf(stderr,
+            "usage: berdcore_bench --model gemma=PATH [--model qwen=PATH]\n"
+            "                      [--prompt-lengths 64,256,1024] [--context-sizes 2048]\n"
+            "                      [--decode-tokens 128] [--repeats 3] [--output FILE]\n");
+}
+
+// Helper: Median of the samples (0 when empty)
+static double median(std::vector<double> samples) {
+    if (samples.empty()) return 0.0;
+    std::sort(samples.begin(), samples.end());
+    return samples[samples.size() / 2];
+}
+
+static Json::Value bench_prompt(berdcore_model_t model, const BenchConfig& config, int prompt_length) {
+    std::string messages = make_prompt(prompt_length);
+    berdcore_inference_options_t opts = {0.0f, 1.0f, 1, config.decode_tokens, nullptr, nullptr};
+    berdcore_streaming_options_t streaming = {1, 0};
+
+    std::vector<double> ttft_ms, prefill_tps, decode_tps;
+    int prompt_tokens = 0;
+    int decoded = 0;
+    size_t scratch = 0;
+    for (int r = 0; r < config.repeats; r++) {
+        // Start every repeat from an empty KV cache so prefill is measured in full
+        berdcore_model_reset_cache(model);
+
+        BenchRun run;
+        uint64_t start = now_ns();
+        berdcore_error_t err = berdcore_generate_batched(model, messages.c_str(), &opts,
+                                                         &streaming, on_batch, &run);
+        if (err != BERDCORE_SUCCESS || run.tokens == 0) {
+            fprintf(stderr, "generation failed: %s\n", berdcore_get_last_error());
+            continue;
+        }
+
+        berdcore_inference_stats_t stats;
+        berdcore_model_get_last_stats(model, &stats);
+        ttft_ms.push_back((run.first_ns - start) / 1e6);
+        prefill_tps.push_back(stats.prefill_tokens_per_second);
+        decode_tps.push_back(stats.decode_tokens_per_second);
+        prompt_tokens = stats.prompt_tokens;
+        scratch = std::max(scratch, stats.peak_scratch_bytes);
+        decoded = stats.generated_tokens;
+    }
+
+    Json::Value result;
+    result["prompt_length"] = prompt_length;
+    result["prompt_tokens"] = prompt_tokens;
+    result["decode_tokens"] = decoded;
+    result["runs"] = static_cast<int>(ttft_ms.size());
+    result["ttft_ms"] = median(ttft_ms);
+    result["prefill_tok_s"] = median(prefill_tps);
+    result["decode_tok_s"] = median(decode_tps);
+    result["peak_scratch_bytes"] = static_cast<Json::UInt64>(scratch);
+    result["peak_rss_bytes"] = static_cast<Json::UInt64>(peak_rss_bytes());
+    return result;
+}
+
+int main(int argc, char** argv) {
+    BenchConfig config;
+    for (int i = 1; i < argc; i++) {
+        const char* arg = argv[i];
+        const char* value = i + 1 < argc ? argv[i + 1] : nullptr;
+        if (!value) {
+            usage();
+            return 1;
+        }
+
+        if (strcmp(arg, "--model") == 0) {
+            BenchModel model;
+            if (!parse_model(value, &model)) {
+                fprintf(stderr, "unknown model '%s' (expected gemma=PATH or qwen=PATH)\n", value);
+                return 1;
+            }
+            config.models.push_back(model);
+        } else if (strcmp(arg, "--prompt-lengths") == 0) {
+            config.prompt_lengths = parse_int_list(value);
+        } else if (strcmp(arg, "--context-sizes") == 0) {
+            config.context_sizes = parse_int_list(value);
+        } else if (strcmp(arg, "--decode-tokens") == 0) {
+            config.decode_tokens = atoi(value);
+        } else if (strcmp(arg, "--repeats") == 0) {
+            config.repeats = std::max(1, atoi(value));
+        } else if (strcmp(arg, "--output") == 0) {
+            config.output = value;
+        } else {
+            usage();
+            return 1;
+        }
+        i++;
+    }
+    if (config.models.empty()) {
+        usage();
+        return 1;
+    }
+
+    berdcore_set_log_level(0);
+
+    Json::Value report;
+    report["berdcore_version"] = berdcore_version();
+    report["results"] = Json::Value(Json::arrayValue);
+
+    for (const auto& bench_model : config.models) {
+        for (int context_size : config.context_sizes) {
+            uint64_t load_start = now_ns();
+            berdcore_model_t model = berdcore_init_model(bench_model.type, bench_model.path.c_str(),
+                                                         context_size, nullptr, nullptr);
+            if (!model) {
+                fprintf(stderr, "failed to load %s: %s\n", bench_model.name.c_str(),
+                        berdcore_get_last_error());
+                return 1;
+            }
+            double load_ms = (now_ns() - load_start) / 1e6;
+
+            for (int prompt_length : config.prompt_lengths) {
+                if (prompt_length + config.decode_tokens > context_size) continue;
+
+                Json::Value result = bench_prompt(model, config, prompt_length);
+                result["model"] = bench_model.name;
+                result["context_size"] = context_size;
+                result["load_ms"] = load_ms;
+                report["results"].append(result);
+
+                fprintf(stderr, "%-6s ctx=%-5d prompt=%-5d ttft=%8.1fms prefill=%8.1f tok/s decode=%6.1f tok/s\n",
+                        bench_model.name.c_str(), context_size, prompt_length,
+                        result["ttft_ms"].asDouble(), result["prefill_tok_s"].asDouble(),
+                        result["decode_tok_s"].asDouble());
+            }
+
+            berdcore_free_model(model);
+        }
+    }
+
+    Json::StreamWriterBuilder writer;
+    writer["indentation"] = "  ";
+    std::string json = Json::writeString(writer, report) + "\n";
+
+    if (config.output.empty()) {
+        fputs(json.c_str(), stdout);
+    } else {
+        FILE* out = fopen(config.output.c_str(), "w");
+        if (!out) {
+            fprintf(stderr, "cannot write %s\n", config.output.c_str());
+            return 1;
+        }
+        fputs(json.c_str(), out);
+        fclose(out);
+    }
+    return 0;
+}
@@ -29,6 +29,9 @@ extern "C" {
 
 typedef void* berdcore_model_t;
 typedef void* berdcore_conversation_t;
+typedef void* berdcore_session_t;
+typedef void* berdcore_model_pool_t;
+typedef void* berdcore_index_t;
 
 // Model types supported via Cactus
 typedef enum {
@@ -43,14 +46,115 @@ typedef struct {
     int top_k;
     int max_tokens;
     const char* stop_sequences;  // JSON array, e.g., ["<|im_end|>"]
+    // JSON schema the reply must match (NULL = free text). Generation stops
+    // as soon as the value is complete, or fails with
+    // BERDCORE_ERROR_INVALID_OUTPUT at the first byte that cannot match. The
+    // schema is not added to the prompt: describe the format there too.
+    const char* json_schema;
 } berdcore_inference_options_t;
 
+// Chat message as pointer/length pairs (not necessarily NUL-terminated)
+typedef struct {
+    const char* role;       // "system", "user" or "assistant"
+    size_t role_length;
+    const char* content;
+    size_t content_length;
+} berdcore_message_t;
+
 // Token callback for streaming responses
 typedef void (*berdcore_token_callback_t)(const char* token, void* user_data);
 
+// A group of streamed tokens. All pointers are views into an internal buffer
+// and are only valid for the duration of the callback.
+typedef struct {
+    const char* text;               // concatenated token text, NUL-terminated
+    size_t text_length;
+    const uint32_t* text_offsets;   // start of each token within text
+    const uint32_t* token_ids;
+    const uint64_t* timestamps_ns;  // monotonic time each token arrived
+    size_t num_tokens;
+    int is_final;                   // 1 for the last batch of a generation
+} berdcore_token_batch_t;
+
+// Batched token callback for streaming responses
+typedef void (*berdcore_token_batch_callback_t)(const berdcore_token_batch_t* batch, void* user_data);
+
+// Batching options for berdcore_token_batch_callback_t
+typedef struct {
+    int max_batch_tokens;   // flush after this many tokens (0 = 16)
+    int flush_interval_ms;  // also flush once the oldest pending token is this old (0 = off)
+} berdcore_streaming_options_t;
+
 // Progress callback for model loading
 typedef void (*berdcore_progress_callback_t)(float progress, void* user_data);
 
+// Ready callback, fired once the model can prefill (weights may still be paging in)
+typedef void (*berdcore_ready_callback_t)(berdcore_model_t model, void* user_data);
+
+// How weights are brought into memory after the model is ready
+typedef enum {
+    BERDCORE_WARMUP_NONE = 0,    // page in on demand during the first prefill
+    BERDCORE_WARMUP_ADVISE = 1,  // madvise(WILLNEED) layer by layer, kernel reads ahead
+    BERDCORE_WARMUP_TOUCH = 2    // touch every page in the background
+} berdcore_warmup_mode_t;
+
+// Model configuration for berdcore_init_model_ex()
+typedef struct {
+    berdcore_model_type_t model_type;
+    const char* model_path;
+    int context_size;                                // 0 = 2048
+    berdcore_warmup_mode_t warmup;
+    berdcore_progress_callback_t progress_callback;  // fraction of weight bytes resident
+    berdcore_ready_callback_t ready_callback;
+    void* user_data;
+    // Shrink context_size, in steps of 256 tokens, so a full KV cache fits
+    // (see berdcore_estimate_kv_bytes()). Init fails when the limit cannot
+    // hold the requested context or 256 tokens, whichever is smaller.
+    size_t kv_memory_limit;                          // 0 = no limit
+} berdcore_model_config_t;
+
+// Quality-of-service class for the thread running inference
+typedef enum {
+    BERDCORE_QOS_DEFAULT = 0,          // leave the calling thread's class alone
+    BERDCORE_QOS_USER_INTERACTIVE = 1,
+    BERDCORE_QOS_USER_INITIATED = 2,
+    BERDCORE_QOS_UTILITY = 3,
+    BERDCORE_QOS_BACKGROUND = 4
+} berdcore_qos_t;
+
+// Which cores a phase of inference should run on
+typedef enum {
+    BERDCORE_CORES_ANY = 0,
+    BERDCORE_CORES_PERFORMANCE = 1,
+    BERDCORE_CORES_EFFICIENCY = 2
+} berdcore_core_preference_t;
+
+// Thread placement for berdcore_model_set_thread_config(). Zero everywhere
+// leaves threads as the engine and the caller set them up.
+typedef struct {
+    int num_threads;                          // cores inference may use (0 = no limit)
+    int prefill_threads;                      // for prefill and embeddings (0 = num_threads)
+    int decode_threads;                       // for decode (0 = num_threads)
+    berdcore_qos_t qos;
+    berdcore_core_preference_t prefill_cores;
+    berdcore_core_preference_t decode_cores;
+} berdcore_thread_config_t;
+
+// Thermal state as reported by the host (ProcessInfo.thermalState on Apple)
+typedef enum {
+    BERDCORE_THERMAL_NOMINAL = 0,
+    BERDCORE_THERMAL_FAIR = 1,
+    BERDCORE_THERMAL_SERIOUS = 2,
+    BERDCORE_THERMAL_CRITICAL = 3
+} berdcore_thermal_state_t;
+
+// Decode governor for berdcore_model_set_governor()
+typedef struct {
+    int enabled;
+    float sustained_fraction;  // decode rate kept per thermal step, of the cool rate (0 = 0.75)
+    int min_max_tokens;        // replies are never capped below this (0 = 128)
+} berdcore_governor_options_t;
+
 // Error codes
 typedef enum {
     BERDCORE_SUCCESS = 0,
@@ -59,9 +163,95 @@ typedef enum {
     BERDCORE_ERROR_INFERENCE_FAILED = -3,
     BERDCORE_ERROR_OUT_OF_MEMORY = -4,
     BERDCORE_ERROR_NETWORK = -5,
-    BERDCORE_ERROR_NOT_INITIALIZED = -6
+    BERDCORE_ERROR_NOT_INITIALIZED = -6,
+    BERDCORE_ERROR_CANCELLED = -7,
+    BERDCORE_ERROR_INVALID_OUTPUT = -8  // the reply broke the requested json_schema
 } berdcore_error_t;
 
+// Why a generation ended
+typedef enum {
+    BERDCORE_STOP_END_OF_SEQUENCE = 0,  // end-of-turn token or a stop sequence
+    BERDCORE_STOP_MAX_TOKENS = 1,
+    BERDCORE_STOP_CANCELLED = 2,
+    BERDCORE_STOP_ERROR = 3
+} berdcore_stop_reason_t;
+
+// Metrics for one generate call
+typedef struct {
+    int prompt_tokens;                 // reused_tokens + prefill_tokens
+    int reused_tokens;                 // served from the KV cache
+    int prefill_tokens;                // evaluated by this call
+    int generated_tokens;
+    double time_to_first_token_ms;     // call entry (async: submission) to first token,
+                                       // including time queued or waiting for the model
+    double prefill_ms;                 // completion start to first token
+    double decode_ms;                  // first token to end of generation
+    double prefill_tokens_per_second;
+    double decode_tokens_per_second;
+    size_t peak_scratch_bytes;         // highest since load of the response, result
+                                       // and batching buffers
+    size_t kv_cache_bytes;             // estimated KV state held after the call
+    berdcore_stop_reason_t stop_reason;
+    
+    // Decode governor decisions (0 when it is off, except max_tokens_applied)
+    int governor_level;                // highest during the call: 0 cool to 3 critical
+                                       // (low-power mode counts as 2)
+    int max_tokens_applied;            // reply cap after the governor
+    double decode_rate_cap;            // tokens/s decode was paced to (0 = unpaced)
+    int throttle_detected;             // decode fell below half the cool rate mid-reply
+} berdcore_inference_stats_t;
+
+// Cumulative counters for a model since load (or the last reset)
+typedef struct {
+    uint64_t requests;
+    uint64_t failed_requests;
+    uint64_t cancelled_requests;
+    uint64_t prompt_tokens;
+    uint64_t reused_tokens;
+    uint64_t generated_tokens;
+    double prefill_ms;
+    double decode_ms;
+} berdcore_model_counters_t;
+
+// What a session does when its conversation outgrows the context window
+typedef enum {
+    BERDCORE_CONTEXT_NONE = 0,            // send the whole history (default)
+    BERDCORE_CONTEXT_SLIDING_WINDOW = 1,  // system messages plus the most recent turns
+    BERDCORE_CONTEXT_DROP_MIDDLE = 2,     // also keep the first turns after the system messages
+    BERDCORE_CONTEXT_SUMMARIZE = 3        // sliding window plus a model-written summary of dropped turns
+} berdcore_context_policy_t;
+
+// Context window options for a session
+typedef struct {
+    berdcore_context_policy_t policy;
+    int reserve_tokens;       // room kept for the reply (0 = the call's max_tokens)
+    int target_tokens;        // trim down to this many tokens (0 = 3/4 of the context size)
+    int keep_first_messages;  // DROP_MIDDLE: messages kept after the system messages (0 = 2)
+    int summary_max_tokens;   // SUMMARIZE: summary length (0 = 256)
+    const char* summary_prompt;  // SUMMARIZE: instruction for the summary (NULL = built-in)
+} berdcore_context_options_t;
+
+// Identifier of an async generation request (0 = invalid)
+typedef uint64_t berdcore_request_id_t;
+
+// Completion callback for async generation, called once per request
+typedef void (*berdcore_completion_callback_t)(berdcore_request_id_t request_id,
+                                               berdcore_error_t result,
+                                               void* user_data);
+
+// Result callback for background generation: the whole reply at once
+// (text is NULL unless result is BERDCORE_SUCCESS, and valid only during the call)
+typedef void (*berdcore_result_callback_t)(berdcore_request_id_t request_id,
+                                           berdcore_error_t result,
+                                           const char* text,
+                                           void* user_data);
+
+// Memory pressure levels (mirror the OS warning/critical notifications)
+typedef enum {
+    BERDCORE_MEMORY_PRESSURE_WARNING = 1,
+    BERDCORE_MEMORY_PRESSURE_CRITICAL = 2
+} berdcore_memory_pressure_t;
+
 // ============================================================================
 // MODEL MANAGEMENT (Cactus Compute)
 // ============================================================================
@@ -84,6 +274,20 @@ berdcore_model_t berdcore_init_model(
     void* user_data
 );
 
+/**
+ * Initialize a Cactus model from a configuration
+ * 
+ * Progress reports the fraction of weight bytes actually resident, measured
+ * while Cactus loads and then while the warm-up mode pages in the rest; the
+ * last report is always 1.0. The ready callback fires before this returns,
+ * as soon as the model can prefill. Warm-up continues on a background thread,
+ * so progress may be reported from that thread after this returns.
+ * 
+ * @param config Model configuration
+ * @return Model handle or NULL on failure
+ */
+berdcore_model_t berdcore_init_model_ex(const berdcore_model_config_t* config);
+
 /**
  * Free model resources
  */
@@ -99,6 +303,217 @@ int berdcore_model_is_ready(berdcore_model_t model);
  */
 float berdcore_model_get_progress(berdcore_model_t model);
 
+/**
+ * Get the full text generated by the last generate call
+ * 
+ * The text lives in a buffer owned by the model and reused across calls, so
+ * it is only valid until the next generate call on this model.
+ * 
+ * @param model Model handle
+ * @param length Optional output for the text length in bytes
+ * @return NUL-terminated reply text (empty before the first call)
+ */
+const char* berdcore_model_get_last_response(berdcore_model_t model, size_t* length);
+
+/**
+ * Get number of prompt tokens the last generate call reused from the KV cache
+ * 
+ * A call reuses the cache when its messages start with the previous prompt
+ * followed by the reply that was generated for it.
+ */
+int berdcore_model_get_reused_tokens(berdcore_model_t model);
+
+/**
+ * Get metrics for the last generate call on this model
+ * 
+ * Covers every generation path (sync, async and sessions), including
+ * failed and cancelled calls.
+ * 
+ * @param model Model handle
+ * @param stats Output stats
+ * @return Error code
+ */
+berdcore_error_t berdcore_model_get_last_stats(berdcore_model_t model, berdcore_inference_stats_t* stats);
+
+/**
+ * Get cumulative counters for all generate calls on this model
+ */
+berdcore_error_t berdcore_model_get_counters(berdcore_model_t model, berdcore_model_counters_t* counters);
+
+/**
+ * Reset the cumulative counters
+ */
+void berdcore_model_reset_counters(berdcore_model_t model);
+
+/**
+ * Drop all cached KV state so the next generate call prefills from scratch
+ */
+void berdcore_model_reset_cache(berdcore_model_t model);
+
+/**
+ * Set the memory budget for cached KV state
+ * 
+ * With a non-zero budget the model keeps extra Cactus contexts so that
+ * several conversations stay warm, evicting the least recently used one
+ * when the estimated KV memory goes over budget. 0 (default) keeps a single
+ * context.
+ * 
+ * @param model Model handle
+ * @param max_bytes Budget in bytes for all cached KV state
+ * @return Error code
+ */
+berdcore_error_t berdcore_model_set_kv_cache_budget(berdcore_model_t model, size_t max_bytes);
+
+/**
+ * Get estimated bytes currently held by cached KV state
+ */
+size_t berdcore_model_get_kv_cache_usage(berdcore_model_t model);
+
+/**
+ * Get the context size the model was loaded with
+ * 
+ * Smaller than the requested one when kv_memory_limit capped it.
+ */
+int berdcore_model_get_context_size(berdcore_model_t model);
+
+/**
+ * Estimate the KV cache memory a context needs
+ * 
+ * Cactus keeps K and V in fp16, so this is what a full context of the
+ * given length holds per Cactus context. Use it to pick context_size or
+ * kv_memory_limit for a device.
+ * 
+ * @param model_type Model to estimate for
+ * @param context_tokens Context length in tokens
+ * @return Estimated bytes, 0 for an unknown model type
+ */
+size_t berdcore_estimate_kv_bytes(berdcore_model_type_t model_type, int context_tokens);
+
+/**
+ * Set where this model's inference runs
+ * 
+ * Applies to the thread that runs each generation (the caller's, or the
+ * async worker) and to engine threads it starts, from prefill to decode:
+ * prefill can spread over the performance cores while decode, which is
+ * bound by memory bandwidth, stays on fewer or efficiency cores to save
+ * power. The thread is put back as it was when the call returns.
+ * 
+ * On Apple platforms placement is by QoS class, which is what steers work
+ * between core types there: a performance preference runs at least
+ * user-initiated, an efficiency preference runs as background. Core counts
+ * cannot be enforced there. On Linux and Android the thread is pinned to
+ * that many cores of the preferred class, and QoS is ignored.
+ * 
+ * @param model Model handle
+ * @param config Thread settings (NULL restores the defaults)
+ * @return Error code
+ */
+berdcore_error_t berdcore_model_set_thread_config(berdcore_model_t model, const berdcore_thread_config_t* config);
+
+/**
+ * Enable or disable the decode governor
+ * 
+ * Keeps long replies from collapsing once the device heats up, by trading
+ * peak speed for a rate it can sustain. The governor learns the model's
+ * decode rate while the device is cool. Each thermal step above nominal
+ * then paces decode to sustained_fraction of the rate below the previous
+ * step. At serious (or in low-power mode) decode also moves to the
+ * efficiency cores and max_tokens is halved, and at critical it is
+ * quartered. A reply whose decode falls below half the cool rate before
+ * the host reports anything is paced from that token on. Decisions are
+ * reported in berdcore_model_get_last_stats().
+ * 
+ * @param model Model handle
+ * @param options Governor settings (NULL disables it)
+ * @return Error code
+ */
+berdcore_error_t berdcore_model_set_governor(berdcore_model_t model, const berdcore_governor_options_t* options);
+
+// ============================================================================
+// MODEL POOL
+// ============================================================================
+
+/**
+ * Release a model's engine memory but keep its handle
+ * 
+ * Destroys the Cactus contexts (unmapping the weights and freeing all KV
+ * state) and tells the OS the weight pages can be dropped. The next
+ * generation, or berdcore_model_rehydrate(), reloads from the same path,
+ * which is fast while the files are still in the page cache.
+ * 
+ * @param model Model handle
+ * @return Error code
+ */
+berdcore_error_t berdcore_model_hibernate(berdcore_model_t model);
+
+/**
+ * Reload a hibernated model (no-op if it is resident)
+ * 
+ * A pooled model that is reloaded, here or by its next generation, becomes
+ * the pool's active model as with berdcore_pool_activate().
+ */
+berdcore_error_t berdcore_model_rehydrate(berdcore_model_t model);
+
+/**
+ * Create a pool that keeps its models within a memory budget
+ * 
+ * The pool does not own its models. On Apple platforms it also listens for
+ * system memory pressure and calls berdcore_pool_handle_memory_pressure()
+ * itself.
+ * 
+ * @param memory_budget Budget in bytes for resident weights plus KV state
+ *                      (0 = unlimited, only memory pressure shrinks the pool)
+ * @return Pool handle
+ */
+berdcore_model_pool_t berdcore_pool_create(size_t memory_budget);
+
+/**
+ * Add a model to a pool (a model belongs to at most one pool)
+ */
+berdcore_error_t berdcore_pool_add(berdcore_model_pool_t pool, berdcore_model_t model);
+
+/**
+ * Remove a model from a pool (berdcore_free_model does this automatically)
+ */
+berdcore_error_t berdcore_pool_remove(berdcore_model_pool_t pool, berdcore_model_t model);
+
+/**
+ * Make a model the pool's active model
+ * 
+ * Rehydrates it if needed, then hibernates the least recently active models
+ * until the pool fits its budget. The active model is never hibernated by
+ * the pool; models that are busy generating are skipped.
+ * 
+ * @param pool Pool handle
+ * @param model Model in the pool
+ * @return Error code
+ */
+berdcore_error_t berdcore_pool_activate(berdcore_model_pool_t pool, berdcore_model_t model);
+
+/**
+ * Shrink the pool in response to memory pressure
+ * 
+ * Warning keeps only each model's most recently used KV context. Critical
+ * hibernates every inactive model and drops the active model's KV state.
+ * 
+ * @param pool Pool handle
+ * @param level Pressure level
+ */
+void berdcore_pool_handle_memory_pressure(berdcore_model_pool_t pool, berdcore_memory_pressure_t level);
+
+/**
+ * Get estimated bytes held by the pool's resident models
+ * 
+ * Does not wait for models that are generating; they count with what they
+ * held when last measured.
+ */
+size_t berdcore_pool_get_memory_usage(berdcore_model_pool_t pool);
+
+/**
+ * Free a pool (its models stay loaded)
+ */
+void berdcore_pool_free(berdcore_model_pool_t pool);
+
 // ============================================================================
 // INFERENCE
 // ============================================================================
@@ -109,7 +524,8 @@ float berdcore_model_get_progress(berdcore_model_t model);
  * @param model Model handle
  * @param messages JSON array of chat messages (OpenAI format)
  * @param options Inference options (temperature, top_p, etc.)
- * @param token_callback Callback for each generated token
+ * @param token_callback Callback for each generated token, or NULL to only
+ *                       collect the reply (see berdcore_model_get_last_response)
  * @param user_data User data passed to callback
  * @return Error code (0 = success)
  */
@@ -121,6 +537,67 @@ berdcore_error_t berdcore_generate(
     void* user_data
 );
 
+/**
+ * Generate text completion, delivering tokens in batches
+ * 
+ * Same as berdcore_generate() but tokens are grouped to cut per-token
+ * callback overhead. The final batch has is_final set and may be empty.
+ * 
+ * @param model Model handle
+ * @param messages JSON array of chat messages (OpenAI format)
+ * @param options Inference options (temperature, top_p, etc.)
+ * @param streaming Batching options (NULL for defaults)
+ * @param batch_callback Callback for each batch of generated tokens
+ * @param user_data User data passed to callback
+ * @return Error code (0 = success)
+ */
+berdcore_error_t berdcore_generate_batched(
+    berdcore_model_t model,
+    const char* messages,
+    const berdcore_inference_options_t* options,
+    const berdcore_streaming_options_t* streaming,
+    berdcore_token_batch_callback_t batch_callback,
+    void* user_data
+);
+
+/**
+ * Generate text from structured chat messages
+ * 
+ * Same as berdcore_generate() without building or parsing a JSON string:
+ * the engine request is written straight from the caller's buffers and a
+ * call that extends the cached conversation only copies the new messages.
+ * The buffers only need to stay valid for the duration of the call.
+ * 
+ * @param model Model handle
+ * @param messages Array of messages
+ * @param num_messages Number of messages
+ * @param options Inference options
+ * @param token_callback Callback for streaming tokens (may be NULL)
+ * @param user_data User data for callback
+ * @return Error code
+ */
+berdcore_error_t berdcore_generate_messages(
+    berdcore_model_t model,
+    const berdcore_message_t* messages,
+    size_t num_messages,
+    const berdcore_inference_options_t* options,
+    berdcore_token_callback_t token_callback,
+    void* user_data
+);
+
+/**
+ * berdcore_generate_messages() with batched token delivery
+ */
+berdcore_error_t berdcore_generate_messages_batched(
+    berdcore_model_t model,
+    const berdcore_message_t* messages,
+    size_t num_messages,
+    const berdcore_inference_options_t* options,
+    const berdcore_streaming_options_t* streaming,
+    berdcore_token_batch_callback_t batch_callback,
+    void* user_data
+);
+
 /**
  * Generate text with system prompt
  */
@@ -133,6 +610,85 @@ berdcore_error_t berdcore_generate_with_system(
     void* user_data
 );
 
+// ============================================================================
+// ASYNC INFERENCE
+// ============================================================================
+
+/**
+ * Queue a generation on the model's inference worker thread
+ * 
+ * Requests run one at a time in submission order. Token and completion
+ * callbacks are invoked on the worker thread; inside the completion callback
+ * berdcore_get_last_error() describes a failure.
+ * 
+ * @param model Model handle
+ * @param messages JSON array of chat messages (copied)
+ * @param options Inference options (copied, may be NULL)
+ * @param token_callback Callback for each generated token (may be NULL)
+ * @param completion_callback Called when the request finishes, fails or is cancelled
+ * @param user_data User data passed to callbacks
+ * @return Request id, or 0 if the request could not be queued (queue full)
+ */
+berdcore_request_id_t berdcore_generate_async(
+    berdcore_model_t model,
+    const char* messages,
+    const berdcore_inference_options_t* options,
+    berdcore_token_callback_t token_callback,
+    berdcore_completion_callback_t completion_callback,
+    void* user_data
+);
+
+/**
+ * Queue a generation on the worker thread, delivering tokens in batches
+ */
+berdcore_request_id_t berdcore_generate_async_batched(
+    berdcore_model_t model,
+    const char* messages,
+    const berdcore_inference_options_t* options,
+    const berdcore_streaming_options_t* streaming,
+    berdcore_token_batch_callback_t batch_callback,
+    berdcore_completion_callback_t completion_callback,
+    void* user_data
+);
+
+/**
+ * Queue a background job (chat titles, summaries, follow-up suggestions)
+ * 
+ * Background jobs run on the inference worker only when no foreground
+ * request is waiting. A foreground generation on the same model, sync or
+ * async, preempts a running job within one decode step; the job is
+ * restarted once the model is free, up to a few times before it is left
+ * to finish. Its KV state stays in slots used for background work where
+ * possible so it does not evict warm chats. The reply is delivered once,
+ * on the worker thread, when the job completes.
+ * 
+ * @param model Model handle
+ * @param messages JSON array of chat messages (copied)
+ * @param options Inference options (copied, may be NULL)
+ * @param result_callback Called with the reply, or the error
+ * @param user_data User data passed to the callback
+ * @return Request id (cancel with berdcore_cancel), or 0 if the queue is full
+ */
+berdcore_request_id_t berdcore_generate_background(
+    berdcore_model_t model,
+    const char* messages,
+    const berdcore_inference_options_t* options,
+    berdcore_result_callback_t result_callback,
+    void* user_data
+);
+
+/**
+ * Cancel an async request
+ * 
+ * A queued request is removed and completes with BERDCORE_ERROR_CANCELLED
+ * right away. A running request stops at the next decode step and then
+ * completes with BERDCORE_ERROR_CANCELLED. Only that request is stopped,
+ * never another caller's generation on the same model.
+ * 
+ * @return Error code (BERDCORE_ERROR_INVALID_PARAM if the request is unknown or done)
+ */
+berdcore_error_t berdcore_cancel(berdcore_model_t model, berdcore_request_id_t request_id);
+
 // ============================================================================
 // PERPLEXITY SEARCH
 // ============================================================================
@@ -167,7 +723,10 @@ berdcore_error_t berdcore_search(
 void berdcore_free_search_results(berdcore_search_result_t* results, int num_results);
 
 /**
- * Fetch webpage content (simple HTML stripping)
+ * Fetch a webpage as readable text (HTML is reduced to its text)
+ * 
+ * Served from the search and page cache while the URL is fresh there; a
+ * stale entry is revalidated with If-None-Match / If-Modified-Since.
  */
 berdcore_error_t berdcore_fetch_page(
     const char* url,
@@ -175,6 +734,82 @@ berdcore_error_t berdcore_fetch_page(
     size_t* content_length
 );
 
+/**
+ * Fetch a webpage as readable text, stopping once enough text is in
+ * 
+ * HTML is reduced to text while it downloads, preferring the <main> or
+ * <article> content and skipping scripts, styles and navigation. The
+ * transfer is aborted as soon as max_text_bytes of text have been
+ * extracted, so the rest of the page is never downloaded.
+ * 
+ * @param url Page URL
+ * @param max_text_bytes Text to keep at most, cut at a UTF-8 boundary (0 = no limit)
+ * @param content Output text (free with berdcore_free_string)
+ * @param content_length Length of content in bytes
+ * @return Error code
+ */
+berdcore_error_t berdcore_fetch_page_limited(
+    const char* url,
+    size_t max_text_bytes,
+    char** content,
+    size_t* content_length
+);
+
+// Options for berdcore_search_and_fetch (zeroed fields use the defaults)
+typedef struct {
+    int max_results;        // search results to request (0 = 5)
+    int max_fetch;          // top results whose pages are fetched (0 = 3)
+    int fetch_timeout_ms;   // deadline per page (0 = 5000)
+    int total_timeout_ms;   // budget for the whole call, search included (0 = 10000)
+    size_t max_page_bytes;  // downloads stop after this many bytes (0 = 512 KB)
+    size_t max_text_bytes;  // or once this much page text is extracted (0 = 16 KB)
+} berdcore_search_fetch_options_t;
+
+// Called once for each page fetched (the first max_fetch results) as it
+// finishes; content is NULL if it failed or missed the budget. content is
+// owned by the pages array of the call.
+typedef void (*berdcore_page_callback_t)(int result_index,
+                                         const char* content,
+                                         size_t content_length,
+                                         berdcore_error_t status,
+                                         void* user_data);
+
+/**
+ * Search, then fetch the top result pages concurrently
+ * 
+ * The pages are fetched in parallel on one curl multi handle, so the
+ * latency is that of the slowest page rather than the sum of them, and
+ * bounded by total_timeout_ms. Pages that fail or are still in flight when
+ * the budget runs out are left NULL; the call still succeeds as long as
+ * the search did.
+ * 
+ * @param api_key Perplexity API key
+ * @param query Search query
+ * @param options Fetch options (may be NULL)
+ * @param results Output array of results (free with berdcore_free_search_results)
+ * @param num_results Number of results returned
+ * @param pages Output page content per result, NULL where not fetched
+ *              (free with berdcore_free_pages using num_results)
+ * @param page_callback Called as each page finishes (may be NULL)
+ * @param user_data User data for callback
+ * @return Error code
+ */
+berdcore_error_t berdcore_search_and_fetch(
+    const char* api_key,
+    const char* query,
+    const berdcore_search_fetch_options_t* options,
+    berdcore_search_result_t** results,
+    int* num_results,
+    char*** pages,
+    berdcore_page_callback_t page_callback,
+    void* user_data
+);
+
+/**
+ * Free pages returned by berdcore_search_and_fetch
+ */
+void berdcore_free_pages(char** pages, int num_pages);
+
 /**
  * Create augmented prompt with search results
  */
@@ -186,17 +821,232 @@ char* berdcore_create_augmented_prompt(
     int num_fetched
 );
 
+/**
+ * Create an augmented prompt that fits a token budget
+ * 
+ * Pages are split into passages at paragraph and sentence breaks and
+ * ranked by the query terms they cover and the rank of their source. As
+ * many whole passages as fit are kept, and the remaining room is filled
+ * with the best passage left, cut at a sentence boundary; text is never
+ * split inside a UTF-8 character. Sources appear in rank order with their
+ * passages in page order. Where no page was fetched the snippet competes
+ * as a passage.
+ * 
+ * Token counts are estimated from the model's bytes-per-token ratio, which
+ * is calibrated from engine counts as the model generates (the engine does
+ * not expose its tokenizer).
+ * 
+ * @param model Model whose token estimate and context size are used (may be NULL)
+ * @param original_query User's question
+ * @param results Search results in rank order
+ * @param num_results Number of results
+ * @param fetched_content Page text per result, NULL where not fetched (may be NULL)
+ * @param num_fetched Number of entries in fetched_content
+ * @param max_tokens Token budget for the whole prompt (0 = half the model's context)
+ * @param token_count Output estimated tokens of the prompt (may be NULL)
+ * @return Prompt (free with berdcore_free_string), or NULL on invalid parameters
+ */
+char* berdcore_build_augmented_prompt(
+    berdcore_model_t model,
+    const char* original_query,
+    const berdcore_search_result_t* results,
+    int num_results,
+    const char** fetched_content,
+    int num_fetched,
+    int max_tokens,
+    int* token_count
+);
+
+// Search and page cache settings (zeroed fields use the defaults)
+typedef struct {
+    const char* directory;        // cache files go here, created if missing (NULL = memory only)
+    size_t memory_budget_bytes;   // least recently used entries are evicted past this (0 = 16 MB)
+    int search_ttl_seconds;       // search results are reused this long (0 = 600, < 0 = off)
+    int page_ttl_seconds;         // pages are reused this long, then revalidated (0 = 3600, < 0 = off)
+} berdcore_cache_options_t;
+
+/**
+ * Configure the search and page cache
+ * 
+ * Search results are cached by normalized query and result count, pages by
+ * normalized URL, and pages are kept as extracted text rather than HTML. A
+ * shorter Cache-Control max-age from the server wins over page_ttl_seconds,
+ * and no-store responses are never cached. The cache is on in memory by
+ * default; pass a directory to keep entries across launches.
+ * 
+ * @param options Cache settings (NULL restores the defaults)
+ * @return Error code
+ */
+berdcore_error_t berdcore_cache_configure(const berdcore_cache_options_t* options);
+
+/**
+ * Drop every cached search and page
+ * 
+ * @param include_disk Non-zero to delete the cache files as well
+ */
+void berdcore_cache_clear(int include_disk);
+
 // ============================================================================
 // MARKDOWN PROCESSING
 // ============================================================================
 
+// A top-level block rendered by the streaming markdown renderer
+typedef struct {
+    int index;           // position of the block in the message
+    const char* html;    // NUL-terminated, valid until the next call on the stream
+    size_t html_length;
+    int is_final;        // 1 once later text can no longer change the block
+} berdcore_markdown_block_t;
+
+typedef void* berdcore_markdown_stream_t;
+
 /**
- * Parse markdown to HTML
+ * Render markdown as HTML
+ * 
+ * Supports a CommonMark subset (headings, paragraphs, fenced and indented
+ * code, block quotes, nested lists, thematic breaks, emphasis, code spans,
+ * links, images, autolinks) plus GFM tables, strikethrough and bare URLs.
+ * Raw HTML in the input is escaped.
+ * 
+ * @param markdown Markdown text
+ * @return HTML (free with berdcore_free_string) or NULL
  */
 char* berdcore_markdown_to_html(const char* markdown);
 
 /**
- * Extract code blocks from markdown
+ * Create a renderer for markdown that arrives incrementally
+ * 
+ * Feed generated text as it streams in. Each call re-parses only the blocks
+ * that can still change and reports only blocks whose HTML changed, so a
+ * view keeps an array of block HTML and replaces entries by index instead
+ * of re-rendering the whole message per token.
+ * 
+ * @return Stream handle
+ */
+berdcore_markdown_stream_t berdcore_markdown_stream_create(void);
+
+/**
+ * Append text to a markdown stream
+ * 
+ * @param stream Stream handle
+ * @param text Text to append (not necessarily NUL-terminated; may split
+ *        lines or UTF-8 sequences)
+ * @param length Bytes of text
+ * @param blocks Output: blocks that changed, in index order (owned by the stream)
+ * @param num_blocks Output: number of changed blocks
+ * @param total_blocks Output: blocks in the message so far; drop any past
+ *        this, which happens when a line that began a block turns out to
+ *        continue the previous one (may be NULL)
+ * @return Error code
+ */
+berdcore_error_t berdcore_markdown_stream_append(
+    berdcore_markdown_stream_t stream,
+    const char* text,
+    size_t length,
+    const berdcore_markdown_block_t** blocks,
+    int* num_blocks,
+    int* total_blocks
+);
+
+/**
+ * End a markdown stream; every remaining block is reported as final
+ */
+berdcore_error_t berdcore_markdown_stream_finish(
+    berdcore_markdown_stream_t stream,
+    const berdcore_markdown_block_t** blocks,
+    int* num_blocks,
+    int* total_blocks
+);
+
+/**
+ * Free markdown stream
+ */
+void berdcore_markdown_stream_free(berdcore_markdown_stream_t stream);
+
+// A fenced code block as byte ranges of the markdown it was found in
+typedef struct {
+    size_t language_offset;  // first word of the info string
+    size_t language_length;  // 0 if the fence has no language
+    size_t code_offset;      // first line after the opening fence
+    size_t code_length;      // through the newline of the last code line
+    size_t indent;           // columns the fence was indented; strip up to this from each line
+    int is_closed;           // 0 while the closing fence has not arrived
+} berdcore_code_span_t;
+
+// State of an incremental code block scan (initialize with berdcore_code_scanner_init)
+typedef struct {
+    size_t position;         // offset of the first line not scanned yet
+    int in_block;
+    char fence_char;
+    size_t fence_length;
+    berdcore_code_span_t current;
+} berdcore_code_scanner_t;
+
+/**
+ * Find the fenced code blocks of markdown in one pass
+ * 
+ * Spans point into markdown; nothing is allocated or copied. Fences are
+ * recognized at any indentation, so code inside list items is found too.
+ * 
+ * @param markdown Markdown text
+ * @param length Bytes of markdown
+ * @param spans Output array (may be NULL when max_spans is 0)
+ * @param max_spans Capacity of spans
+ * @param num_spans Output: blocks found, which may exceed max_spans
+ * @return Error code
+ */
+berdcore_error_t berdcore_find_code_blocks(
+    const char* markdown,
+    size_t length,
+    berdcore_code_span_t* spans,
+    int max_spans,
+    int* num_spans
+);
+
+/**
+ * Reset a scanner for a new message
+ */
+void berdcore_code_scanner_init(berdcore_code_scanner_t* scanner);
+
+/**
+ * Scan text that has grown since the last call
+ * 
+ * Pass the whole message so far each time (it may have moved); only lines
+ * completed since the last call are read. Reports the blocks closed since
+ * then and, while one is still being generated, that block with is_closed
+ * 0 and the code received so far, so highlighting can start before the
+ * closing fence arrives. When spans fill up the rest is reported by the
+ * next call.
+ * 
+ * @param scanner Scanner state
+ * @param text Message so far
+ * @param length Bytes of text
+ * @param is_final 1 when generation has ended (the last line needs no newline)
+ * @param spans Output array
+ * @param max_spans Capacity of spans (at least 1)
+ * @param num_spans Output: spans written
+ * @return Error code
+ */
+berdcore_error_t berdcore_code_scanner_feed(
+    berdcore_code_scanner_t* scanner,
+    const char* text,
+    size_t length,
+    int is_final,
+    berdcore_code_span_t* spans,
+    int max_spans,
+    int* num_spans
+);
+
+/**
+ * Extract code blocks from markdown as copies
+ * 
+ * Prefer berdcore_find_code_blocks, which copies nothing.
+ * 
+ * @param markdown Markdown text
+ * @param languages Output: language per block ("" if none)
+ * @param codes Output: code per block
+ * @param num_blocks Output: number of blocks
+ * @return Error code (free the arrays with berdcore_free_code_blocks)
  */
 berdcore_error_t berdcore_extract_code_blocks(
     const char* markdown,
@@ -205,6 +1055,11 @@ berdcore_error_t berdcore_extract_code_blocks(
     int* num_blocks
 );
 
+/**
+ * Free the arrays returned by berdcore_extract_code_blocks
+ */
+void berdcore_free_code_blocks(char** languages, char** codes, int num_blocks);
+
 /**
  * Free markdown processing results
  */
@@ -228,16 +1083,288 @@ berdcore_error_t berdcore_conversation_add_message(
     const char* content
 );
 
+/**
+ * Get number of messages in a conversation
+ */
+size_t berdcore_conversation_get_message_count(berdcore_conversation_t conv);
+
+/**
+ * Borrow a message of a conversation
+ * 
+ * The pointers stay valid until the conversation is modified or freed.
+ * 
+ * @param conv Conversation handle
+ * @param index Message index
+ * @param message Output role and content views
+ * @param token_count Output engine-reported tokens for the message, -1 if
+ *                    unknown (may be NULL). Known for turns generated
+ *                    through a session.
+ * @return Error code
+ */
+berdcore_error_t berdcore_conversation_get_message(
+    berdcore_conversation_t conv,
+    size_t index,
+    berdcore_message_t* message,
+    int* token_count
+);
+
+/**
+ * Borrow the conversation as a JSON messages array (OpenAI format)
+ * 
+ * The JSON is kept up to date as messages are added, so this does not
+ * serialize anything. The pointer stays valid until the conversation is
+ * modified or freed.
+ * 
+ * @param conv Conversation handle
+ * @param length Output length in bytes (may be NULL)
+ * @return NUL-terminated JSON
+ */
+const char* berdcore_conversation_get_json(berdcore_conversation_t conv, size_t* length);
+
 /**
  * Get conversation as JSON (OpenAI format)
+ * 
+ * Copy of berdcore_conversation_get_json() (caller must free with
+ * berdcore_free_string).
  */
 char* berdcore_conversation_to_json(berdcore_conversation_t conv);
 
+/**
+ * Save a conversation to a binary log file
+ * 
+ * The first save (or a save to a different path) writes the whole file
+ * atomically; saving the same conversation to the same path again only
+ * appends the messages added since. Token counts are stored with each
+ * message, but token IDs are not: the engine accepts only text, so a
+ * loaded conversation is prefilled again from its text the first time a
+ * session uses it.
+ * 
+ * @param conv Conversation handle
+ * @param path File path
+ * @return Error code
+ */
+berdcore_error_t berdcore_conversation_save(berdcore_conversation_t conv, const char* path);
+
+/**
+ * Load a conversation saved by berdcore_conversation_save
+ * 
+ * The records are read straight into the conversation storage without
+ * parsing message text. A torn last record (from an interrupted append) is
+ * ignored.
+ * 
+ * @param path File path
+ * @return Conversation handle or NULL on failure
+ */
+berdcore_conversation_t berdcore_conversation_load(const char* path);
+
 /**
  * Free conversation
  */
 void berdcore_conversation_free(berdcore_conversation_t conv);
 
+// ============================================================================
+// SESSIONS
+// ============================================================================
+
+/**
+ * Bind a conversation to a model's live KV state
+ * 
+ * The session appends to the conversation, which must outlive it. While the
+ * session is the last user of the model, each turn only prefills the new
+ * messages instead of the whole history.
+ * 
+ * @param model Model handle
+ * @param conv Conversation holding the history so far
+ * @return Session handle or NULL on failure
+ */
+berdcore_session_t berdcore_session_create(
+    berdcore_model_t model,
+    berdcore_conversation_t conv
+);
+
+/**
+ * Append a message and generate the reply
+ * 
+ * The generated reply is appended to the conversation as an "assistant"
+ * message once generation succeeds.
+ * 
+ * @param session Session handle
+ * @param role Role of the new message (usually "user")
+ * @param content Content of the new message
+ * @param options Inference options (temperature, top_p, etc.)
+ * @param token_callback Callback for each generated token, or NULL
+ * @param user_data User data passed to callback
+ * @return Error code (0 = success)
+ */
+berdcore_error_t berdcore_session_append_and_generate(
+    berdcore_session_t session,
+    const char* role,
+    const char* content,
+    const berdcore_inference_options_t* options,
+    berdcore_token_callback_t token_callback,
+    void* user_data
+);
+
+/**
+ * Append a message and generate the reply, delivering tokens in batches
+ */
+berdcore_error_t berdcore_session_append_and_generate_batched(
+    berdcore_session_t session,
+    const char* role,
+    const char* content,
+    const berdcore_inference_options_t* options,
+    const berdcore_streaming_options_t* streaming,
+    berdcore_token_batch_callback_t batch_callback,
+    void* user_data
+);
+
+/**
+ * Set how a session keeps its conversation within the context window
+ * 
+ * Before each turn the session estimates the tokens it would send (engine
+ * counts for turns it generated, a calibrated byte estimate otherwise).
+ * When the turn would not fit it moves the window forward to target_tokens,
+ * so the re-prefill this needs happens once per many turns instead of on
+ * every one. The conversation itself keeps the full history.
+ * 
+ * @param session Session handle
+ * @param options Context options (copied; summary_prompt must stay valid)
+ * @return Error code
+ */
+berdcore_error_t berdcore_session_set_context_policy(
+    berdcore_session_t session,
+    const berdcore_context_options_t* options
+);
+
+/**
+ * Free session (the conversation and model are not freed)
+ * 
+ * The session's resident KV state is dropped, so the model must still be
+ * alive.
+ */
+void berdcore_session_free(berdcore_session_t session);
+
+// ============================================================================
+// LOCAL RETRIEVAL
+// ============================================================================
+
+/**
+ * Embed text with the model
+ * 
+ * Uses a small context of its own, created on first use, so it never
+ * disturbs the KV state of sessions on the same model.
+ * 
+ * @param model Model handle
+ * @param text Text to embed
+ * @param embedding Output buffer of max_dim floats
+ * @param max_dim Capacity of embedding
+ * @param dim Output: embedding dimension (set even when max_dim is too small)
+ * @return Error code
+ */
+berdcore_error_t berdcore_embed(
+    berdcore_model_t model,
+    const char* text,
+    float* embedding,
+    size_t max_dim,
+    size_t* dim
+);
+
+/**
+ * Create an empty embedding index over passages of text
+ * 
+ * Vectors are stored as int8 and scanned exhaustively while the index is
+ * small, then partitioned into inverted lists so a search reads only the
+ * lists nearest the query. The model handle must outlive the index.
+ * 
+ * @param model Model used to embed passages and queries
+ * @return Index handle or NULL on error
+ */
+berdcore_index_t berdcore_index_create(berdcore_model_t model);
+
+/**
+ * Load an index written by berdcore_index_save
+ * 
+ * @param model Model the index was built with
+ * @param path Index file path
+ * @return Index handle or NULL on error
+ */
+berdcore_index_t berdcore_index_load(berdcore_model_t model, const char* path);
+
+/**
+ * Save the index (written to a temporary file, then renamed into place)
+ */
+berdcore_error_t berdcore_index_save(berdcore_index_t index, const char* path);
+
+/**
+ * Split text into passages and index each one
+ * 
+ * Passages already indexed under the same ref are skipped.
+ * 
+ * @param index Index handle
+ * @param title Title returned with hits (may be NULL)
+ * @param ref Reference returned with hits, e.g. a URL (may be NULL)
+ * @param text Text to index
+ * @return Error code
+ */
+berdcore_error_t berdcore_index_add_text(
+    berdcore_index_t index,
+    const char* title,
+    const char* ref,
+    const char* text
+);
+
+/**
+ * Index the user and assistant messages of a conversation
+ * 
+ * Hits carry the conversation title and a ref of the form
+ * "conversation:<title>#<message index>".
+ * 
+ * @param index Index handle
+ * @param conv Conversation handle
+ * @param first_message First message to index, so a growing conversation
+ *        can be indexed incrementally (earlier ones are skipped anyway)
+ * @return Error code
+ */
+berdcore_error_t berdcore_index_add_conversation(
+    berdcore_index_t index,
+    berdcore_conversation_t conv,
+    size_t first_message
+);
+
+/**
+ * Number of indexed passages
+ */
+size_t berdcore_index_size(berdcore_index_t index);
+
+/**
+ * Find the passages closest to a query
+ * 
+ * Hits come back as search results (title, ref as url, passage as
+ * snippet), so they can be passed straight to
+ * berdcore_create_augmented_prompt or berdcore_build_augmented_prompt.
+ * 
+ * @param index Index handle
+ * @param query Query text
+ * @param max_results Maximum hits
+ * @param results Output: array of hits, best first (free with berdcore_free_search_results)
+ * @param scores Output: cosine similarity per hit, max_results floats (may be NULL)
+ * @param num_results Output: number of hits
+ * @return Error code
+ */
+berdcore_error_t berdcore_index_search(
+    berdcore_index_t index,
+    const char* query,
+    int max_results,
+    berdcore_search_result_t** results,
+    float* scores,
+    int* num_results
+);
+
+/**
+ * Free index
+ */
+void berdcore_index_free(berdcore_index_t index);
+
 // ============================================================================
 // UTILITIES
 // ============================================================================
@@ -257,6 +1384,57 @@ const char* berdcore_get_last_error(void);
  */
 void berdcore_set_log_level(int level);
 
+/**
+ * Get the number of performance and efficiency cores (logical CPUs)
+ * 
+ * Machines with a single core type report all cores as performance cores.
+ * 
+ * @param performance_cores Output count (may be NULL)
+ * @param efficiency_cores Output count (may be NULL)
+ */
+void berdcore_get_cpu_topology(int* performance_cores, int* efficiency_cores);
+
+/**
+ * Report the device's thermal state and low-power mode to the governor
+ * 
+ * Call on launch and whenever the host is notified of a change; the state
+ * applies to all models from their next token.
+ * 
+ * @param thermal_state Current thermal state
+ * @param low_power_mode 1 if the user enabled low-power mode
+ */
+void berdcore_set_device_state(berdcore_thermal_state_t thermal_state, int low_power_mode);
+
+// ============================================================================
+// TRACING
+// ============================================================================
+
+/**
+ * Enable or disable trace recording (off by default)
+ * 
+ * Records init, prefill, per-token decode, callback, network and JSON
+ * parsing intervals into per-thread ring buffers. On Apple platforms the
+ * same intervals are emitted as os_signposts whenever Instruments is
+ * recording, independent of this setting.
+ */
+void berdcore_trace_set_enabled(int enabled);
+
+/**
+ * Discard recorded trace events
+ */
+void berdcore_trace_clear(void);
+
+/**
+ * Export recorded events as Chrome trace JSON (chrome://tracing, Perfetto)
+ * 
+ * Each thread keeps its most recent events only. Events are copied while
+ * their threads keep recording, without stopping them; events overwritten
+ * during the copy are left out.
+ * 
+ * @return JSON string (caller must free with berdcore_free_string)
+ */
+char* berdcore_trace_export_chrome(void);
+
 #ifdef __cplusplus
 }
 #endif
@@ -1,12 +1,36 @@
 #include "berdcore.h"
+#include "berdcore_weights.h"
+#include "berdcore_trace.h"
+#include "berdcore_json.h"
+#include "berdcore_http.h"
+#include "berdcore_cache.h"
+#include "berdcore_html.h"
+#include "berdcore_index.h"
+#include "berdcore_markdown.h"
+#include "berdcore_schema.h"
+#include "berdcore_threads.h"
 #include <cactus.h>
+#ifdef __APPLE__
+#include <dispatch/dispatch.h>
+#endif
 #include <string>
 #include <vector>
 #include <memory>
 #include <sstream>
 #include <mutex>
 #include <atomic>
+#include <chrono>
+#include <thread>
+#include <condition_variable>
+#include <deque>
+#include <algorithm>
+#include <cctype>
+#include <cmath>
 #include <cstring>
+#include <string_view>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #include <curl/curl.h>
 #include <json/json.h>
 
@@ -14,6 +38,74 @@
 // INTERNAL STRUCTURES
 // ============================================================================
 
+typedef std::pair<std::string, std::string> BerdCoreMessage; // role, content
+
+// One Cactus context and the conversation state resident in its KV cache.
+// Cactus keeps the KV cache of the previous completion alive until
+// cactus_reset(). kv_messages mirrors what is resident there (the last
+// prompt plus the generated reply) so the next call only has to prefill
+// the messages that come after it. When a session owns the slot, kv_owner
+// holds its id and the session tracks the resident history itself.
+struct BerdCoreKvSlot {
+    cactus_model_t cactus_model;
+    std::vector<BerdCoreMessage> kv_messages;
+    uint64_t kv_owner;
+    bool kv_resident;
+    int kv_tokens;
+    uint64_t last_used;
+    bool background;  // last used by a background job
+    
+    explicit BerdCoreKvSlot(cactus_model_t cm) : cactus_model(cm), kv_owner(0),
+                                                 kv_resident(false), kv_tokens(0), last_used(0),
+                                                 background(false) {}
+};
+
+// Staging buffer for batched token delivery. Batches are handed to the
+// caller synchronously on the inference thread, so the buffer is rewound
+// after every flush and its capacity is reused across calls.
+struct BerdCoreTokenBatcher {
+    std::string text;
+    std::vector<uint32_t> text_offsets;
+    std::vector<uint32_t> token_ids;
+    std::vector<uint64_t> timestamps_ns;
+    size_t max_tokens;
+    uint64_t flush_interval_ns;
+    
+    BerdCoreTokenBatcher() : max_tokens(16), flush_interval_ns(0) {}
+};
+
+// Streaming target for generated tokens: one callback per token, or batches
+// assembled in the model's token batcher
+struct BerdCoreTokenSink {
+    berdcore_token_callback_t token_callback;
+    berdcore_token_batch_callback_t batch_callback;
+    void* user_data;
+};
+
+// A queued berdcore_generate_async() call. Everything the caller passed is
+// copied so it can outlive the submitting call.
+struct BerdCoreAsyncRequest {
+    uint64_t id;
+    std::string messages;
+    berdcore_inference_options_t options;
+    std::string stop_sequences;
+    std::string json_schema;
+    bool has_options;
+    berdcore_streaming_options_t streaming;
+    bool has_streaming;
+    BerdCoreTokenSink sink;
+    berdcore_completion_callback_t completion_callback;
+    
+    // Background jobs deliver their text once, through result_callback, so
+    // a preempted run can be restarted without the caller seeing it twice
+    bool background;
+    berdcore_result_callback_t result_callback;
+    int preemptions;
+    uint64_t submitted_ns;   // time to first token counts from here
+};
+
+struct BerdCoreModelPool;
+
 struct BerdCoreModel {
     berdcore_model_type_t type;
     cactus_model_t cactus_model;
@@ -22,17 +114,187 @@ struct BerdCoreModel {
     int context_size;
     std::string model_path;
     
+    // Weight files in paging order, and the warm-up thread that pages them
+    // in after the model is ready
+    std::vector<BerdCoreWeightFile> weight_files;
+    std::thread warmup_thread;
+    std::atomic<bool> warmup_cancel;
+    
+    // Residency. A hibernated model has no Cactus context (and so no weight
+    // mappings or KV memory) but keeps its handle; it is rehydrated on next
+    // use. Guarded by inference_mutex, except footprint: the resident bytes
+    // when last measured, which the pool reads while the model is busy.
+    bool hibernated;
+    BerdCoreModelPool* pool;
+    uint64_t pool_last_active;
+    std::atomic<size_t> footprint;
+    
+    // KV slot cache. kv_slots[0] wraps cactus_model; further slots are extra
+    // Cactus contexts created while the cache is under kv_cache_budget so
+    // several chats can keep their KV state warm at once.
+    std::mutex inference_mutex;
+    std::vector<std::unique_ptr<BerdCoreKvSlot>> kv_slots;
+    size_t kv_cache_budget;
+    uint64_t kv_clock;
+    int last_reused_tokens;
+    float bytes_per_token;  // calibrated from engine counts, for token estimates
+    berdcore_thread_config_t thread_config;
+    
+    // Decode governor settings, and the decode rate of unpaced replies on a
+    // cool device that its pacing is relative to
+    berdcore_governor_options_t governor;
+    double cool_decode_tps;
+    
+    // Context used only by berdcore_embed, created on first use, so that
+    // embedding never disturbs the KV state of the chat slots
+    cactus_model_t embed_context;
+    berdcore_inference_stats_t last_stats;
+    berdcore_model_counters_t counters;
+    BerdCoreTokenBatcher batcher;
+    uint64_t request_start_ns;   // entry of the call being generated
+    size_t peak_scratch_bytes;   // highest scratch footprint since load
+    
+    // Reusable output buffers: completion_buffer receives the Cactus result
+    // JSON, response holds the text generated by the last call.
+    // reply_rewritten is set when a json_schema constraint trimmed or
+    // completed response, which then differs from the KV-resident text.
+    std::vector<char> completion_buffer;
+    std::string response;
+    bool reply_rewritten;
+    std::string options_json;
+    std::string request_json;
+    
+    // Async worker. The worker thread is started by the first async call and
+    // runs queued requests one at a time; active_request is the id being
+    // generated (0 when idle) and cancel_requested stops it at the next token
+    // (only the worker's own completion reads it, through t_cancel_flag).
+    // Background jobs run only when no foreground work is waiting. A running
+    // one stops at the next token when a foreground request is queued
+    // (preempt_requested) or a foreground call waits for inference_mutex
+    // (foreground_waiting), and goes back to the head of its queue.
+    std::thread worker;
+    std::mutex queue_mutex;
+    std::condition_variable queue_cv;
+    std::deque<BerdCoreAsyncRequest> queue;
+    std::deque<BerdCoreAsyncRequest> background_queue;
+    bool worker_stopping;
+    uint64_t active_request;
+    std::atomic<bool> cancel_requested;
+    std::atomic<bool> preempt_requested;
+    std::atomic<int> foreground_waiting;
+    std::atomic<bool> preempted;   // the running background job stopped to yield
+    
     BerdCoreModel() : type(BERDCORE_MODEL_GEMMA3_1B_Q4), cactus_model(nullptr), 
-                      load_progress(0.0f), is_ready(false), context_size(2048) {}
+                      load_progress(0.0f), is_ready(false), context_size(2048),
+                      warmup_cancel(false), hibernated(false), pool(nullptr), pool_last_active(0), footprint(0),
+                      kv_cache_budget(0), kv_clock(0), last_reused_tokens(0),
+                      bytes_per_token(4.0f), thread_config(), governor(), cool_decode_tps(0.0),
+                      embed_context(nullptr), last_stats(), counters(),
+                      request_start_ns(0), peak_scratch_bytes(0),
+                      reply_rewritten(false),
+                      worker_stopping(false), active_request(0), cancel_requested(false),
+                      preempt_requested(false), foreground_waiting(0), preempted(false) {}
+};
+
+// A message of a conversation, as offsets into the conversation arena
+struct BerdCoreConversationEntry {
+    size_t role_offset;
+    size_t role_length;
+    size_t content_offset;
+    size_t content_length;
+    size_t json_offset;  // start of this message (and its separator) in json
+    int token_count;     // engine-reported tokens for the message, -1 if unknown
 };
 
+// Message text is appended to one contiguous arena and the serialized
+// messages array is extended on demand, so adding a message costs only that
+// message. saved_* track the file last written by berdcore_conversation_save
+// so saving again only appends the new messages.
 struct BerdCoreConversation {
     std::string title;
-    std::vector<std::pair<std::string, std::string>> messages; // role, content
+    std::string arena;
+    std::vector<BerdCoreConversationEntry> entries;
+    std::string json;    // always a closed array of the first json_count messages
+    size_t json_count;
+    std::string saved_path;
+    size_t saved_count;
+    off_t saved_size;
+    
+    BerdCoreConversation(const char* t) : title(t ? t : "New Conversation"), json("[]"),
+                                          json_count(0), saved_count(0), saved_size(0) {}
+};
+
+// The engine sees a window of the conversation: the first head_count
+// messages, an optional summary of what was dropped, then everything from
+// window_start on. window_version changes whenever the window moves, which
+// invalidates the resident KV state.
+struct BerdCoreSession {
+    uint64_t id;
+    BerdCoreModel* model;
+    BerdCoreConversation* conversation;
+    size_t kv_count;            // messages resident in the model KV cache
+    
+    berdcore_context_options_t context;
+    size_t head_count;
+    size_t window_start;
+    std::string summary;
+    std::string window_json;
+    uint64_t window_version;
+    uint64_t kv_window_version;
+    
+    BerdCoreSession(uint64_t i, BerdCoreModel* m, BerdCoreConversation* c)
+        : id(i), model(m), conversation(c), kv_count(0), context(), head_count(0),
+          window_start(0), window_version(0), kv_window_version(0) {}
+};
+
+static std::atomic<uint64_t> g_next_session_id(1);
+static std::atomic<uint64_t> g_next_request_id(1);
+
+struct BerdCoreModelPool {
+    std::mutex mutex;
+    size_t memory_budget;
+    std::vector<BerdCoreModel*> models;  // not owned
+    BerdCoreModel* active;
+    uint64_t clock;
+#ifdef __APPLE__
+    dispatch_queue_t pressure_queue;
+    dispatch_source_t pressure_source;
+#endif
     
-    BerdCoreConversation(const char* t) : title(t ? t : "New Conversation") {}
+    explicit BerdCoreModelPool(size_t budget) : memory_budget(budget), active(nullptr), clock(0) {}
 };
 
+// Maximum number of async requests waiting behind the active one
+static const size_t BERDCORE_ASYNC_QUEUE_CAPACITY = 8;
+
+// Maximum number of background jobs waiting for the model
+static const size_t BERDCORE_BACKGROUND_QUEUE_CAPACITY = 32;
+
+// Times a background job yields before it runs to completion regardless,
+// so a busy foreground cannot starve it forever
+static const int BERDCORE_MAX_PREEMPTIONS = 4;
+
+// Step and smallest size for a context shrunk to fit kv_memory_limit
+static const int BERDCORE_KV_CONTEXT_STEP = 256;
+
+// Set on the worker thread while it runs a background job, and whether
+// that job may still be preempted
+static thread_local bool t_background_job = false;
+static thread_local bool t_preemptible = false;
+
+// Set on the worker thread while it runs an async request: the cancel flag
+// of that request. A completion honors only the flag it started with, so a
+// cancel never stops another caller that holds the model meanwhile.
+static thread_local const std::atomic<bool>* t_cancel_flag = nullptr;
+
+// Set on the worker thread while it runs an async request: when that
+// request was submitted, so its time to first token includes the queue
+static thread_local uint64_t t_request_start_ns = 0;
+
+// Device state reported by the host, read by every model's governor
+static std::atomic<int> g_thermal_state(BERDCORE_THERMAL_NOMINAL);
+static std::atomic<bool> g_low_power_mode(false);
+
 // Global error state
 static thread_local std::string g_last_error;
 static std::atomic<int> g_log_level(2); // default: warn
@@ -56,66 +318,176 @@ static void log_info(const std::string& msg) {
 // MODEL MANAGEMENT (Cactus Compute)
 // ============================================================================
 
-berdcore_model_t berdcore_init_model(
-    berdcore_model_type_t model_type,
-    const char* model_path,
-    int context_size,
-    berdcore_progress_callback_t progress_callback,
-    void* user_data
-) {
-    if (!model_path) {
+// Helper: Total size of the model's weight files
+static size_t total_weight_bytes(const BerdCoreModel* m) {
+    size_t total = 0;
+    for (const auto& file : m->weight_files) total += file.size;
+    return total;
+}
+
+// Helper: Publish a progress value
+static void report_progress(BerdCoreModel* m, float progress,
+                            berdcore_progress_callback_t callback, void* user_data) {
+    m->load_progress = progress;
+    if (callback) {
+        callback(progress, user_data);
+    }
+}
+
+berdcore_model_t berdcore_init_model_ex(const berdcore_model_config_t* config) {
+    if (!config || !config->model_path) {
         set_error("Model path cannot be null");
         return nullptr;
     }
     
+    BERDCORE_TRACE_SCOPE("init_model");
     auto model = std::make_unique<BerdCoreModel>();
-    model->type = model_type;
-    model->model_path = model_path;
-    model->context_size = context_size > 0 ? context_size : 2048;
+    model->type = config->model_type;
+    model->model_path = config->model_path;
+    model->context_size = config->context_size > 0 ? config->context_size : 2048;
+    
+    // Shrink the context, in whole steps, until a full KV cache fits the
+    // limit; a limit too small for one step fails rather than exceeding it
+    size_t per_token = berdcore_estimate_kv_bytes(model->type, 1);
+    if (config->kv_memory_limit > 0 && per_token > 0) {
+        size_t fit = config->kv_memory_limit / per_token;
+        if (fit < (size_t)model->context_size) {
+            fit = fit / BERDCORE_KV_CONTEXT_STEP * BERDCORE_KV_CONTEXT_STEP;
+            if (fit == 0) {
+                set_error("KV memory limit is below a " + std::to_string(BERDCORE_KV_CONTEXT_STEP) +
+                          "-token context (" + std::to_string(BERDCORE_KV_CONTEXT_STEP * per_token) +
+                          " bytes)");
+                return nullptr;
+            }
+            log_info("Context capped to " + std::to_string(fit) + " tokens (requested " +
+                     std::to_string(model->context_size) + ") to fit the KV memory limit");
+            model->context_size = (int)fit;
+        }
+    }
+    
+    log_info("Initializing Cactus model: " + model->model_path);
     
-    log_info("Initializing Cactus model: " + std::string(model_path));
+    if (!weights_scan_files(model->model_path, &model->weight_files)) {
+        log_info("Could not list weight files, progress will be coarse");
+    }
+    size_t total = total_weight_bytes(model.get());
+    
+    berdcore_progress_callback_t progress_callback = config->progress_callback;
+    void* user_data = config->user_data;
+    report_progress(model.get(), 0.0f, progress_callback, user_data);
+    
+    // Cactus gives no progress of its own, so follow page cache residency of
+    // the weight files while it loads
+    std::atomic<bool> init_done(false);
+    std::thread poller;
+    if (total > 0) {
+        BerdCoreModel* m = model.get();
+        poller = std::thread([m, total, &init_done, progress_callback, user_data] {
+            while (!init_done) {
+                float fraction = (float)weights_resident_bytes(m->weight_files) / total;
+                report_progress(m, std::min(fraction, 0.99f), progress_callback, user_data);
+                for (int i = 0; i < 10 && !init_done; i++) {
+                    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+                }
+            }
+        });
+    }
     
-    // Initialize Cactus model
-    model->load_progress = 0.1f;
-    if (progress_callback) {
-        progress_callback(0.1f, user_data);
+    {
+        BERDCORE_TRACE_SCOPE("cactus_init");
+        model->cactus_model = cactus_init(model->model_path.c_str(), model->context_size);
+    }
+    init_done = true;
+    if (poller.joinable()) {
+        poller.join();
     }
     
-    model->cactus_model = cactus_init(model_path, model->context_size);
     if (!model->cactus_model) {
         set_error("Failed to initialize Cactus model");
         return nullptr;
     }
+    model->kv_slots.emplace_back(new BerdCoreKvSlot(model->cactus_model));
     
-    model->load_progress = 0.5f;
-    if (progress_callback) {
-        progress_callback(0.5f, user_data);
+    // Model is ready; pages not yet resident fault in on first use
+    model->is_ready = true;
+    log_info("Cactus model loaded successfully");
+    if (config->ready_callback) {
+        config->ready_callback(model.get(), user_data);
     }
     
-    // Model is ready
-    model->is_ready = true;
-    model->load_progress = 1.0f;
-    if (progress_callback) {
-        progress_callback(1.0f, user_data);
+    if (config->warmup == BERDCORE_WARMUP_NONE || total == 0) {
+        report_progress(model.get(), 1.0f, progress_callback, user_data);
+        return model.release();
     }
     
-    log_info("Cactus model loaded successfully");
+    BerdCoreModel* m = model.get();
+    berdcore_warmup_mode_t mode = config->warmup;
+    m->warmup_thread = std::thread([m, mode, progress_callback, user_data] {
+        BERDCORE_TRACE_SCOPE("weights_warm");
+        weights_warm(m->weight_files, mode, m->warmup_cancel,
+                     [m, progress_callback, user_data](size_t resident, size_t total) {
+            report_progress(m, std::min((float)resident / total, 0.99f), progress_callback, user_data);
+        });
+        if (!m->warmup_cancel) {
+            report_progress(m, 1.0f, progress_callback, user_data);
+            log_info("Model weights warmed up");
+        }
+    });
     return model.release();
 }
 
+berdcore_model_t berdcore_init_model(
+    berdcore_model_type_t model_type,
+    const char* model_path,
+    int context_size,
+    berdcore_progress_callback_t progress_callback,
+    void* user_data
+) {
+    berdcore_model_config_t config;
+    memset(&config, 0, sizeof(config));
+    config.model_type = model_type;
+    config.model_path = model_path;
+    config.context_size = context_size;
+    config.warmup = BERDCORE_WARMUP_NONE;
+    config.progress_callback = progress_callback;
+    config.user_data = user_data;
+    return berdcore_init_model_ex(&config);
+}
+
+static void stop_async_worker(BerdCoreModel* m);
+static void pool_remove_model(BerdCoreModelPool* pool, BerdCoreModel* m);
+
 void berdcore_free_model(berdcore_model_t model) {
     if (!model) return;
     
     auto m = static_cast<BerdCoreModel*>(model);
+    if (m->pool) {
+        pool_remove_model(m->pool, m);
+    }
+    stop_async_worker(m);
+    if (m->warmup_thread.joinable()) {
+        m->warmup_cancel = true;
+        m->warmup_thread.join();
+    }
+    for (const auto& slot : m->kv_slots) {
+        if (slot->cactus_model != m->cactus_model) {
+            cactus_destroy(slot->cactus_model);
+        }
+    }
     if (m->cactus_model) {
         cactus_destroy(m->cactus_model);
     }
+    if (m->embed_context) {
+        cactus_destroy(m->embed_context);
+    }
     delete m;
 }
 
 int berdcore_model_is_ready(berdcore_model_t model) {
     if (!model) return 0;
-    return static_cast<BerdCoreModel*>(model)->is_ready ? 1 : 0;
+    auto m = static_cast<BerdCoreModel*>(model);
+    std::lock_guard<std::mutex> lock(m->inference_mutex);
+    return m->is_ready && !m->hibernated ? 1 : 0;
 }
 
 float berdcore_model_get_progress(berdcore_model_t model) {
@@ -123,226 +495,2296 @@ float berdcore_model_get_progress(berdcore_model_t model) {
     return static_cast<BerdCoreModel*>(model)->load_progress.load();
 }
 
-// ============================================================================
-// INFERENCE
-// ============================================================================
+const char* berdcore_model_get_last_response(berdcore_model_t model, size_t* length) {
+    if (!model) {
+        if (length) *length = 0;
+        return nullptr;
+    }
+    auto m = static_cast<BerdCoreModel*>(model);
+    std::lock_guard<std::mutex> lock(m->inference_mutex);
+    if (length) *length = m->response.size();
+    return m->response.c_str();
+}
 
-berdcore_error_t berdcore_generate(
-    berdcore_model_t model,
-    const char* messages,
-    const berdcore_inference_options_t* options,
-    berdcore_token_callback_t token_callback,
-    void* user_data
-) {
-    if (!model || !messages || !token_callback) {
-        set_error("Invalid parameters for generate");
+int berdcore_model_get_reused_tokens(berdcore_model_t model) {
+    if (!model) return 0;
+    auto m = static_cast<BerdCoreModel*>(model);
+    std::lock_guard<std::mutex> lock(m->inference_mutex);
+    return m->last_reused_tokens;
+}
+
+berdcore_error_t berdcore_model_get_last_stats(berdcore_model_t model, berdcore_inference_stats_t* stats) {
+    if (!model || !stats) {
+        set_error("Invalid parameters for get_last_stats");
         return BERDCORE_ERROR_INVALID_PARAM;
     }
-    
     auto m = static_cast<BerdCoreModel*>(model);
-    if (!m->is_ready) {
-        set_error("Model not ready");
-        return BERDCORE_ERROR_NOT_INITIALIZED;
-    }
-    
-    // Build options JSON
-    std::ostringstream opts;
-    opts << "{";
-    opts << "\"temperature\": " << (options ? options->temperature : 0.7f) << ",";
-    opts << "\"top_p\": " << (options ? options->top_p : 0.95f) << ",";
-    opts << "\"top_k\": " << (options ? options->top_k : 40) << ",";
-    opts << "\"max_tokens\": " << (options ? options->max_tokens : 512);
-    if (options && options->stop_sequences) {
-        opts << ",\"stop_sequences\": " << options->stop_sequences;
-    }
-    opts << "}";
-    
-    std::string options_str = opts.str();
-    
-    // Buffer for response
-    char response_buffer[8192];
-    memset(response_buffer, 0, sizeof(response_buffer));
-    
-    // Call Cactus complete with streaming callback
-    auto cactus_callback = [](const char* token, uint32_t token_id, void* ud) {
-        auto cb_data = static_cast<std::pair<berdcore_token_callback_t, void*>*>(ud);
-        cb_data->first(token, cb_data->second);
-    };
-    
-    std::pair<berdcore_token_callback_t, void*> cb_data{token_callback, user_data};
-    
-    int result = cactus_complete(
-        m->cactus_model,
-        messages,
-        response_buffer,
-        sizeof(response_buffer),
-        options_str.c_str(),
-        nullptr, // no tools
-        cactus_callback,
-        &cb_data
-    );
-    
-    if (result != 0) {
-        set_error("Cactus inference failed with code: " + std::to_string(result));
-        return BERDCORE_ERROR_INFERENCE_FAILED;
-    }
-    
+    std::lock_guard<std::mutex> lock(m->inference_mutex);
+    *stats = m->last_stats;
     return BERDCORE_SUCCESS;
 }
 
-berdcore_error_t berdcore_generate_with_system(
-    berdcore_model_t model,
-    const char* system_prompt,
-    const char* user_message,
-    const berdcore_inference_options_t* options,
-    berdcore_token_callback_t token_callback,
-    void* user_data
-) {
-    if (!system_prompt || !user_message) {
-        set_error("Invalid prompts");
+berdcore_error_t berdcore_model_get_counters(berdcore_model_t model, berdcore_model_counters_t* counters) {
+    if (!model || !counters) {
+        set_error("Invalid parameters for get_counters");
         return BERDCORE_ERROR_INVALID_PARAM;
     }
-    
-    // Build messages JSON
-    std::ostringstream msgs;
-    msgs << "[";
-    msgs << "{\"role\":\"system\",\"content\":\"" << system_prompt << "\"},";
-    msgs << "{\"role\":\"user\",\"content\":\"" << user_message << "\"}";
-    msgs << "]";
-    
-    std::string messages_str = msgs.str();
-    return berdcore_generate(model, messages_str.c_str(), options, token_callback, user_data);
+    auto m = static_cast<BerdCoreModel*>(model);
+    std::lock_guard<std::mutex> lock(m->inference_mutex);
+    *counters = m->counters;
+    return BERDCORE_SUCCESS;
+}
+
+void berdcore_model_reset_counters(berdcore_model_t model) {
+    if (!model) return;
+    auto m = static_cast<BerdCoreModel*>(model);
+    std::lock_guard<std::mutex> lock(m->inference_mutex);
+    m->counters = berdcore_model_counters_t();
 }
 
 // ============================================================================
-// PERPLEXITY SEARCH (using libcurl)
+// KV SLOT CACHE
 // ============================================================================
 
-// CURL write callback
-static size_t berdcore_curl_write_callback(void* contents, size_t size, size_t nmemb, void* userp) {
-    ((std::string*)userp)->append((char*)contents, size * nmemb);
-    return size * nmemb;
+// Approximate fp16 K+V bytes per token: 2 * layers * kv_heads * head_dim * 2
+static size_t kv_bytes_per_token(berdcore_model_type_t type) {
+    switch (type) {
+        case BERDCORE_MODEL_GEMMA3_1B_Q4: return 2 * 26 * 1 * 256 * 2;
+        case BERDCORE_MODEL_QWEN_4B_Q4:   return 2 * 36 * 8 * 128 * 2;
+    }
+    return 0;
 }
 
-berdcore_error_t berdcore_search(
-    const char* api_key,
-    const char* query,
-    int max_results,
-    berdcore_search_result_t** results,
-    int* num_results
-) {
-    if (!api_key || !query || !results || !num_results) {
-        set_error("Invalid search parameters");
-        return BERDCORE_ERROR_INVALID_PARAM;
+// Helper: Estimated bytes held by all resident KV caches
+static size_t kv_cache_usage(const BerdCoreModel* m) {
+    size_t tokens = 0;
+    for (const auto& slot : m->kv_slots) {
+        tokens += slot->kv_tokens;
     }
-    
-    // Build request JSON
-    Json::Value request;
-    request["query"] = query;
-    request["max_results"] = max_results;
-    request["max_tokens_per_page"] = 1024;
-    
-    Json::StreamWriterBuilder writer;
-    std::string request_body = Json::writeString(writer, request);
-    
-    // Make HTTP request
-    CURL* curl = curl_easy_init();
-    if (!curl) {
-        set_error("Failed to initialize CURL");
-        return BERDCORE_ERROR_NETWORK;
+    return tokens * kv_bytes_per_token(m->type);
+}
+
+// Helper: Forget the resident KV state (caller holds inference_mutex)
+static void drop_kv_state(BerdCoreKvSlot* slot) {
+    cactus_reset(slot->cactus_model);
+    slot->kv_messages.clear();
+    slot->kv_owner = 0;
+    slot->kv_resident = false;
+    slot->kv_tokens = 0;
+}
+
+// Helper: Evict slot i, destroying its context unless it is the primary one
+static void evict_slot(BerdCoreModel* m, size_t i) {
+    BerdCoreKvSlot* slot = m->kv_slots[i].get();
+    if (slot->cactus_model == m->cactus_model) {
+        drop_kv_state(slot);
+        return;
     }
-    
-    std::string response_data;
-    struct curl_slist* headers = nullptr;
-    headers = curl_slist_append(headers, ("Authorization: Bearer " + std::string(api_key)).c_str());
-    headers = curl_slist_append(headers, "Content-Type: application/json");
-    
-    curl_easy_setopt(curl, CURLOPT_URL, "https://api.perplexity.ai/search");
-    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
-    curl_easy_setopt(curl, CURLOPT_POSTFIELDS, request_body.c_str());
-    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, berdcore_curl_write_callback);
-    curl_easy_setopt(curl, CURLOPT_WRITEDATA, &response_data);
-    
-    CURLcode res = curl_easy_perform(curl);
-    curl_slist_free_all(headers);
-    curl_easy_cleanup(curl);
-    
-    if (res != CURLE_OK) {
-        set_error("CURL request failed: " + std::string(curl_easy_strerror(res)));
-        return BERDCORE_ERROR_NETWORK;
+    cactus_destroy(slot->cactus_model);
+    m->kv_slots.erase(m->kv_slots.begin() + i);
+}
+
+// Helper: Resident slot owned by a session, or nullptr
+static BerdCoreKvSlot* find_owned_slot(BerdCoreModel* m, uint64_t owner) {
+    for (const auto& slot : m->kv_slots) {
+        if (slot->kv_resident && slot->kv_owner == owner) {
+            return slot.get();
+        }
     }
-    
-    // Parse response
-    Json::CharReaderBuilder reader;
-    Json::Value response;
-    std::istringstream iss(response_data);
-    std::string errs;
-    
-    if (!Json::parseFromStream(reader, iss, &response, &errs)) {
-        set_error("Failed to parse search response: " + errs);
-        return BERDCORE_ERROR_NETWORK;
+    return nullptr;
+}
+
+// Helper: Slot for a prompt with no resident state. Grows the pool while it
+// is under budget, otherwise recycles the least recently used slot.
+static BerdCoreKvSlot* acquire_free_slot(BerdCoreModel* m) {
+    for (const auto& slot : m->kv_slots) {
+        if (!slot->kv_resident) return slot.get();
     }
     
-    // Extract results
-    const Json::Value& search_results = response["results"];
-    *num_results = search_results.size();
-    *results = new berdcore_search_result_t[*num_results];
-    
-    for (int i = 0; i < *num_results; i++) {
-        const auto& result = search_results[i];
-        (*results)[i].title = strdup(result["title"].asString().c_str());
-        (*results)[i].url = strdup(result["url"].asString().c_str());
-        (*results)[i].snippet = strdup(result["snippet"].asString().c_str());
+    if (kv_cache_usage(m) < m->kv_cache_budget) {
+        BERDCORE_TRACE_SCOPE("cactus_init");
+        cactus_model_t cm = cactus_init(m->model_path.c_str(), m->context_size);
+        if (cm) {
+            m->kv_slots.emplace_back(new BerdCoreKvSlot(cm));
+            log_info("Created KV slot " + std::to_string(m->kv_slots.size() - 1));
+            return m->kv_slots.back().get();
+        }
+        log_info("Failed to create KV slot, recycling instead");
     }
     
-    return BERDCORE_SUCCESS;
+    // Background jobs recycle a slot they used before, keeping chats warm
+    BerdCoreKvSlot* lru = nullptr;
+    for (const auto& slot : m->kv_slots) {
+        if (t_background_job && !slot->background) continue;
+        if (!lru || slot->last_used < lru->last_used) lru = slot.get();
+    }
+    if (!lru) {
+        lru = m->kv_slots[0].get();
+        for (const auto& slot : m->kv_slots) {
+            if (slot->last_used < lru->last_used) lru = slot.get();
+        }
+    }
+    drop_kv_state(lru);
+    return lru;
 }
 
-void berdcore_free_search_results(berdcore_search_result_t* results, int num_results) {
-    if (!results) return;
-    for (int i = 0; i < num_results; i++) {
-        free(results[i].title);
-        free(results[i].url);
-        free(results[i].snippet);
+// Helper: Evict least recently used slots until the cache fits its budget.
+// The slot that was just used is never evicted.
+static void enforce_kv_budget(BerdCoreModel* m, const BerdCoreKvSlot* keep) {
+    while (m->kv_slots.size() > 1 && kv_cache_usage(m) > m->kv_cache_budget) {
+        size_t lru = m->kv_slots.size();
+        for (size_t i = 0; i < m->kv_slots.size(); i++) {
+            const BerdCoreKvSlot* slot = m->kv_slots[i].get();
+            if (slot == keep || !slot->kv_resident) continue;
+            if (lru == m->kv_slots.size() || slot->last_used < m->kv_slots[lru]->last_used) {
+                lru = i;
+            }
+        }
+        if (lru == m->kv_slots.size()) break;
+        evict_slot(m, lru);
     }
-    delete[] results;
 }
 
-berdcore_error_t berdcore_fetch_page(
-    const char* url,
-    char** content,
-    size_t* content_length
-) {
-    if (!url || !content || !content_length) {
-        return BERDCORE_ERROR_INVALID_PARAM;
-    }
-    
-    CURL* curl = curl_easy_init();
-    if (!curl) {
-        return BERDCORE_ERROR_NETWORK;
-    }
-    
-    std::string page_data;
-    curl_easy_setopt(curl, CURLOPT_URL, url);
-    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, berdcore_curl_write_callback);
-    curl_easy_setopt(curl, CURLOPT_WRITEDATA, &page_data);
-    curl_easy_setopt(curl, CURLOPT_USERAGENT, "Mozilla/5.0");
-    curl_easy_setopt(curl, CURLOPT_TIMEOUT, 15L);
-    
-    CURLcode res = curl_easy_perform(curl);
-    curl_easy_cleanup(curl);
-    
-    if (res != CURLE_OK) {
-        set_error("Failed to fetch page");
-        return BERDCORE_ERROR_NETWORK;
+void berdcore_model_reset_cache(berdcore_model_t model) {
+    if (!model) return;
+    auto m = static_cast<BerdCoreModel*>(model);
+    std::lock_guard<std::mutex> lock(m->inference_mutex);
+    for (size_t i = m->kv_slots.size(); i-- > 0;) {
+        evict_slot(m, i);
     }
-    
-    // Simple HTML stripping (basic implementation)
-    // TODO: Use proper HTML parser for production
-    *content_length = page_data.length();
-    *content = strdup(page_data.c_str());
-    
-    return BERDCORE_SUCCESS;
+    m->last_reused_tokens = 0;
+}
+
+berdcore_error_t berdcore_model_set_kv_cache_budget(berdcore_model_t model, size_t max_bytes) {
+    if (!model) {
+        set_error("Invalid model for KV cache budget");
+        return BERDCORE_ERROR_INVALID_PARAM;
+    }
+    
+    auto m = static_cast<BerdCoreModel*>(model);
+    std::lock_guard<std::mutex> lock(m->inference_mutex);
+    m->kv_cache_budget = max_bytes;
+    enforce_kv_budget(m, nullptr);
+    return BERDCORE_SUCCESS;
+}
+
+size_t berdcore_model_get_kv_cache_usage(berdcore_model_t model) {
+    if (!model) return 0;
+    auto m = static_cast<BerdCoreModel*>(model);
+    std::lock_guard<std::mutex> lock(m->inference_mutex);
+    return kv_cache_usage(m);
+}
+
+int berdcore_model_get_context_size(berdcore_model_t model) {
+    if (!model) return 0;
+    return static_cast<BerdCoreModel*>(model)->context_size;
+}
+
+size_t berdcore_estimate_kv_bytes(berdcore_model_type_t model_type, int context_tokens) {
+    if (context_tokens <= 0) return 0;
+    return (size_t)context_tokens * kv_bytes_per_token(model_type);
+}
+
+berdcore_error_t berdcore_model_set_thread_config(berdcore_model_t model, const berdcore_thread_config_t* config) {
+    if (!model) {
+        set_error("Invalid model for thread config");
+        return BERDCORE_ERROR_INVALID_PARAM;
+    }
+    berdcore_thread_config_t tc = config ? *config : berdcore_thread_config_t();
+    if (tc.num_threads < 0 || tc.prefill_threads < 0 || tc.decode_threads < 0 ||
+        tc.qos < BERDCORE_QOS_DEFAULT || tc.qos > BERDCORE_QOS_BACKGROUND ||
+        tc.prefill_cores < BERDCORE_CORES_ANY || tc.prefill_cores > BERDCORE_CORES_EFFICIENCY ||
+        tc.decode_cores < BERDCORE_CORES_ANY || tc.decode_cores > BERDCORE_CORES_EFFICIENCY) {
+        set_error("Invalid thread config");
+        return BERDCORE_ERROR_INVALID_PARAM;
+    }
+    
+    auto m = static_cast<BerdCoreModel*>(model);
+    std::lock_guard<std::mutex> lock(m->inference_mutex);
+    m->thread_config = tc;
+    return BERDCORE_SUCCESS;
+}
+
+berdcore_error_t berdcore_model_set_governor(berdcore_model_t model, const berdcore_governor_options_t* options) {
+    if (!model) {
+        set_error("Invalid model for governor");
+        return BERDCORE_ERROR_INVALID_PARAM;
+    }
+    berdcore_governor_options_t g = options ? *options : berdcore_governor_options_t();
+    if (g.sustained_fraction < 0.0f || g.sustained_fraction > 1.0f || g.min_max_tokens < 0) {
+        set_error("Invalid governor options");
+        return BERDCORE_ERROR_INVALID_PARAM;
+    }
+    
+    auto m = static_cast<BerdCoreModel*>(model);
+    std::lock_guard<std::mutex> lock(m->inference_mutex);
+    m->governor = g;
+    return BERDCORE_SUCCESS;
+}
+
+// ============================================================================
+// MODEL RESIDENCY
+// ============================================================================
+
+// Helper: Release the Cactus contexts but keep the handle (caller holds
+// inference_mutex). Destroying the contexts unmaps the weights and frees the
+// KV caches; the page cache keeps the weights warm for a quick rehydrate
+// unless the OS needs the memory.
+static void hibernate_locked(BerdCoreModel* m) {
+    if (m->hibernated) return;
+    
+    BERDCORE_TRACE_SCOPE("hibernate");
+    if (m->warmup_thread.joinable()) {
+        m->warmup_cancel = true;
+        m->warmup_thread.join();
+    }
+    for (const auto& slot : m->kv_slots) {
+        cactus_destroy(slot->cactus_model);
+    }
+    m->kv_slots.clear();
+    m->cactus_model = nullptr;
+    if (m->embed_context) {
+        cactus_destroy(m->embed_context);
+        m->embed_context = nullptr;
+    }
+    weights_release(m->weight_files);
+    m->hibernated = true;
+    m->footprint = 0;
+    log_info("Hibernated model: " + m->model_path);
+}
+
+// Helper: Recreate the primary Cactus context (caller holds inference_mutex)
+static bool rehydrate_locked(BerdCoreModel* m) {
+    if (!m->hibernated) return true;
+    
+    BERDCORE_TRACE_SCOPE("rehydrate");
+    m->cactus_model = cactus_init(m->model_path.c_str(), m->context_size);
+    if (!m->cactus_model) {
+        set_error("Failed to rehydrate Cactus model");
+        return false;
+    }
+    m->kv_slots.emplace_back(new BerdCoreKvSlot(m->cactus_model));
+    m->hibernated = false;
+    log_info("Rehydrated model: " + m->model_path);
+    return true;
+}
+
+// Helper: Estimated resident bytes (caller holds inference_mutex)
+static size_t model_footprint_locked(BerdCoreModel* m) {
+    m->footprint = m->hibernated ? 0 : weights_resident_bytes(m->weight_files) + kv_cache_usage(m);
+    return m->footprint;
+}
+
+// Helper: Estimated resident bytes without waiting for a busy model, which
+// reports what it held when last measured
+static size_t model_footprint(BerdCoreModel* m) {
+    std::unique_lock<std::mutex> lock(m->inference_mutex, std::try_to_lock);
+    return lock.owns_lock() ? model_footprint_locked(m) : m->footprint.load();
+}
+
+berdcore_error_t berdcore_model_hibernate(berdcore_model_t model) {
+    if (!model) {
+        set_error("Invalid model for hibernate");
+        return BERDCORE_ERROR_INVALID_PARAM;
+    }
+    
+    auto m = static_cast<BerdCoreModel*>(model);
+    std::lock_guard<std::mutex> lock(m->inference_mutex);
+    hibernate_locked(m);
+    return BERDCORE_SUCCESS;
+}
+
+static bool rehydrate_for_use_locked(BerdCoreModel* m);
+
+berdcore_error_t berdcore_model_rehydrate(berdcore_model_t model) {
+    if (!model) {
+        set_error("Invalid model for rehydrate");
+        return BERDCORE_ERROR_INVALID_PARAM;
+    }
+    
+    auto m = static_cast<BerdCoreModel*>(model);
+    std::lock_guard<std::mutex> lock(m->inference_mutex);
+    return rehydrate_for_use_locked(m) ? BERDCORE_SUCCESS : BERDCORE_ERROR_MODEL_LOAD_FAILED;
+}
+
+// Helper: Hibernate inactive models, least recently active first, until the
+// pool fits its budget (caller holds pool->mutex, and inference_mutex of
+// held if set). Models that are busy generating are skipped rather than
+// waited for, so no model lock is ever waited on under pool->mutex.
+static void pool_enforce_budget(BerdCoreModelPool* pool, BerdCoreModel* held = nullptr) {
+    if (pool->memory_budget == 0) return;
+    
+    std::vector<BerdCoreModel*> order(pool->models);
+    std::sort(order.begin(), order.end(), [](const BerdCoreModel* a, const BerdCoreModel* b) {
+        return a->pool_last_active < b->pool_last_active;
+    });
+    
+    size_t total = 0;
+    for (BerdCoreModel* m : order) {
+        total += m == held ? model_footprint_locked(m) : model_footprint(m);
+    }
+    
+    for (BerdCoreModel* m : order) {
+        if (total <= pool->memory_budget) break;
+        if (m == pool->active || m == held) continue;
+        
+        std::unique_lock<std::mutex> lock(m->inference_mutex, std::try_to_lock);
+        if (!lock.owns_lock() || m->hibernated) continue;
+        size_t footprint = model_footprint_locked(m);
+        hibernate_locked(m);
+        total -= std::min(total, footprint);
+    }
+}
+
+// Helper: Shrink caches in response to memory pressure (caller holds pool->mutex)
+static void pool_handle_pressure(BerdCoreModelPool* pool, berdcore_memory_pressure_t level) {
+    log_info(std::string("Memory pressure: ") +
+             (level == BERDCORE_MEMORY_PRESSURE_CRITICAL ? "critical" : "warning"));
+    
+    for (BerdCoreModel* m : pool->models) {
+        std::unique_lock<std::mutex> lock(m->inference_mutex, std::try_to_lock);
+        if (!lock.owns_lock()) continue;
+        
+        if (level == BERDCORE_MEMORY_PRESSURE_CRITICAL && m != pool->active) {
+            hibernate_locked(m);
+            continue;
+        }
+        
+        // Keep only the most recently used KV slot warm; under critical
+        // pressure the active model drops that one too
+        const BerdCoreKvSlot* keep = nullptr;
+        for (const auto& slot : m->kv_slots) {
+            if (!keep || slot->last_used > keep->last_used) keep = slot.get();
+        }
+        if (level == BERDCORE_MEMORY_PRESSURE_CRITICAL) keep = nullptr;
+        for (size_t i = m->kv_slots.size(); i-- > 0;) {
+            if (m->kv_slots[i].get() != keep) evict_slot(m, i);
+        }
+    }
+}
+
+#ifdef __APPLE__
+// Helper: libdispatch memory pressure handler
+static void pool_memory_pressure_event(void* context) {
+    auto pool = static_cast<BerdCoreModelPool*>(context);
+    unsigned long flags = dispatch_source_get_data(pool->pressure_source);
+    std::lock_guard<std::mutex> lock(pool->mutex);
+    pool_handle_pressure(pool, (flags & DISPATCH_MEMORYPRESSURE_CRITICAL)
+                                   ? BERDCORE_MEMORY_PRESSURE_CRITICAL
+                                   : BERDCORE_MEMORY_PRESSURE_WARNING);
+}
+
+static void pool_pressure_flush(void*) {}
+#endif
+
+berdcore_model_pool_t berdcore_pool_create(size_t memory_budget) {
+    auto pool = new BerdCoreModelPool(memory_budget);
+    
+#ifdef __APPLE__
+    // Same signal UIKit's memory warnings are derived from, so the pool
+    // shrinks itself without the app having to forward notifications
+    pool->pressure_queue = dispatch_queue_create("berdcore.memory-pressure", DISPATCH_QUEUE_SERIAL);
+    pool->pressure_source = dispatch_source_create(
+        DISPATCH_SOURCE_TYPE_MEMORYPRESSURE, 0,
+        DISPATCH_MEMORYPRESSURE_WARN | DISPATCH_MEMORYPRESSURE_CRITICAL,
+        pool->pressure_queue);
+    dispatch_set_context(pool->pressure_source, pool);
+    dispatch_source_set_event_handler_f(pool->pressure_source, pool_memory_pressure_event);
+    dispatch_resume(pool->pressure_source);
+#endif
+    
+    return pool;
+}
+
+berdcore_error_t berdcore_pool_add(berdcore_model_pool_t pool, berdcore_model_t model) {
+    if (!pool || !model) {
+        set_error("Invalid parameters for pool add");
+        return BERDCORE_ERROR_INVALID_PARAM;
+    }
+    
+    auto p = static_cast<BerdCoreModelPool*>(pool);
+    auto m = static_cast<BerdCoreModel*>(model);
+    if (m->pool && m->pool != p) {
+        set_error("Model already belongs to another pool");
+        return BERDCORE_ERROR_INVALID_PARAM;
+    }
+    
+    std::lock_guard<std::mutex> lock(p->mutex);
+    if (m->pool == p) return BERDCORE_SUCCESS;
+    m->pool = p;
+    m->pool_last_active = ++p->clock;
+    p->models.push_back(m);
+    pool_enforce_budget(p);
+    return BERDCORE_SUCCESS;
+}
+
+// Helper: Detach a model from its pool
+static void pool_remove_model(BerdCoreModelPool* pool, BerdCoreModel* m) {
+    std::lock_guard<std::mutex> lock(pool->mutex);
+    pool->models.erase(std::remove(pool->models.begin(), pool->models.end(), m), pool->models.end());
+    if (pool->active == m) pool->active = nullptr;
+    m->pool = nullptr;
+}
+
+berdcore_error_t berdcore_pool_remove(berdcore_model_pool_t pool, berdcore_model_t model) {
+    if (!pool || !model || static_cast<BerdCoreModel*>(model)->pool != pool) {
+        set_error("Model is not in this pool");
+        return BERDCORE_ERROR_INVALID_PARAM;
+    }
+    
+    pool_remove_model(static_cast<BerdCoreModelPool*>(pool), static_cast<BerdCoreModel*>(model));
+    return BERDCORE_SUCCESS;
+}
+
+berdcore_error_t berdcore_pool_activate(berdcore_model_pool_t pool, berdcore_model_t model) {
+    if (!pool || !model || static_cast<BerdCoreModel*>(model)->pool != pool) {
+        set_error("Model is not in this pool");
+        return BERDCORE_ERROR_INVALID_PARAM;
+    }
+    
+    // A model that is busy is resident (or rehydrating for its own use)
+    auto p = static_cast<BerdCoreModelPool*>(pool);
+    auto m = static_cast<BerdCoreModel*>(model);
+    std::unique_lock<std::mutex> model_lock(m->inference_mutex, std::try_to_lock);
+    if (model_lock.owns_lock() && !rehydrate_locked(m)) {
+        return BERDCORE_ERROR_MODEL_LOAD_FAILED;
+    }
+    std::lock_guard<std::mutex> lock(p->mutex);
+    p->active = m;
+    m->pool_last_active = ++p->clock;
+    pool_enforce_budget(p, model_lock.owns_lock() ? m : nullptr);
+    return BERDCORE_SUCCESS;
+}
+
+// Helper: Rehydrate a model about to be used (caller holds inference_mutex).
+// A pooled model becomes the pool's active model and the pool is brought
+// back within its budget, as berdcore_pool_activate() does.
+static bool rehydrate_for_use_locked(BerdCoreModel* m) {
+    if (!m->hibernated) return true;
+    if (!rehydrate_locked(m)) return false;
+    
+    BerdCoreModelPool* p = m->pool;
+    if (p) {
+        std::lock_guard<std::mutex> lock(p->mutex);
+        if (m->pool == p) {
+            p->active = m;
+            m->pool_last_active = ++p->clock;
+            pool_enforce_budget(p, m);
+        }
+    }
+    return true;
+}
+
+void berdcore_pool_handle_memory_pressure(berdcore_model_pool_t pool, berdcore_memory_pressure_t level) {
+    if (!pool) return;
+    auto p = static_cast<BerdCoreModelPool*>(pool);
+    std::lock_guard<std::mutex> lock(p->mutex);
+    pool_handle_pressure(p, level);
+}
+
+size_t berdcore_pool_get_memory_usage(berdcore_model_pool_t pool) {
+    if (!pool) return 0;
+    auto p = static_cast<BerdCoreModelPool*>(pool);
+    std::lock_guard<std::mutex> lock(p->mutex);
+    size_t total = 0;
+    for (BerdCoreModel* m : p->models) {
+        total += model_footprint(m);
+    }
+    return total;
+}
+
+void berdcore_pool_free(berdcore_model_pool_t pool) {
+    if (!pool) return;
+    auto p = static_cast<BerdCoreModelPool*>(pool);
+    
+#ifdef __APPLE__
+    // Cancel the source and drain its serial queue so no handler is running
+    dispatch_source_cancel(p->pressure_source);
+    dispatch_sync_f(p->pressure_queue, nullptr, pool_pressure_flush);
+#if !OS_OBJECT_USE_OBJC
+    dispatch_release(p->pressure_source);
+    dispatch_release(p->pressure_queue);
+#endif
+#endif
+    
+    std::lock_guard<std::mutex> lock(p->mutex);
+    for (BerdCoreModel* m : p->models) {
+        m->pool = nullptr;
+    }
+    p->models.clear();
+    delete p;
+}
+
+// ============================================================================
+// INFERENCE
+// ============================================================================
+
+// Helper: Parse an OpenAI-style messages array into (role, content) pairs
+static bool parse_messages(const char* messages, Json::Value* root,
+                           std::vector<BerdCoreMessage>* out) {
+    BERDCORE_TRACE_SCOPE("parse_messages");
+    Json::CharReaderBuilder reader;
+    std::unique_ptr<Json::CharReader> parser(reader.newCharReader());
+    std::string errs;
+    if (!parser->parse(messages, messages + strlen(messages), root, &errs) ||
+        !root->isArray()) {
+        return false;
+    }
+    
+    out->clear();
+    out->reserve(root->size());
+    for (const auto& msg : *root) {
+        out->emplace_back(msg["role"].asString(), msg["content"].asString());
+    }
+    return true;
+}
+
+// Helper: Strip leading/trailing whitespace for reply comparison
+static std::string trim_whitespace(const std::string& s) {
+    size_t begin = s.find_first_not_of(" \t\r\n");
+    if (begin == std::string::npos) return std::string();
+    size_t end = s.find_last_not_of(" \t\r\n");
+    return s.substr(begin, end - begin + 1);
+}
+
+// Helper: Check whether prompt starts with the KV-resident messages.
+// Callers usually trim the generated reply before sending it back, so an
+// assistant message that only differs in surrounding whitespace still counts.
+static bool kv_prefix_matches(const std::vector<BerdCoreMessage>& kv,
+                              const std::vector<BerdCoreMessage>& prompt) {
+    if (kv.empty() || prompt.size() <= kv.size()) return false;
+    for (size_t i = 0; i < kv.size(); i++) {
+        const BerdCoreMessage& msg = prompt[i];
+        if (msg.first != kv[i].first) return false;
+        if (msg.second == kv[i].second) continue;
+        
+        if (msg.first != "assistant" ||
+            trim_whitespace(msg.second) != trim_whitespace(kv[i].second)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Helper: Swap trimmed replies in a matching prompt back to the exact text
+// the model produced, so the token prefix stays identical
+static bool adopt_kv_replies(const std::vector<BerdCoreMessage>& kv,
+                             std::vector<BerdCoreMessage>* prompt,
+                             Json::Value* messages_json) {
+    bool rewritten = false;
+    for (size_t i = 0; i < kv.size(); i++) {
+        if ((*prompt)[i].second == kv[i].second) continue;
+        (*prompt)[i].second = kv[i].second;
+        (*messages_json)[(Json::ArrayIndex)i]["content"] = kv[i].second;
+        rewritten = true;
+    }
+    return rewritten;
+}
+
+// Helper: Read token counts from the Cactus completion JSON
+static void parse_completion_counts(const char* response, int* prefill_tokens,
+                                    int* decode_tokens) {
+    BERDCORE_TRACE_SCOPE("parse_result");
+    Json::CharReaderBuilder reader;
+    std::unique_ptr<Json::CharReader> parser(reader.newCharReader());
+    Json::Value root;
+    std::string errs;
+    if (!parser->parse(response, response + strlen(response), &root, &errs) ||
+        !root.isObject()) {
+        return;
+    }
+    *prefill_tokens = root.get("prefill_tokens", 0).asInt();
+    *decode_tokens = root.get("decode_tokens", 0).asInt();
+}
+
+// Helper: Build the Cactus options JSON into out (reused across calls)
+static void build_options_json(const berdcore_inference_options_t* options, std::string* out) {
+    out->clear();
+    BerdCoreJsonWriter json(out);
+    json.begin_object();
+    json.key("temperature");
+    json.number(options ? options->temperature : 0.7f);
+    json.key("top_p");
+    json.number(options ? options->top_p : 0.95f);
+    json.key("top_k");
+    json.integer(options ? options->top_k : 40);
+    json.key("max_tokens");
+    json.integer(options ? options->max_tokens : 512);
+    if (options && options->stop_sequences) {
+        // Documented as a JSON array, passed through unchanged
+        json.key("stop_sequences");
+        json.raw(options->stop_sequences);
+    }
+    json.end_object();
+}
+
+// Helper: Monotonic timestamp in nanoseconds
+static uint64_t monotonic_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Helper: Reset the batcher for a new generation
+static void batcher_begin(BerdCoreTokenBatcher* b, const berdcore_streaming_options_t* streaming) {
+    b->max_tokens = streaming && streaming->max_batch_tokens > 0 ? streaming->max_batch_tokens : 16;
+    b->flush_interval_ns = streaming && streaming->flush_interval_ms > 0
+        ? (uint64_t)streaming->flush_interval_ms * 1000000ull : 0;
+    b->text.clear();
+    b->text_offsets.clear();
+    b->token_ids.clear();
+    b->timestamps_ns.clear();
+}
+
+// Helper: Hand pending tokens to the caller and rewind the buffer
+static void batcher_flush(BerdCoreTokenBatcher* b, const BerdCoreTokenSink& sink, bool is_final) {
+    if (b->token_ids.empty() && !is_final) return;
+    
+    berdcore_token_batch_t batch;
+    batch.text = b->text.c_str();
+    batch.text_length = b->text.size();
+    batch.text_offsets = b->text_offsets.data();
+    batch.token_ids = b->token_ids.data();
+    batch.timestamps_ns = b->timestamps_ns.data();
+    batch.num_tokens = b->token_ids.size();
+    batch.is_final = is_final ? 1 : 0;
+    {
+        BerdCoreTraceScope scope("batch_callback", (int64_t)batch.num_tokens);
+        sink.batch_callback(&batch, sink.user_data);
+    }
+    
+    b->text.clear();
+    b->text_offsets.clear();
+    b->token_ids.clear();
+    b->timestamps_ns.clear();
+}
+
+// Helper: Queue one token, flushing when the batch is full or stale
+static void batcher_push(BerdCoreTokenBatcher* b, const BerdCoreTokenSink& sink,
+                         const char* token, uint32_t token_id) {
+    uint64_t now = monotonic_ns();
+    b->text_offsets.push_back((uint32_t)b->text.size());
+    if (token) b->text.append(token);
+    b->token_ids.push_back(token_id);
+    b->timestamps_ns.push_back(now);
+    
+    if (b->token_ids.size() >= b->max_tokens ||
+        (b->flush_interval_ns && now - b->timestamps_ns.front() >= b->flush_interval_ns)) {
+        batcher_flush(b, sink, false);
+    }
+}
+
+// Helper: Fill last_stats for a finished completion and add it to the
+// model's counters (caller holds inference_mutex)
+static void record_stats(BerdCoreModel* m, int prefill_tokens, int decode_tokens,
+                         uint64_t first_token_ns, uint64_t prefill_ns, uint64_t decode_ns,
+                         berdcore_stop_reason_t stop_reason) {
+    berdcore_inference_stats_t& st = m->last_stats;
+    st.reused_tokens = m->last_reused_tokens;
+    st.prefill_tokens = prefill_tokens;
+    st.prompt_tokens = st.reused_tokens + prefill_tokens;
+    st.generated_tokens = decode_tokens;
+    st.time_to_first_token_ms = (m->request_start_ns && m->request_start_ns <= first_token_ns
+                                 ? first_token_ns - m->request_start_ns : prefill_ns) / 1e6;
+    st.prefill_ms = prefill_ns / 1e6;
+    st.decode_ms = decode_ns / 1e6;
+    st.prefill_tokens_per_second = prefill_ns ? prefill_tokens / (prefill_ns / 1e9) : 0.0;
+    // The first token comes out of the prefill pass
+    st.decode_tokens_per_second = decode_ns && decode_tokens > 1
+                                      ? (decode_tokens - 1) / (decode_ns / 1e9) : 0.0;
+    size_t scratch = m->completion_buffer.size() + m->response.capacity() +
+                     m->batcher.text.capacity() +
+                     m->batcher.text_offsets.capacity() * sizeof(uint32_t) +
+                     m->batcher.token_ids.capacity() * sizeof(uint32_t) +
+                     m->batcher.timestamps_ns.capacity() * sizeof(uint64_t);
+    m->peak_scratch_bytes = std::max(m->peak_scratch_bytes, scratch);
+    st.peak_scratch_bytes = m->peak_scratch_bytes;
+    st.kv_cache_bytes = kv_cache_usage(m);
+    st.stop_reason = stop_reason;
+    
+    berdcore_model_counters_t& c = m->counters;
+    c.requests++;
+    if (stop_reason == BERDCORE_STOP_ERROR) c.failed_requests++;
+    if (stop_reason == BERDCORE_STOP_CANCELLED) c.cancelled_requests++;
+    c.prompt_tokens += st.prompt_tokens;
+    c.reused_tokens += st.reused_tokens;
+    c.generated_tokens += st.generated_tokens;
+    c.prefill_ms += st.prefill_ms;
+    c.decode_ms += st.decode_ms;
+}
+
+// Helper: Take inference_mutex for a generation. A foreground caller is
+// counted while it waits, which makes a running background job yield and
+// keeps the worker from starting another until the caller has the lock.
+static std::unique_lock<std::mutex> lock_inference(BerdCoreModel* m) {
+    if (t_background_job) {
+        return std::unique_lock<std::mutex>(m->inference_mutex);
+    }
+    m->foreground_waiting++;
+    std::unique_lock<std::mutex> lock(m->inference_mutex);
+    if (--m->foreground_waiting == 0) {
+        std::lock_guard<std::mutex> queue_lock(m->queue_mutex);
+        m->queue_cv.notify_all();
+    }
+    return lock;
+}
+
+// Helper: Thermal step of the device, with low-power mode counting as
+// serious
+static int device_level() {
+    int level = g_thermal_state.load(std::memory_order_relaxed);
+    if (g_low_power_mode.load(std::memory_order_relaxed)) level = std::max(level, (int)BERDCORE_THERMAL_SERIOUS);
+    return level;
+}
+
+// Helper: Governor level for a model (0 when its governor is off)
+static int governor_level(const BerdCoreModel* m) {
+    return m->governor.enabled ? device_level() : 0;
+}
+
+// Helper: Reply cap at a governor level: half from serious, a quarter at
+// critical, never below min_max_tokens
+static int governor_max_tokens(const BerdCoreModel* m, int level, int requested) {
+    if (level < BERDCORE_THERMAL_SERIOUS) return requested;
+    int floor = m->governor.min_max_tokens > 0 ? m->governor.min_max_tokens : 128;
+    return std::min(requested, std::max(requested >> (level - 1), floor));
+}
+
+// Helper: Minimum time per decoded token at a level (0 = unpaced)
+static uint64_t governor_pace_ns(const BerdCoreModel* m, int level) {
+    if (level == 0 || m->cool_decode_tps <= 0) return 0;
+    double fraction = m->governor.sustained_fraction > 0 ? m->governor.sustained_fraction : 0.75;
+    return (uint64_t)(1e9 / (m->cool_decode_tps * std::pow(fraction, level)));
+}
+
+// Longest pacing sleep between checks for callers waiting on the model
+static const uint64_t BERDCORE_PACE_SLICE_NS = 5000000;
+
+// Helper: Whether a foreground request is waiting for the model
+static bool foreground_pending(const BerdCoreModel* m) {
+    return m->preempt_requested.load(std::memory_order_relaxed) ||
+           m->foreground_waiting.load(std::memory_order_relaxed) > 0;
+}
+
+// Helper: Whether the request behind a completion has been cancelled
+static bool request_cancelled(const std::atomic<bool>* cancel) {
+    return cancel && cancel->load(std::memory_order_relaxed);
+}
+
+// Helper: Hold decode back for a pacing delay. Pacing runs under
+// inference_mutex, so it sleeps in slices and gives up the rest of the delay
+// as soon as anyone is waiting for the model or the request is cancelled: a
+// paced reply then finishes at full speed (or, in the background, yields)
+// instead of holding them up.
+static void governor_wait(const BerdCoreModel* m, const std::atomic<bool>* cancel, uint64_t ns) {
+    uint64_t end = monotonic_ns() + ns;
+    while (!foreground_pending(m) && !request_cancelled(cancel)) {
+        uint64_t now = monotonic_ns();
+        if (now >= end) return;
+        std::this_thread::sleep_for(std::chrono::nanoseconds(std::min(end - now, BERDCORE_PACE_SLICE_NS)));
+    }
+}
+
+// Helper: Place the thread for decode; from serious on it runs on the
+// efficiency cores
+static void place_decode(const BerdCoreModel* m, BerdCoreThreadPlacement* placement, int level) {
+    const berdcore_thread_config_t& tc = m->thread_config;
+    placement->apply(tc.qos, level >= BERDCORE_THERMAL_SERIOUS ? BERDCORE_CORES_EFFICIENCY : tc.decode_cores,
+                     tc.decode_threads > 0 ? tc.decode_threads : tc.num_threads);
+}
+
+// Helper: Run one Cactus completion on top of whatever KV state is resident
+// in the slot (caller holds inference_mutex). On success the generated text
+// is in m->response and the engine-reported token counts are returned; on
+// failure the KV state is dropped because it is unknown after a failed
+// completion. With a json_schema only the JSON value reaches the sink and
+// m->response, and generation stops once the value is decided.
+static berdcore_error_t run_completion(
+    BerdCoreModel* m,
+    BerdCoreKvSlot* slot,
+    const char* messages,
+    const berdcore_inference_options_t* options,
+    const BerdCoreTokenSink& sink,
+    int* prefill_tokens,
+    int* decode_tokens
+) {
+    std::unique_ptr<BerdCoreSchemaValidator> validator;
+    if (options && options->json_schema) {
+        std::string error;
+        std::shared_ptr<const BerdCoreSchema> schema = schema_compile(options->json_schema, &error);
+        if (!schema) {
+            set_error(error);
+            return BERDCORE_ERROR_INVALID_PARAM;
+        }
+        validator.reset(new BerdCoreSchemaValidator(std::move(schema)));
+    }
+    m->reply_rewritten = false;
+    
+    // A warm device gets a shorter reply cap up front
+    int level = governor_level(m);
+    int requested_max_tokens = options && options->max_tokens > 0 ? options->max_tokens : 512;
+    int max_tokens = governor_max_tokens(m, level, requested_max_tokens);
+    berdcore_inference_options_t capped;
+    if (max_tokens != requested_max_tokens) {
+        capped = options ? *options : berdcore_inference_options_t{0.7f, 0.95f, 40, 0, nullptr, nullptr};
+        capped.max_tokens = max_tokens;
+        options = &capped;
+    }
+    build_options_json(options, &m->options_json);
+    
+    // Cactus echoes the reply inside its result JSON, so size the buffer for
+    // max_tokens of escaped text. It only ever grows and is not cleared.
+    size_t needed = (size_t)max_tokens * 32 + 4096;
+    if (m->completion_buffer.size() < needed) {
+        m->completion_buffer.resize(needed);
+    }
+    m->completion_buffer[0] = '\0';
+    m->response.clear();
+    
+    // Call Cactus complete with streaming callback
+    struct CallbackData {
+        const BerdCoreTokenSink* sink;
+        BerdCoreModel* model;
+        cactus_model_t cactus_model;
+        uint64_t first_token_ns;
+        BerdCoreTraceScope* prefill_scope;
+        BerdCoreTraceScope* decode_scope;
+        BerdCoreSchemaValidator* validator;
+        BerdCoreThreadPlacement* placement;
+        const std::atomic<bool>* cancel;   // the request's cancel flag (NULL for direct calls)
+        
+        // Governor state for this reply
+        int requested_max_tokens;
+        int max_tokens;            // lowered when the device heats up mid-reply
+        int level;
+        int max_level;
+        int tokens;
+        uint64_t pace_ns;          // minimum time per token (0 = unpaced)
+        uint64_t token_end_ns;     // when the previous callback let decode go on
+        double interval_ns;        // moving average time per token, pacing excluded
+        bool throttled;
+    };
+    
+    // Cactus may clear its stop flag when a completion starts, so a cancel
+    // is re-issued from here and takes effect within one decode step.
+    auto cactus_callback = [](const char* token, uint32_t token_id, void* ud) {
+        auto cb_data = static_cast<CallbackData*>(ud);
+        BerdCoreModel* m = cb_data->model;
+        if (request_cancelled(cb_data->cancel)) {
+            cactus_stop(cb_data->cactus_model);
+            return;
+        }
+        if (t_preemptible && foreground_pending(m)) {
+            m->preempted = true;
+            cactus_stop(cb_data->cactus_model);
+            return;
+        }
+        if (!cb_data->first_token_ns) {
+            cb_data->first_token_ns = monotonic_ns();
+            cb_data->prefill_scope->end();
+            place_decode(m, cb_data->placement, cb_data->level);
+        }
+        // One interval per token, from the previous token to this one
+        cb_data->decode_scope->set_arg(token_id);
+        cb_data->decode_scope->end();
+        cb_data->decode_scope->begin("decode_token");
+        
+        // Governor: follow thermal changes, hold decode to a sustainable
+        // rate, and treat a slowdown the host has not reported as throttling
+        if (m->governor.enabled) {
+            if (cb_data->tokens >= cb_data->max_tokens) {
+                cactus_stop(cb_data->cactus_model);
+                return;
+            }
+            int level = governor_level(m);
+            if (level != cb_data->level) {
+                cb_data->level = level;
+                cb_data->max_level = std::max(cb_data->max_level, level);
+                cb_data->max_tokens = std::min(cb_data->max_tokens,
+                                               governor_max_tokens(m, level, cb_data->requested_max_tokens));
+                place_decode(m, cb_data->placement, level);
+            }
+            uint64_t now = monotonic_ns();
+            uint64_t spent = cb_data->token_end_ns ? now - cb_data->token_end_ns : 0;
+            if (spent) {
+                cb_data->interval_ns = cb_data->interval_ns > 0
+                    ? 0.9 * cb_data->interval_ns + 0.1 * (double)spent : (double)spent;
+                if (cb_data->tokens >= 16 && m->cool_decode_tps > 0 &&
+                    cb_data->interval_ns * m->cool_decode_tps > 2e9) {
+                    cb_data->throttled = true;
+                }
+            }
+            cb_data->pace_ns = governor_pace_ns(m, cb_data->throttled ? std::max(level, 1) : level);
+            if (spent && spent < cb_data->pace_ns) {
+                governor_wait(m, cb_data->cancel, cb_data->pace_ns - spent);
+                // A cancel, or a background job yielding, stops here rather
+                // than after another token
+                if (request_cancelled(cb_data->cancel)) {
+                    cactus_stop(cb_data->cactus_model);
+                    return;
+                }
+                if (t_preemptible && foreground_pending(m)) {
+                    m->preempted = true;
+                    cactus_stop(cb_data->cactus_model);
+                    return;
+                }
+            }
+            if (++cb_data->tokens >= cb_data->max_tokens) {
+                cactus_stop(cb_data->cactus_model);
+            }
+            cb_data->token_end_ns = monotonic_ns();
+        }
+        
+        // A forced tail is appended instead of being decoded, which is as
+        // far ahead as we can jump without access to the sampler
+        BerdCoreSchemaValidator* v = cb_data->validator;
+        if (v) {
+            if (v->status() != BerdCoreSchemaValidator::MORE) {
+                cactus_stop(cb_data->cactus_model);
+                return;
+            }
+            size_t before = v->value().size();
+            size_t length = token ? strlen(token) : 0;
+            v->feed(token, length);
+            std::string forced = v->status() == BerdCoreSchemaValidator::MORE ? v->forced() : std::string();
+            if (!forced.empty()) {
+                v->feed(forced.data(), forced.size());
+            }
+            if (v->status() != BerdCoreSchemaValidator::MORE) {
+                cactus_stop(cb_data->cactus_model);
+            }
+            if (v->value().size() - before != length || !forced.empty()) {
+                m->reply_rewritten = true;
+            }
+            if (v->value().size() == before) return;
+            token = v->value().c_str() + before;
+        }
+        
+        if (token) m->response.append(token);
+        if (cb_data->sink->batch_callback) {
+            batcher_push(&m->batcher, *cb_data->sink, token, token_id);
+        } else if (cb_data->sink->token_callback) {
+            BERDCORE_TRACE_SCOPE("token_callback");
+            cb_data->sink->token_callback(token, cb_data->sink->user_data);
+        }
+    };
+    
+    // Prefill and decode can run on different cores; the first token moves
+    // the thread, and it is put back when this returns
+    const berdcore_thread_config_t& tc = m->thread_config;
+    BerdCoreThreadPlacement placement;
+    placement.apply(tc.qos, tc.prefill_cores, tc.prefill_threads > 0 ? tc.prefill_threads : tc.num_threads);
+    
+    BerdCoreTraceScope completion_scope("completion", m->last_reused_tokens);
+    BerdCoreTraceScope prefill_scope("prefill");
+    BerdCoreTraceScope decode_scope;
+    CallbackData cb_data{&sink, m, slot->cactus_model, 0, &prefill_scope, &decode_scope, validator.get(),
+                         &placement, t_cancel_flag, requested_max_tokens, max_tokens, level, level, 0, 0, 0, 0.0, false};
+    
+    uint64_t start_ns = monotonic_ns();
+    int result = cactus_complete(
+        slot->cactus_model,
+        messages,
+        m->completion_buffer.data(),
+        m->completion_buffer.size(),
+        m->options_json.c_str(),
+        nullptr, // no tools
+        cactus_callback,
+        &cb_data
+    );
+    
+    uint64_t end_ns = monotonic_ns();
+    prefill_scope.end();
+    decode_scope.end();
+    
+    if (sink.batch_callback) {
+        batcher_flush(&m->batcher, sink, true);
+    }
+    
+    *prefill_tokens = 0;
+    *decode_tokens = 0;
+    if (result >= 0) {
+        parse_completion_counts(m->completion_buffer.data(), prefill_tokens, decode_tokens);
+    }
+    
+    berdcore_stop_reason_t stop_reason = BERDCORE_STOP_END_OF_SEQUENCE;
+    bool invalid_output = false;
+    bool truncated_output = false;
+    if (result < 0) {
+        stop_reason = BERDCORE_STOP_ERROR;
+    } else if (request_cancelled(cb_data.cancel) || (t_background_job && m->preempted)) {
+        stop_reason = BERDCORE_STOP_CANCELLED;
+    } else if (validator && validator->status() != BerdCoreSchemaValidator::COMPLETE) {
+        // Only a number can still be completed by the end of the reply
+        truncated_output = validator->status() == BerdCoreSchemaValidator::MORE;
+        invalid_output = validator->finish() == BerdCoreSchemaValidator::INVALID;
+    }
+    if (invalid_output) {
+        stop_reason = BERDCORE_STOP_ERROR;
+    } else if (stop_reason == BERDCORE_STOP_END_OF_SEQUENCE && *decode_tokens >= cb_data.max_tokens) {
+        stop_reason = BERDCORE_STOP_MAX_TOKENS;
+    }
+    uint64_t first_ns = cb_data.first_token_ns ? cb_data.first_token_ns : end_ns;
+    record_stats(m, *prefill_tokens, *decode_tokens, first_ns, first_ns - start_ns, end_ns - first_ns, stop_reason);
+    berdcore_inference_stats_t& st = m->last_stats;
+    st.governor_level = cb_data.max_level;
+    st.max_tokens_applied = cb_data.max_tokens;
+    st.decode_rate_cap = cb_data.pace_ns ? 1e9 / cb_data.pace_ns : 0.0;
+    st.throttle_detected = cb_data.throttled ? 1 : 0;
+    
+    // Unpaced replies on a cool device set the rate the governor paces
+    // against; it follows the fastest recent runs and decays slowly
+    if (result >= 0 && stop_reason != BERDCORE_STOP_CANCELLED && cb_data.max_level == 0 &&
+        device_level() == 0 && !cb_data.throttled && *decode_tokens >= 16 &&
+        st.decode_tokens_per_second > 0) {
+        m->cool_decode_tps = std::max(st.decode_tokens_per_second, 0.95 * m->cool_decode_tps);
+    }
+    
+    if (result < 0) {
+        drop_kv_state(slot);
+        m->last_reused_tokens = 0;
+        set_error("Cactus inference failed with code: " + std::to_string(result));
+        return BERDCORE_ERROR_INFERENCE_FAILED;
+    }
+    if (invalid_output) {
+        drop_kv_state(slot);
+        m->last_reused_tokens = 0;
+        if (truncated_output) {
+            set_error("Reply ended before its JSON value was complete");
+        } else {
+            set_error("Reply does not match the JSON schema at byte " + std::to_string(validator->offset()));
+        }
+        return BERDCORE_ERROR_INVALID_OUTPUT;
+    }
+    
+    log_info("Generated " + std::to_string(*decode_tokens) + " tokens, reused " +
+             std::to_string(m->last_reused_tokens) + " prompt tokens from KV cache");
+    return BERDCORE_SUCCESS;
+}
+
+// Helper: Generate from a messages JSON array, reusing a matching KV slot
+static berdcore_error_t generate_messages(
+    BerdCoreModel* m,
+    const char* messages,
+    const berdcore_inference_options_t* options,
+    const berdcore_streaming_options_t* streaming,
+    const BerdCoreTokenSink& sink,
+    std::string* output = nullptr
+) {
+    uint64_t request_start_ns = t_request_start_ns ? t_request_start_ns : monotonic_ns();
+    if (!m->is_ready) {
+        set_error("Model not ready");
+        return BERDCORE_ERROR_NOT_INITIALIZED;
+    }
+    
+    // Messages we cannot parse are still handed to Cactus as-is, they just
+    // never take part in prefix reuse.
+    std::vector<BerdCoreMessage> prompt;
+    Json::Value messages_json;
+    bool parsed = parse_messages(messages, &messages_json, &prompt);
+    
+    std::unique_lock<std::mutex> lock = lock_inference(m);
+    m->request_start_ns = request_start_ns;
+    if (!rehydrate_for_use_locked(m)) {
+        return BERDCORE_ERROR_MODEL_LOAD_FAILED;
+    }
+    batcher_begin(&m->batcher, streaming);
+    
+    // Reuse a slot whose resident KV state this prompt extends, otherwise
+    // start from a free one so Cactus prefills from scratch.
+    BerdCoreKvSlot* slot = nullptr;
+    if (parsed) {
+        for (const auto& candidate : m->kv_slots) {
+            if (candidate->kv_owner == 0 &&
+                kv_prefix_matches(candidate->kv_messages, prompt)) {
+                slot = candidate.get();
+                break;
+            }
+        }
+    }
+    
+    int reused_tokens = 0;
+    std::string rewritten_messages;
+    if (slot) {
+        reused_tokens = slot->kv_tokens;
+        if (adopt_kv_replies(slot->kv_messages, &prompt, &messages_json)) {
+            Json::StreamWriterBuilder writer;
+            writer["indentation"] = "";
+            rewritten_messages = Json::writeString(writer, messages_json);
+            messages = rewritten_messages.c_str();
+        }
+    } else {
+        slot = acquire_free_slot(m);
+    }
+    m->last_reused_tokens = reused_tokens;
+    
+    int prefill_tokens = 0;
+    int decode_tokens = 0;
+    berdcore_error_t err = run_completion(m, slot, messages, options, sink,
+                                          &prefill_tokens, &decode_tokens);
+    if (err != BERDCORE_SUCCESS) {
+        return err;
+    }
+    if (output) {
+        *output = m->response;
+    }
+    
+    // A reply the schema trimmed or completed is not what the KV state
+    // holds, so no later prompt can extend it
+    if (m->reply_rewritten) {
+        drop_kv_state(slot);
+        m->last_stats.kv_cache_bytes = kv_cache_usage(m);
+        return BERDCORE_SUCCESS;
+    }
+    
+    slot->kv_messages.clear();
+    if (parsed) {
+        prompt.emplace_back("assistant", m->response);
+        slot->kv_messages = std::move(prompt);
+    }
+    slot->kv_resident = true;
+    slot->kv_tokens = reused_tokens + prefill_tokens + decode_tokens;
+    slot->last_used = ++m->kv_clock;
+    slot->background = t_background_job;
+    enforce_kv_budget(m, slot);
+    m->last_stats.kv_cache_bytes = kv_cache_usage(m);
+    
+    return BERDCORE_SUCCESS;
+}
+
+berdcore_error_t berdcore_generate(
+    berdcore_model_t model,
+    const char* messages,
+    const berdcore_inference_options_t* options,
+    berdcore_token_callback_t token_callback,
+    void* user_data
+) {
+    if (!model || !messages) {
+        set_error("Invalid parameters for generate");
+        return BERDCORE_ERROR_INVALID_PARAM;
+    }
+    
+    BerdCoreTokenSink sink{token_callback, nullptr, user_data};
+    return generate_messages(static_cast<BerdCoreModel*>(model), messages, options, nullptr, sink);
+}
+
+berdcore_error_t berdcore_generate_batched(
+    berdcore_model_t model,
+    const char* messages,
+    const berdcore_inference_options_t* options,
+    const berdcore_streaming_options_t* streaming,
+    berdcore_token_batch_callback_t batch_callback,
+    void* user_data
+) {
+    if (!model || !messages || !batch_callback) {
+        set_error("Invalid parameters for batched generate");
+        return BERDCORE_ERROR_INVALID_PARAM;
+    }
+    
+    BerdCoreTokenSink sink{nullptr, batch_callback, user_data};
+    return generate_messages(static_cast<BerdCoreModel*>(model), messages, options, streaming, sink);
+}
+
+berdcore_error_t berdcore_generate_with_system(
+    berdcore_model_t model,
+    const char* system_prompt,
+    const char* user_message,
+    const berdcore_inference_options_t* options,
+    berdcore_token_callback_t token_callback,
+    void* user_data
+) {
+    if (!system_prompt || !user_message) {
+        set_error("Invalid prompts");
+        return BERDCORE_ERROR_INVALID_PARAM;
+    }
+    
+    // Build messages JSON. The buffer is per thread because the model's
+    // inference lock is only taken inside berdcore_generate.
+    static thread_local std::string messages_json;
+    messages_json.clear();
+    BerdCoreJsonWriter json(&messages_json);
+    json.begin_array();
+    json.begin_object();
+    json.key("role");
+    json.string("system");
+    json.key("content");
+    json.string(system_prompt);
+    json.end_object();
+    json.begin_object();
+    json.key("role");
+    json.string("user");
+    json.key("content");
+    json.string(user_message);
+    json.end_object();
+    json.end_array();
+    
+    return berdcore_generate(model, messages_json.c_str(), options, token_callback, user_data);
+}
+
+// Helper: View of a structured message field (NULL reads as empty)
+static std::string_view message_field(const char* s, size_t length) {
+    return s ? std::string_view(s, length) : std::string_view();
+}
+
+// Helper: Strip leading/trailing whitespace without copying
+static std::string_view trim_view(std::string_view s) {
+    size_t begin = s.find_first_not_of(" \t\r\n");
+    if (begin == std::string_view::npos) return std::string_view();
+    size_t end = s.find_last_not_of(" \t\r\n");
+    return s.substr(begin, end - begin + 1);
+}
+
+// Helper: kv_prefix_matches for structured messages
+static bool kv_prefix_matches_structured(const std::vector<BerdCoreMessage>& kv,
+                                         const berdcore_message_t* msgs, size_t count) {
+    if (kv.empty() || count <= kv.size()) return false;
+    for (size_t i = 0; i < kv.size(); i++) {
+        std::string_view role = message_field(msgs[i].role, msgs[i].role_length);
+        std::string_view content = message_field(msgs[i].content, msgs[i].content_length);
+        if (role != kv[i].first) return false;
+        if (content == kv[i].second) continue;
+        
+        if (role != "assistant" || trim_view(content) != trim_view(kv[i].second)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Helper: Generate from structured messages. Nothing is parsed: the Cactus
+// request is written straight from the caller's buffers, and a matching slot
+// only copies the messages that follow its resident prefix.
+static berdcore_error_t generate_structured(
+    BerdCoreModel* m,
+    const berdcore_message_t* msgs,
+    size_t count,
+    const berdcore_inference_options_t* options,
+    const berdcore_streaming_options_t* streaming,
+    const BerdCoreTokenSink& sink
+) {
+    uint64_t request_start_ns = t_request_start_ns ? t_request_start_ns : monotonic_ns();
+    if (!m->is_ready) {
+        set_error("Model not ready");
+        return BERDCORE_ERROR_NOT_INITIALIZED;
+    }
+    
+    std::unique_lock<std::mutex> lock = lock_inference(m);
+    m->request_start_ns = request_start_ns;
+    if (!rehydrate_for_use_locked(m)) {
+        return BERDCORE_ERROR_MODEL_LOAD_FAILED;
+    }
+    batcher_begin(&m->batcher, streaming);
+    
+    BerdCoreKvSlot* slot = nullptr;
+    for (const auto& candidate : m->kv_slots) {
+        if (candidate->kv_owner == 0 &&
+            kv_prefix_matches_structured(candidate->kv_messages, msgs, count)) {
+            slot = candidate.get();
+            break;
+        }
+    }
+    size_t resident = slot ? slot->kv_messages.size() : 0;
+    int reused_tokens = slot ? slot->kv_tokens : 0;
+    if (!slot) {
+        slot = acquire_free_slot(m);
+    }
+    m->last_reused_tokens = reused_tokens;
+    
+    // Resident messages are written with the exact text the model produced
+    // so the token prefix stays identical
+    m->request_json.clear();
+    BerdCoreJsonWriter json(&m->request_json);
+    json.begin_array();
+    for (size_t i = 0; i < count; i++) {
+        json.begin_object();
+        std::string_view role = i < resident ? std::string_view(slot->kv_messages[i].first)
+                                             : message_field(msgs[i].role, msgs[i].role_length);
+        std::string_view content = i < resident ? std::string_view(slot->kv_messages[i].second)
+                                                : message_field(msgs[i].content, msgs[i].content_length);
+        json.key("role");
+        json.string(role.data(), role.size());
+        json.key("content");
+        json.string(content.data(), content.size());
+        json.end_object();
+    }
+    json.end_array();
+    
+    int prefill_tokens = 0;
+    int decode_tokens = 0;
+    berdcore_error_t err = run_completion(m, slot, m->request_json.c_str(), options, sink,
+                                          &prefill_tokens, &decode_tokens);
+    if (err != BERDCORE_SUCCESS) {
+        return err;
+    }
+    if (m->reply_rewritten) {
+        drop_kv_state(slot);
+        m->last_stats.kv_cache_bytes = kv_cache_usage(m);
+        return BERDCORE_SUCCESS;
+    }
+    
+    slot->kv_messages.resize(resident);
+    for (size_t i = resident; i < count; i++) {
+        slot->kv_messages.emplace_back(std::string(message_field(msgs[i].role, msgs[i].role_length)),
+                                       std::string(message_field(msgs[i].content, msgs[i].content_length)));
+    }
+    slot->kv_messages.emplace_back("assistant", m->response);
+    slot->kv_resident = true;
+    slot->kv_tokens = reused_tokens + prefill_tokens + decode_tokens;
+    slot->last_used = ++m->kv_clock;
+    slot->background = false;
+    enforce_kv_budget(m, slot);
+    m->last_stats.kv_cache_bytes = kv_cache_usage(m);
+    
+    return BERDCORE_SUCCESS;
+}
+
+berdcore_error_t berdcore_generate_messages(
+    berdcore_model_t model,
+    const berdcore_message_t* messages,
+    size_t num_messages,
+    const berdcore_inference_options_t* options,
+    berdcore_token_callback_t token_callback,
+    void* user_data
+) {
+    if (!model || !messages || num_messages == 0) {
+        set_error("Invalid parameters for generate_messages");
+        return BERDCORE_ERROR_INVALID_PARAM;
+    }
+    
+    BerdCoreTokenSink sink{token_callback, nullptr, user_data};
+    return generate_structured(static_cast<BerdCoreModel*>(model), messages, num_messages,
+                               options, nullptr, sink);
+}
+
+berdcore_error_t berdcore_generate_messages_batched(
+    berdcore_model_t model,
+    const berdcore_message_t* messages,
+    size_t num_messages,
+    const berdcore_inference_options_t* options,
+    const berdcore_streaming_options_t* streaming,
+    berdcore_token_batch_callback_t batch_callback,
+    void* user_data
+) {
+    if (!model || !messages || num_messages == 0 || !batch_callback) {
+        set_error("Invalid parameters for generate_messages_batched");
+        return BERDCORE_ERROR_INVALID_PARAM;
+    }
+    
+    BerdCoreTokenSink sink{nullptr, batch_callback, user_data};
+    return generate_structured(static_cast<BerdCoreModel*>(model), messages, num_messages,
+                               options, streaming, sink);
+}
+
+// ============================================================================
+// ASYNC INFERENCE
+// ============================================================================
+
+// Helper: Worker loop, runs queued requests until the model is freed
+static void async_worker_main(BerdCoreModel* m) {
+    std::string output;
+    for (;;) {
+        BerdCoreAsyncRequest req;
+        {
+            std::unique_lock<std::mutex> lock(m->queue_mutex);
+            m->queue_cv.wait(lock, [m] {
+                return m->worker_stopping || !m->queue.empty() ||
+                       (!m->background_queue.empty() && m->foreground_waiting == 0);
+            });
+            if (m->worker_stopping) return;
+            std::deque<BerdCoreAsyncRequest>& source = m->queue.empty() ? m->background_queue : m->queue;
+            req = std::move(source.front());
+            source.pop_front();
+            m->active_request = req.id;
+            m->cancel_requested = false;
+            m->preempt_requested = false;
+            m->preempted = false;
+        }
+        
+        if (req.has_options) {
+            req.options.stop_sequences = req.stop_sequences.empty() ? nullptr : req.stop_sequences.c_str();
+            req.options.json_schema = req.json_schema.empty() ? nullptr : req.json_schema.c_str();
+        }
+        t_background_job = req.background;
+        t_preemptible = req.background && req.preemptions < BERDCORE_MAX_PREEMPTIONS;
+        t_cancel_flag = &m->cancel_requested;
+        t_request_start_ns = req.submitted_ns;
+        berdcore_error_t err = generate_messages(m, req.messages.c_str(),
+                                                 req.has_options ? &req.options : nullptr,
+                                                 req.has_streaming ? &req.streaming : nullptr,
+                                                 req.sink, req.background ? &output : nullptr);
+        t_background_job = false;
+        t_preemptible = false;
+        t_cancel_flag = nullptr;
+        t_request_start_ns = 0;
+        
+        bool requeued = false;
+        {
+            std::lock_guard<std::mutex> lock(m->queue_mutex);
+            if (err == BERDCORE_SUCCESS && m->cancel_requested) {
+                err = BERDCORE_ERROR_CANCELLED;
+            } else if (err == BERDCORE_SUCCESS && m->preempted) {
+                // Yielded to a foreground generation: run again from the start
+                req.preemptions++;
+                m->background_queue.push_front(std::move(req));
+                requeued = true;
+            }
+            m->active_request = 0;
+            m->cancel_requested = false;
+            m->preempt_requested = false;
+            m->preempted = false;
+        }
+        if (requeued) continue;
+        
+        if (err == BERDCORE_ERROR_CANCELLED) {
+            set_error("Request cancelled");
+        }
+        if (req.result_callback) {
+            req.result_callback(req.id, err, err == BERDCORE_SUCCESS ? output.c_str() : nullptr,
+                                req.sink.user_data);
+        } else if (req.completion_callback) {
+            req.completion_callback(req.id, err, req.sink.user_data);
+        }
+    }
+}
+
+// Helper: Complete a request that never ran as cancelled
+static void complete_cancelled(const BerdCoreAsyncRequest& req) {
+    if (req.result_callback) {
+        req.result_callback(req.id, BERDCORE_ERROR_CANCELLED, nullptr, req.sink.user_data);
+    } else if (req.completion_callback) {
+        req.completion_callback(req.id, BERDCORE_ERROR_CANCELLED, req.sink.user_data);
+    }
+}
+
+// Helper: Stop the worker, completing queued requests as cancelled
+static void stop_async_worker(BerdCoreModel* m) {
+    std::deque<BerdCoreAsyncRequest> pending;
+    {
+        std::lock_guard<std::mutex> lock(m->queue_mutex);
+        if (!m->worker.joinable()) return;
+        m->worker_stopping = true;
+        m->cancel_requested = true;
+        pending.swap(m->queue);
+        for (auto& req : m->background_queue) {
+            pending.push_back(std::move(req));
+        }
+        m->background_queue.clear();
+    }
+    m->queue_cv.notify_all();
+    m->worker.join();
+    
+    if (!pending.empty()) {
+        set_error("Request cancelled");
+    }
+    for (const auto& req : pending) {
+        complete_cancelled(req);
+    }
+}
+
+// Helper: Copy a request into the queue, starting the worker on first use
+static uint64_t submit_async(
+    BerdCoreModel* m,
+    const char* messages,
+    const berdcore_inference_options_t* options,
+    const berdcore_streaming_options_t* streaming,
+    const BerdCoreTokenSink& sink,
+    berdcore_completion_callback_t completion_callback,
+    berdcore_result_callback_t result_callback = nullptr
+) {
+    if (!m->is_ready) {
+        set_error("Model not ready");
+        return 0;
+    }
+    
+    BerdCoreAsyncRequest req;
+    req.id = g_next_request_id++;
+    req.messages = messages;
+    req.has_options = options != nullptr;
+    if (options) {
+        req.options = *options;
+        req.stop_sequences = options->stop_sequences ? options->stop_sequences : "";
+        req.json_schema = options->json_schema ? options->json_schema : "";
+    }
+    req.has_streaming = streaming != nullptr;
+    if (streaming) {
+        req.streaming = *streaming;
+    }
+    req.sink = sink;
+    req.completion_callback = completion_callback;
+    req.background = result_callback != nullptr;
+    req.result_callback = result_callback;
+    req.preemptions = 0;
+    req.submitted_ns = monotonic_ns();
+    
+    uint64_t id = req.id;
+    {
+        std::lock_guard<std::mutex> lock(m->queue_mutex);
+        std::deque<BerdCoreAsyncRequest>& queue = req.background ? m->background_queue : m->queue;
+        size_t capacity = req.background ? BERDCORE_BACKGROUND_QUEUE_CAPACITY : BERDCORE_ASYNC_QUEUE_CAPACITY;
+        if (queue.size() >= capacity) {
+            set_error("Async request queue is full");
+            return 0;
+        }
+        if (!req.background) {
+            m->preempt_requested = true;
+        }
+        queue.push_back(std::move(req));
+        if (!m->worker.joinable()) {
+            m->worker = std::thread(async_worker_main, m);
+        }
+    }
+    m->queue_cv.notify_one();
+    return id;
+}
+
+berdcore_request_id_t berdcore_generate_async(
+    berdcore_model_t model,
+    const char* messages,
+    const berdcore_inference_options_t* options,
+    berdcore_token_callback_t token_callback,
+    berdcore_completion_callback_t completion_callback,
+    void* user_data
+) {
+    if (!model || !messages) {
+        set_error("Invalid parameters for async generate");
+        return 0;
+    }
+    
+    BerdCoreTokenSink sink{token_callback, nullptr, user_data};
+    return submit_async(static_cast<BerdCoreModel*>(model), messages, options, nullptr,
+                        sink, completion_callback);
+}
+
+berdcore_request_id_t berdcore_generate_async_batched(
+    berdcore_model_t model,
+    const char* messages,
+    const berdcore_inference_options_t* options,
+    const berdcore_streaming_options_t* streaming,
+    berdcore_token_batch_callback_t batch_callback,
+    berdcore_completion_callback_t completion_callback,
+    void* user_data
+) {
+    if (!model || !messages || !batch_callback) {
+        set_error("Invalid parameters for async generate");
+        return 0;
+    }
+    
+    BerdCoreTokenSink sink{nullptr, batch_callback, user_data};
+    return submit_async(static_cast<BerdCoreModel*>(model), messages, options, streaming,
+                        sink, completion_callback);
+}
+
+berdcore_request_id_t berdcore_generate_background(
+    berdcore_model_t model,
+    const char* messages,
+    const berdcore_inference_options_t* options,
+    berdcore_result_callback_t result_callback,
+    void* user_data
+) {
+    if (!model || !messages || !result_callback) {
+        set_error("Invalid parameters for background generate");
+        return 0;
+    }
+    
+    BerdCoreTokenSink sink{nullptr, nullptr, user_data};
+    return submit_async(static_cast<BerdCoreModel*>(model), messages, options, nullptr,
+                        sink, nullptr, result_callback);
+}
+
+berdcore_error_t berdcore_cancel(berdcore_model_t model, berdcore_request_id_t request_id) {
+    if (!model || request_id == 0) {
+        set_error("Invalid parameters for cancel");
+        return BERDCORE_ERROR_INVALID_PARAM;
+    }
+    
+    auto m = static_cast<BerdCoreModel*>(model);
+    BerdCoreAsyncRequest cancelled;
+    {
+        std::lock_guard<std::mutex> lock(m->queue_mutex);
+        if (m->active_request == request_id) {
+            m->cancel_requested = true;
+            return BERDCORE_SUCCESS;
+        }
+        
+        bool found = false;
+        for (auto* queue : {&m->queue, &m->background_queue}) {
+            auto it = queue->begin();
+            while (it != queue->end() && it->id != request_id) ++it;
+            if (it != queue->end()) {
+                cancelled = std::move(*it);
+                queue->erase(it);
+                found = true;
+                break;
+            }
+        }
+        if (!found) {
+            set_error("Unknown or finished request");
+            return BERDCORE_ERROR_INVALID_PARAM;
+        }
+    }
+    
+    set_error("Request cancelled");
+    complete_cancelled(cancelled);
+    return BERDCORE_SUCCESS;
+}
+
+// ============================================================================
+// PERPLEXITY SEARCH (using libcurl)
+// ============================================================================
+
+// CURL write callback
+static size_t berdcore_curl_write_callback(void* contents, size_t size, size_t nmemb, void* userp) {
+    ((std::string*)userp)->append((char*)contents, size * nmemb);
+    return size * nmemb;
+}
+
+// Helper: Encode search results as a cache body (length-prefixed strings)
+static std::string encode_search_results(const berdcore_search_result_t* results, int num_results) {
+    std::string body;
+    for (int i = 0; i < num_results; i++) {
+        for (const char* field : {results[i].title, results[i].url, results[i].snippet}) {
+            uint32_t length = (uint32_t)strlen(field);
+            body.append(reinterpret_cast<const char*>(&length), sizeof(length));
+            body.append(field, length);
+        }
+    }
+    return body;
+}
+
+// Helper: Decode results written by encode_search_results
+static bool decode_search_results(const std::string& body, berdcore_search_result_t** results, int* num_results) {
+    std::vector<std::string_view> fields;
+    size_t pos = 0;
+    while (pos < body.size()) {
+        uint32_t length;
+        if (body.size() - pos < sizeof(length)) return false;
+        memcpy(&length, body.data() + pos, sizeof(length));
+        pos += sizeof(length);
+        if (body.size() - pos < length) return false;
+        fields.emplace_back(body.data() + pos, length);
+        pos += length;
+    }
+    if (fields.size() % 3 != 0) return false;
+    
+    *num_results = (int)(fields.size() / 3);
+    *results = new berdcore_search_result_t[*num_results];
+    for (int i = 0; i < *num_results; i++) {
+        (*results)[i].title = strndup(fields[i * 3].data(), fields[i * 3].size());
+        (*results)[i].url = strndup(fields[i * 3 + 1].data(), fields[i * 3 + 1].size());
+        (*results)[i].snippet = strndup(fields[i * 3 + 2].data(), fields[i * 3 + 2].size());
+    }
+    return true;
+}
+
+// Helper: String member of a JSON object, empty when missing or not a string
+static std::string json_member_string(const Json::Value& object, const char* key) {
+    const Json::Value& value = object[key];
+    return value.isString() ? value.asString() : std::string();
+}
+
+// Helper: Run a Perplexity search (timeout_ms 0 = no limit), answering
+// from the cache while the same query is still fresh there
+static berdcore_error_t search_request(
+    const char* api_key,
+    const char* query,
+    int max_results,
+    long timeout_ms,
+    berdcore_search_result_t** results,
+    int* num_results
+) {
+    int ttl = cache_config().search_ttl_seconds;
+    std::string cache_key;
+    if (ttl >= 0) {
+        cache_key = cache_search_key(query, max_results);
+        BerdCoreCacheEntry cached;
+        if (cache_lookup(cache_key, &cached) && cached.fresh(cache_now()) &&
+            decode_search_results(cached.body, results, num_results)) {
+            log_info("Search served from cache");
+            return BERDCORE_SUCCESS;
+        }
+    }
+    
+    // Build request JSON
+    Json::Value request;
+    request["query"] = query;
+    request["max_results"] = max_results;
+    request["max_tokens_per_page"] = 1024;
+    
+    Json::StreamWriterBuilder writer;
+    std::string request_body = Json::writeString(writer, request);
+    
+    // Make HTTP request
+    CURL* curl = http_acquire();
+    if (!curl) {
+        set_error("Failed to initialize CURL");
+        return BERDCORE_ERROR_NETWORK;
+    }
+    
+    std::string response_data;
+    struct curl_slist* headers = nullptr;
+    headers = curl_slist_append(headers, ("Authorization: Bearer " + std::string(api_key)).c_str());
+    headers = curl_slist_append(headers, "Content-Type: application/json");
+    
+    curl_easy_setopt(curl, CURLOPT_URL, "https://api.perplexity.ai/search");
+    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
+    curl_easy_setopt(curl, CURLOPT_POSTFIELDS, request_body.c_str());
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, berdcore_curl_write_callback);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, &response_data);
+    if (timeout_ms > 0) {
+        curl_easy_setopt(curl, CURLOPT_TIMEOUT_MS, timeout_ms);
+    }
+    
+    CURLcode res;
+    {
+        BERDCORE_TRACE_SCOPE("curl_search");
+        res = curl_easy_perform(curl);
+    }
+    long status = 0;
+    curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &status);
+    curl_slist_free_all(headers);
+    http_release(curl);
+    
+    if (res != CURLE_OK) {
+        set_error("CURL request failed: " + std::string(curl_easy_strerror(res)));
+        return BERDCORE_ERROR_NETWORK;
+    }
+    // An error body (401, 429, ...) is not an empty result list, and must not
+    // be cached as one
+    if (status != 200) {
+        set_error("Search request failed with HTTP status " + std::to_string(status));
+        return BERDCORE_ERROR_NETWORK;
+    }
+    
+    // Parse response
+    Json::CharReaderBuilder reader;
+    Json::Value response;
+    std::istringstream iss(response_data);
+    std::string errs;
+    
+    BerdCoreTraceScope parse_scope("parse_search");
+    if (!Json::parseFromStream(reader, iss, &response, &errs)) {
+        set_error("Failed to parse search response: " + errs);
+        return BERDCORE_ERROR_NETWORK;
+    }
+    if (!response.isObject() || !response["results"].isArray()) {
+        set_error("Search response has no results array");
+        return BERDCORE_ERROR_NETWORK;
+    }
+    
+    // Extract results, skipping entries that are not objects
+    const Json::Value& search_results = response["results"];
+    *results = new berdcore_search_result_t[search_results.size()];
+    *num_results = 0;
+    for (const auto& result : search_results) {
+        if (!result.isObject()) continue;
+        berdcore_search_result_t& out = (*results)[(*num_results)++];
+        out.title = strdup(json_member_string(result, "title").c_str());
+        out.url = strdup(json_member_string(result, "url").c_str());
+        out.snippet = strdup(json_member_string(result, "snippet").c_str());
+    }
+    
+    if (ttl >= 0) {
+        BerdCoreCacheEntry entry;
+        entry.body = encode_search_results(*results, *num_results);
+        entry.stored_at = cache_now();
+        entry.expires_at = entry.stored_at + ttl;
+        cache_store(cache_key, entry);
+    }
+    
+    return BERDCORE_SUCCESS;
+}
+
+berdcore_error_t berdcore_search(
+    const char* api_key,
+    const char* query,
+    int max_results,
+    berdcore_search_result_t** results,
+    int* num_results
+) {
+    if (!api_key || !query || !results || !num_results) {
+        set_error("Invalid search parameters");
+        return BERDCORE_ERROR_INVALID_PARAM;
+    }
+    return search_request(api_key, query, max_results, 0, results, num_results);
+}
+
+void berdcore_free_search_results(berdcore_search_result_t* results, int num_results) {
+    if (!results) return;
+    for (int i = 0; i < num_results; i++) {
+        free(results[i].title);
+        free(results[i].url);
+        free(results[i].snippet);
+    }
+    delete[] results;
+}
+
+// What a page body turned out to be, decided on its first chunk
+enum BerdCorePageBody {
+    PAGE_BODY_UNKNOWN,
+    PAGE_BODY_HTML,   // streamed through the extractor
+    PAGE_BODY_PLAIN,  // kept as-is
+};
+
+// State of one page fetch: the text extracted so far, the caching headers
+// of the response and the cache entry it may revalidate. The download stops
+// at limit bytes, or as soon as text_limit bytes of text are in.
+struct BerdCorePageBuffer {
+    CURL* curl;
+    BerdCorePageBody body;
+    BerdCoreHtmlExtractor html;
+    std::string data;   // PAGE_BODY_PLAIN only
+    size_t limit;
+    size_t text_limit;
+    size_t received;
+    bool truncated;
+    
+    std::string etag;
+    std::string last_modified;
+    long max_age;   // Cache-Control max-age, -1 if absent
+    bool no_store;
+    
+    std::string cache_key;
+    BerdCoreCacheEntry cached;
+    bool revalidating;  // cached is stale and the request is conditional
+    struct curl_slist* request_headers;
+    
+    BerdCorePageBuffer()
+        : curl(nullptr), body(PAGE_BODY_UNKNOWN), limit(SIZE_MAX), text_limit(SIZE_MAX),
+          received(0), truncated(false), max_age(-1), no_store(false),
+          revalidating(false), request_headers(nullptr) {}
+};
+
+// Helper: Cut s to at most max_bytes without splitting a UTF-8 sequence
+static void utf8_truncate(std::string* s, size_t max_bytes) {
+    if (s->size() <= max_bytes) return;
+    size_t cut = max_bytes;
+    while (cut > 0 && ((unsigned char)(*s)[cut] & 0xC0) == 0x80) cut--;
+    s->resize(cut);
+}
+
+// Helper: Drop an incomplete UTF-8 sequence left at the end of s by a cut
+static void utf8_drop_partial(std::string* s) {
+    size_t lead = s->size();
+    while (lead > 0 && s->size() - lead < 3 && ((unsigned char)(*s)[lead - 1] & 0xC0) == 0x80) lead--;
+    if (lead == 0) return;
+    unsigned char c = (unsigned char)(*s)[lead - 1];
+    size_t length = c < 0x80 ? 1 : c >= 0xF0 ? 4 : c >= 0xE0 ? 3 : c >= 0xC0 ? 2 : 1;
+    if (s->size() - (lead - 1) < length) s->resize(lead - 1);
+}
+
+// CURL write callback for page fetches. HTML is reduced to text as it
+// arrives. Once either limit is reached it returns short, which makes curl
+// end the transfer with CURLE_WRITE_ERROR.
+static size_t berdcore_page_write_callback(void* contents, size_t size, size_t nmemb, void* userp) {
+    auto page = static_cast<BerdCorePageBuffer*>(userp);
+    const char* data = static_cast<const char*>(contents);
+    size_t bytes = size * nmemb;
+    
+    if (page->body == PAGE_BODY_UNKNOWN) {
+        char* content_type = nullptr;
+        curl_easy_getinfo(page->curl, CURLINFO_CONTENT_TYPE, &content_type);
+        if (html_is_markup(content_type, data, bytes)) {
+            page->body = PAGE_BODY_HTML;
+            page->html = BerdCoreHtmlExtractor(page->text_limit);
+        } else {
+            page->body = PAGE_BODY_PLAIN;
+        }
+    }
+    
+    size_t take = std::min(bytes, page->limit - std::min(page->limit, page->received));
+    page->received += take;
+    
+    bool more;
+    if (page->body == PAGE_BODY_HTML) {
+        more = page->html.feed(data, take);
+    } else {
+        size_t keep = std::min(take, page->text_limit - std::min(page->text_limit, page->data.size()));
+        page->data.append(data, keep);
+        more = keep == take;
+    }
+    if (!more || take < bytes) {
+        page->truncated = true;
+        return 0;
+    }
+    return bytes;
+}
+
+// CURL header callback for page fetches: keeps the validators and the
+// freshness lifetime of the final response (redirects start over)
+static size_t berdcore_page_header_callback(char* buffer, size_t size, size_t nitems, void* userp) {
+    auto page = static_cast<BerdCorePageBuffer*>(userp);
+    size_t bytes = size * nitems;
+    std::string_view line(buffer, bytes);
+    
+    if (line.compare(0, 5, "HTTP/") == 0) {
+        page->etag.clear();
+        page->last_modified.clear();
+        page->max_age = -1;
+        page->no_store = false;
+        return bytes;
+    }
+    size_t colon = line.find(':');
+    if (colon == std::string_view::npos) return bytes;
+    std::string_view name = line.substr(0, colon);
+    std::string_view value = trim_view(line.substr(colon + 1));
+    
+    auto is = [&](const char* header) {
+        return name.size() == strlen(header) && strncasecmp(name.data(), header, name.size()) == 0;
+    };
+    if (is("etag")) {
+        page->etag.assign(value.data(), value.size());
+    } else if (is("last-modified")) {
+        page->last_modified.assign(value.data(), value.size());
+    } else if (is("cache-control")) {
+        std::string directives(value);
+        std::transform(directives.begin(), directives.end(), directives.begin(), ::tolower);
+        if (directives.find("no-store") != std::string::npos) page->no_store = true;
+        if (directives.find("no-cache") != std::string::npos) page->max_age = 0;
+        size_t max_age = directives.find("max-age=");
+        if (max_age != std::string::npos && page->max_age != 0) {
+            page->max_age = strtol(directives.c_str() + max_age + 8, nullptr, 10);
+        }
+    }
+    return bytes;
+}
+
+// Helper: Look the page up in the cache. Returns true on a fresh hit that
+// covers the text limit, with its text in text; a stale entry with validators
+// is kept in page for a conditional request.
+static bool page_cache_begin(const char* url, BerdCorePageBuffer* page, std::string* text) {
+    if (cache_config().page_ttl_seconds < 0) return false;
+    
+    page->cache_key = cache_url_key(url);
+    if (!cache_lookup(page->cache_key, &page->cached) || !page->cached.covers(page->text_limit)) {
+        return false;
+    }
+    if (page->cached.fresh(cache_now())) {
+        *text = page->cached.body;
+        utf8_truncate(text, page->text_limit);
+        return true;
+    }
+    page->revalidating = !page->cached.etag.empty() || !page->cached.last_modified.empty();
+    return false;
+}
+
+// Helper: Point curl at the page, conditional on the cached validators
+static void page_setup(CURL* curl, const char* url, BerdCorePageBuffer* page) {
+    page->curl = curl;
+    curl_easy_setopt(curl, CURLOPT_URL, url);
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, berdcore_page_write_callback);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, page);
+    curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, berdcore_page_header_callback);
+    curl_easy_setopt(curl, CURLOPT_HEADERDATA, page);
+    curl_easy_setopt(curl, CURLOPT_USERAGENT, "Mozilla/5.0");
+    curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
+    
+    if (page->revalidating) {
+        if (!page->cached.etag.empty()) {
+            page->request_headers = curl_slist_append(page->request_headers,
+                                                      ("If-None-Match: " + page->cached.etag).c_str());
+        }
+        if (!page->cached.last_modified.empty()) {
+            page->request_headers = curl_slist_append(page->request_headers,
+                                                      ("If-Modified-Since: " + page->cached.last_modified).c_str());
+        }
+        curl_easy_setopt(curl, CURLOPT_HTTPHEADER, page->request_headers);
+    }
+}
+
+// Helper: Text of a finished transfer (false if it failed). A 304 renews
+// the cached entry; a full 200 response is stored as extracted text.
+static bool page_finish(CURL* curl, CURLcode result, BerdCorePageBuffer* page, std::string* text) {
+    curl_slist_free_all(page->request_headers);
+    page->request_headers = nullptr;
+    
+    if (result != CURLE_OK && !(result == CURLE_WRITE_ERROR && page->truncated)) {
+        return false;
+    }
+    
+    long status = 0;
+    curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &status);
+    
+    int ttl = cache_config().page_ttl_seconds;
+    if (page->max_age >= 0 && page->max_age < ttl) ttl = (int)page->max_age;
+    bool cacheable = !page->cache_key.empty() && ttl >= 0 && !page->no_store;
+    
+    if (status == 304 && page->revalidating) {
+        *text = page->cached.body;
+        utf8_truncate(text, page->text_limit);
+        if (cacheable) {
+            if (!page->etag.empty()) page->cached.etag = page->etag;
+            if (!page->last_modified.empty()) page->cached.last_modified = page->last_modified;
+            page->cached.stored_at = cache_now();
+            page->cached.expires_at = page->cached.stored_at + ttl;
+            cache_store(page->cache_key, page->cached);
+        }
+        return true;
+    }
+    
+    if (page->body == PAGE_BODY_HTML) {
+        *text = page->html.finish();
+    } else {
+        text->swap(page->data);
+        if (page->truncated) utf8_drop_partial(text);
+    }
+    
+    if (status == 200 && cacheable && !(page->truncated && text->empty())) {
+        BerdCoreCacheEntry entry;
+        entry.body = *text;
+        entry.etag = page->etag;
+        entry.last_modified = page->last_modified;
+        entry.stored_at = cache_now();
+        entry.expires_at = entry.stored_at + ttl;
+        entry.source_limit = page->truncated ? text->size() : 0;
+        cache_store(page->cache_key, entry);
+    }
+    return true;
+}
+
+berdcore_error_t berdcore_fetch_page(
+    const char* url,
+    char** content,
+    size_t* content_length
+) {
+    return berdcore_fetch_page_limited(url, 0, content, content_length);
+}
+
+berdcore_error_t berdcore_fetch_page_limited(
+    const char* url,
+    size_t max_text_bytes,
+    char** content,
+    size_t* content_length
+) {
+    if (!url || !content || !content_length) {
+        return BERDCORE_ERROR_INVALID_PARAM;
+    }
+    
+    BerdCorePageBuffer page;
+    if (max_text_bytes > 0) page.text_limit = max_text_bytes;
+    std::string text;
+    if (!page_cache_begin(url, &page, &text)) {
+        CURL* curl = http_acquire();
+        if (!curl) {
+            return BERDCORE_ERROR_NETWORK;
+        }
+        
+        page_setup(curl, url, &page);
+        curl_easy_setopt(curl, CURLOPT_TIMEOUT, 15L);
+        
+        CURLcode res;
+        {
+            BERDCORE_TRACE_SCOPE("curl_fetch");
+            res = curl_easy_perform(curl);
+        }
+        bool ok = page_finish(curl, res, &page, &text);
+        http_release(curl);
+        
+        if (!ok) {
+            set_error("Failed to fetch page");
+            return BERDCORE_ERROR_NETWORK;
+        }
+    }
+    
+    *content_length = text.length();
+    *content = strdup(text.c_str());
+    
+    return BERDCORE_SUCCESS;
+}
+
+// Helper: Remaining milliseconds until deadline (never below 1)
+static long ms_until(std::chrono::steady_clock::time_point deadline) {
+    auto left = std::chrono::duration_cast<std::chrono::milliseconds>(
+        deadline - std::chrono::steady_clock::now()).count();
+    return left > 1 ? (long)left : 1;
+}
+
+berdcore_error_t berdcore_search_and_fetch(
+    const char* api_key,
+    const char* query,
+    const berdcore_search_fetch_options_t* options,
+    berdcore_search_result_t** results,
+    int* num_results,
+    char*** pages,
+    berdcore_page_callback_t page_callback,
+    void* user_data
+) {
+    if (!api_key || !query || !results || !num_results || !pages) {
+        set_error("Invalid search parameters");
+        return BERDCORE_ERROR_INVALID_PARAM;
+    }
+    
+    int max_results = options && options->max_results > 0 ? options->max_results : 5;
+    int max_fetch = options && options->max_fetch > 0 ? options->max_fetch : 3;
+    long fetch_timeout_ms = options && options->fetch_timeout_ms > 0 ? options->fetch_timeout_ms : 5000;
+    long total_timeout_ms = options && options->total_timeout_ms > 0 ? options->total_timeout_ms : 10000;
+    size_t max_page_bytes = options && options->max_page_bytes > 0 ? options->max_page_bytes : 512 * 1024;
+    size_t max_text_bytes = options && options->max_text_bytes > 0 ? options->max_text_bytes : 16 * 1024;
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(total_timeout_ms);
+    
+    *pages = nullptr;
+    berdcore_error_t err = search_request(api_key, query, max_results, total_timeout_ms,
+                                          results, num_results);
+    if (err != BERDCORE_SUCCESS) {
+        return err;
+    }
+    
+    int n = *num_results;
+    *pages = static_cast<char**>(calloc(n > 0 ? n : 1, sizeof(char*)));
+    int fetch_count = std::min(n, max_fetch);
+    if (fetch_count == 0) {
+        return BERDCORE_SUCCESS;
+    }
+    
+    CURLM* multi = http_multi_create();
+    if (!multi) {
+        set_error("Failed to initialize CURL multi");
+        return BERDCORE_ERROR_NETWORK;
+    }
+    
+    // Pages fresh in the cache are handed over right away. All others are in
+    // flight at once, each with its own deadline.
+    int fetched = 0;
+    std::vector<BerdCorePageBuffer> buffers(fetch_count);
+    std::vector<CURL*> handles(fetch_count, nullptr);
+    for (int i = 0; i < fetch_count; i++) {
+        buffers[i].limit = max_page_bytes;
+        buffers[i].text_limit = max_text_bytes;
+        std::string text;
+        if (page_cache_begin((*results)[i].url, &buffers[i], &text)) {
+            (*pages)[i] = strdup(text.c_str());
+            fetched++;
+            if (page_callback) {
+                page_callback(i, (*pages)[i], text.size(), BERDCORE_SUCCESS, user_data);
+            }
+            continue;
+        }
+        
+        CURL* curl = http_acquire();
+        if (!curl) {
+            // Reported like any other failed page, so callers see every result
+            log_info("No CURL handle for result " + std::to_string(i + 1));
+            if (page_callback) {
+                page_callback(i, nullptr, 0, BERDCORE_ERROR_NETWORK, user_data);
+            }
+            continue;
+        }
+        page_setup(curl, (*results)[i].url, &buffers[i]);
+        curl_easy_setopt(curl, CURLOPT_TIMEOUT_MS, std::min(fetch_timeout_ms, ms_until(deadline)));
+        curl_easy_setopt(curl, CURLOPT_PRIVATE, reinterpret_cast<char*>(&buffers[i]));
+        curl_multi_add_handle(multi, curl);
+        handles[i] = curl;
+    }
+    
+    BERDCORE_TRACE_SCOPE("curl_fetch_pages");
+    int running = 0;
+    curl_multi_perform(multi, &running);
+    for (;;) {
+        // Hand each page over as soon as it finishes
+        int queued = 0;
+        while (CURLMsg* msg = curl_multi_info_read(multi, &queued)) {
+            if (msg->msg != CURLMSG_DONE) continue;
+            
+            char* priv = nullptr;
+            curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, &priv);
+            int i = (int)(reinterpret_cast<BerdCorePageBuffer*>(priv) - buffers.data());
+            BerdCorePageBuffer& page = buffers[i];
+            std::string text;
+            bool ok = page_finish(msg->easy_handle, msg->data.result, &page, &text);
+            
+            curl_multi_remove_handle(multi, handles[i]);
+            http_release(handles[i]);
+            handles[i] = nullptr;
+            
+            if (ok) {
+                (*pages)[i] = strdup(text.c_str());
+                fetched++;
+            } else {
+                log_info("Fetch failed for result " + std::to_string(i + 1));
+            }
+            if (page_callback) {
+                page_callback(i, (*pages)[i], ok ? text.size() : 0,
+                              ok ? BERDCORE_SUCCESS : BERDCORE_ERROR_NETWORK, user_data);
+            }
+            std::string().swap(page.data);
+        }
+        
+        if (running == 0 || std::chrono::steady_clock::now() >= deadline) break;
+        curl_multi_poll(multi, nullptr, 0, (int)std::min(ms_until(deadline), 100L), nullptr);
+        curl_multi_perform(multi, &running);
+    }
+    
+    // Whatever is still running missed the overall budget
+    for (int i = 0; i < fetch_count; i++) {
+        if (!handles[i]) continue;
+        curl_multi_remove_handle(multi, handles[i]);
+        http_release(handles[i]);
+        curl_slist_free_all(buffers[i].request_headers);
+        if (page_callback) {
+            page_callback(i, nullptr, 0, BERDCORE_ERROR_NETWORK, user_data);
+        }
+    }
+    curl_multi_cleanup(multi);
+    
+    log_info("Fetched " + std::to_string(fetched) + " of " + std::to_string(fetch_count) + " pages");
+    return BERDCORE_SUCCESS;
+}
+
+void berdcore_free_pages(char** pages, int num_pages) {
+    if (!pages) return;
+    for (int i = 0; i < num_pages; i++) {
+        free(pages[i]);
+    }
+    free(pages);
+}
+
+berdcore_error_t berdcore_cache_configure(const berdcore_cache_options_t* options) {
+    BerdCoreCacheConfig config;
+    config.memory_budget_bytes = options && options->memory_budget_bytes > 0
+        ? options->memory_budget_bytes : 16 * 1024 * 1024;
+    config.search_ttl_seconds = options && options->search_ttl_seconds != 0 ? options->search_ttl_seconds : 600;
+    config.page_ttl_seconds = options && options->page_ttl_seconds != 0 ? options->page_ttl_seconds : 3600;
+    
+    if (options && options->directory && options->directory[0]) {
+        config.directory = options->directory;
+        while (config.directory.size() > 1 && config.directory.back() == '/') {
+            config.directory.pop_back();
+        }
+        struct stat st;
+        if (mkdir(config.directory.c_str(), 0755) != 0 &&
+            (stat(config.directory.c_str(), &st) != 0 || !S_ISDIR(st.st_mode))) {
+            set_error("Cannot create cache directory: " + config.directory);
+            return BERDCORE_ERROR_INVALID_PARAM;
+        }
+    }
+    
+    cache_configure(config);
+    return BERDCORE_SUCCESS;
+}
+
+void berdcore_cache_clear(int include_disk) {
+    cache_clear(include_disk != 0);
+}
+
+// Helper: Length of the longest prefix of s up to max_bytes that ends on a
+// natural break: a paragraph past half-way, else a sentence end, else a
+// space, else the last whole UTF-8 character. Never 0 for a non-empty s
+// and max_bytes > 0, so callers that consume s cut by cut always progress.
+static size_t text_cut(std::string_view s, size_t max_bytes) {
+    if (s.size() <= max_bytes) return s.size();
+    
+    for (size_t p = max_bytes; p > max_bytes / 2; p--) {
+        if (s[p - 1] == '\n') return p;
+    }
+    for (size_t p = max_bytes; p > 1; p--) {
+        char c = s[p - 2];
+        if ((c == '.' || c == '!' || c == '?') && (s[p - 1] == ' ' || s[p - 1] == '\n')) return p - 1;
+    }
+    for (size_t p = max_bytes; p > 1; p--) {
+        if (s[p - 1] == ' ') return p - 1;
+    }
+    size_t p = max_bytes;
+    while (p > 0 && ((unsigned char)s[p] & 0xC0) == 0x80) p--;
+    // Nothing but continuation bytes (Latin-1 or binary text): cut anyway
+    return p > 0 ? p : max_bytes;
 }
 
 char* berdcore_create_augmented_prompt(
@@ -356,97 +2798,1368 @@ char* berdcore_create_augmented_prompt(
     prompt << original_query << "\n\n---\n";
     prompt << "CONTEXT FROM WEB SEARCH:\n\n";
     
-    for (int i = 0; i < num_results; i++) {
-        prompt << "[" << (i+1) << "] " << results[i].title << "\n";
-        prompt << "URL: " << results[i].url << "\n";
+    for (int i = 0; i < num_results; i++) {
+        prompt << "[" << (i+1) << "] " << results[i].title << "\n";
+        prompt << "URL: " << results[i].url << "\n";
+        
+        if (i < num_fetched && fetched_content[i]) {
+            std::string_view content = fetched_content[i];
+            if (content.length() > 800) {
+                prompt << "Content: " << content.substr(0, text_cut(content, 800)) << "...\n";
+            } else {
+                prompt << "Content: " << content << "\n";
+            }
+        } else {
+            prompt << "Snippet: " << results[i].snippet << "\n";
+        }
+        prompt << "\n";
+    }
+    
+    prompt << "---\n\n";
+    prompt << "Please provide a comprehensive answer using the above sources. ";
+    prompt << "Include relevant citations using [1], [2], etc.";
+    
+    return strdup(prompt.str().c_str());
+}
+
+// Passages are about this long; a page is split at paragraph or sentence
+// breaks into pieces no longer than this
+static const size_t PROMPT_PASSAGE_BYTES = 480;
+
+// Remaining budget below which a passage is not worth cutting down to fit
+static const int PROMPT_MIN_PARTIAL_TOKENS = 24;
+
+// One candidate piece of grounding text
+struct PromptPassage {
+    int source;           // result index
+    size_t order;         // position within the source
+    std::string_view text;
+    float score;
+    bool snippet;         // the search snippet, used where no page was fetched
+};
+
+// Helper: Estimated tokens of text, from the model's calibrated ratio
+static int estimate_text_tokens(const BerdCoreModel* m, size_t bytes) {
+    float bytes_per_token = m ? m->bytes_per_token : 4.0f;
+    return (int)std::ceil(bytes / bytes_per_token);
+}
+
+// Helper: Lowercased words of the query worth matching on
+static std::vector<std::string> prompt_query_terms(const char* query) {
+    static const char* const stopwords[] = {
+        "about", "and", "are", "can", "does", "for", "from", "how", "the",
+        "that", "this", "was", "what", "when", "where", "which", "who", "why", "with",
+    };
+    std::vector<std::string> terms;
+    std::string word;
+    for (const char* p = query;; p++) {
+        unsigned char c = (unsigned char)*p;
+        if (c && (isalnum(c) || c >= 0x80)) {
+            word.push_back((char)tolower(c));
+            continue;
+        }
+        bool stop = std::find_if(std::begin(stopwords), std::end(stopwords),
+                                 [&](const char* w) { return word == w; }) != std::end(stopwords);
+        if (word.size() >= 3 && !stop && std::find(terms.begin(), terms.end(), word) == terms.end()) {
+            terms.push_back(word);
+        }
+        word.clear();
+        if (!c) break;
+    }
+    return terms;
+}
+
+// Helper: Distinct query terms that occur in text, as whole words
+static int prompt_term_matches(std::string_view text, const std::vector<std::string>& terms) {
+    if (terms.empty()) return 0;
+    
+    std::vector<bool> seen(terms.size(), false);
+    int matches = 0;
+    std::string word;
+    for (size_t i = 0; i <= text.size(); i++) {
+        unsigned char c = i < text.size() ? (unsigned char)text[i] : 0;
+        if (c && (isalnum(c) || c >= 0x80)) {
+            word.push_back((char)tolower(c));
+            continue;
+        }
+        if (!word.empty()) {
+            for (size_t t = 0; t < terms.size(); t++) {
+                if (!seen[t] && terms[t] == word) {
+                    seen[t] = true;
+                    matches++;
+                }
+            }
+            word.clear();
+        }
+    }
+    return matches;
+}
+
+// Helper: Split a page into passages of at most PROMPT_PASSAGE_BYTES
+static void prompt_split_passages(int source, std::string_view content, std::vector<PromptPassage>* out) {
+    size_t order = 0;
+    while (!content.empty()) {
+        size_t cut = text_cut(content, PROMPT_PASSAGE_BYTES);
+        std::string_view text = trim_view(content.substr(0, cut));
+        content.remove_prefix(cut);
+        if (!text.empty()) {
+            out->push_back({source, order++, text, 0.0f, false});
+        }
+    }
+}
+
+char* berdcore_build_augmented_prompt(
+    berdcore_model_t model,
+    const char* original_query,
+    const berdcore_search_result_t* results,
+    int num_results,
+    const char** fetched_content,
+    int num_fetched,
+    int max_tokens,
+    int* token_count
+) {
+    if (!original_query || (num_results > 0 && !results)) {
+        set_error("Invalid prompt parameters");
+        return nullptr;
+    }
+    auto m = static_cast<const BerdCoreModel*>(model);
+    if (max_tokens <= 0) {
+        max_tokens = (m ? m->context_size : 2048) / 2;
+    }
+    
+    static const char preamble[] = "\n\n---\nCONTEXT FROM WEB SEARCH:\n\n";
+    static const char closing[] = "---\n\nPlease provide a comprehensive answer using the above sources. "
+                                  "Include relevant citations using [1], [2], etc.";
+    int budget = max_tokens - estimate_text_tokens(m, strlen(original_query) + sizeof(preamble) + sizeof(closing));
+    
+    // Rank every passage: query terms it covers first, then the rank of its
+    // source, with a little extra for the opening passage of a page. Once
+    // anything matches the query, passages that match nothing are filler
+    // and are left out.
+    std::vector<PromptPassage> passages;
+    for (int i = 0; i < num_results; i++) {
+        if (i < num_fetched && fetched_content && fetched_content[i] && fetched_content[i][0]) {
+            prompt_split_passages(i, fetched_content[i], &passages);
+        } else if (results[i].snippet && results[i].snippet[0]) {
+            passages.push_back({i, 0, results[i].snippet, 0.0f, true});
+        }
+    }
+    std::vector<std::string> terms = prompt_query_terms(original_query);
+    std::vector<int> matches(passages.size());
+    bool any_match = false;
+    for (size_t i = 0; i < passages.size(); i++) {
+        PromptPassage& passage = passages[i];
+        matches[i] = prompt_term_matches(passage.text, terms);
+        any_match = any_match || matches[i] > 0;
+        passage.score = (float)matches[i] +
+                        1.0f / (1.0f + passage.source) +
+                        (passage.order == 0 ? 0.5f : 0.0f);
+    }
+    std::vector<size_t> ranked;
+    for (size_t i = 0; i < passages.size(); i++) {
+        if (!any_match || matches[i] > 0) ranked.push_back(i);
+    }
+    std::stable_sort(ranked.begin(), ranked.end(), [&](size_t a, size_t b) {
+        return passages[a].score > passages[b].score;
+    });
+    
+    // Take whole passages while they fit, counting a source's header once
+    std::vector<int> header_tokens(num_results);
+    for (int i = 0; i < num_results; i++) {
+        header_tokens[i] = estimate_text_tokens(m, strlen(results[i].title) + strlen(results[i].url) + 24);
+    }
+    std::vector<bool> source_used(num_results, false);
+    std::vector<std::string_view> taken(passages.size());
+    for (size_t idx : ranked) {
+        const PromptPassage& passage = passages[idx];
+        int cost = estimate_text_tokens(m, passage.text.size() + 1) +
+                   (source_used[passage.source] ? 0 : header_tokens[passage.source]);
+        if (cost > budget) continue;
+        taken[idx] = passage.text;
+        source_used[passage.source] = true;
+        budget -= cost;
+    }
+    
+    // Fill what is left with the best passage that did not fit, cut at a
+    // sentence boundary
+    if (budget >= PROMPT_MIN_PARTIAL_TOKENS) {
+        for (size_t idx : ranked) {
+            const PromptPassage& passage = passages[idx];
+            if (!taken[idx].empty()) continue;
+            int room = budget - (source_used[passage.source] ? 0 : header_tokens[passage.source]) - 1;
+            if (room < PROMPT_MIN_PARTIAL_TOKENS) continue;
+            
+            float bytes_per_token = m ? m->bytes_per_token : 4.0f;
+            size_t cut = text_cut(passage.text, (size_t)(room * bytes_per_token));
+            if (cut == 0) continue;
+            taken[idx] = passage.text.substr(0, cut);
+            source_used[passage.source] = true;
+            break;
+        }
+    }
+    
+    // Sources in rank order, passages in page order
+    std::string prompt = original_query;
+    prompt += preamble;
+    size_t next = 0;
+    for (int i = 0; i < num_results; i++) {
+        if (!source_used[i]) {
+            while (next < passages.size() && passages[next].source == i) next++;
+            continue;
+        }
+        prompt += "[" + std::to_string(i + 1) + "] " + results[i].title + "\nURL: " + results[i].url + "\n";
+        bool first = true;
+        for (; next < passages.size() && passages[next].source == i; next++) {
+            if (taken[next].empty()) continue;
+            if (first) {
+                prompt += passages[next].snippet ? "Snippet: " : "Content: ";
+                first = false;
+            } else {
+                prompt += passages[next].order == passages[next - 1].order + 1 && !taken[next - 1].empty() ? "\n" : "\n...\n";
+            }
+            prompt.append(taken[next].data(), taken[next].size());
+        }
+        prompt += "\n\n";
+    }
+    prompt += closing;
+    
+    if (token_count) {
+        *token_count = estimate_text_tokens(m, prompt.size());
+    }
+    return strdup(prompt.c_str());
+}
+
+// ============================================================================
+// MARKDOWN PROCESSING
+// ============================================================================
+
+char* berdcore_markdown_to_html(const char* markdown) {
+    if (!markdown) return nullptr;
+    return strdup(markdown_render(markdown).c_str());
+}
+
+struct BerdCoreMarkdownStreamState {
+    BerdCoreMarkdownStream stream;
+    std::vector<BerdCoreMarkdownStream::Block> updates;
+    std::vector<berdcore_markdown_block_t> blocks;
+    bool finished;
+    
+    BerdCoreMarkdownStreamState() : finished(false) {}
+};
+
+// Helper: Expose the stream's pending updates through the C structs
+static void markdown_stream_publish(BerdCoreMarkdownStreamState* st,
+                                    const berdcore_markdown_block_t** blocks,
+                                    int* num_blocks, int* total_blocks) {
+    st->blocks.resize(st->updates.size());
+    for (size_t i = 0; i < st->updates.size(); i++) {
+        const auto& update = st->updates[i];
+        st->blocks[i].index = (int)update.index;
+        st->blocks[i].html = update.html.c_str();
+        st->blocks[i].html_length = update.html.size();
+        st->blocks[i].is_final = update.final ? 1 : 0;
+    }
+    *blocks = st->blocks.empty() ? nullptr : st->blocks.data();
+    *num_blocks = (int)st->blocks.size();
+    if (total_blocks) *total_blocks = (int)st->stream.block_count();
+}
+
+berdcore_markdown_stream_t berdcore_markdown_stream_create(void) {
+    return new BerdCoreMarkdownStreamState();
+}
+
+berdcore_error_t berdcore_markdown_stream_append(
+    berdcore_markdown_stream_t stream,
+    const char* text,
+    size_t length,
+    const berdcore_markdown_block_t** blocks,
+    int* num_blocks,
+    int* total_blocks
+) {
+    if (!stream || (!text && length > 0) || !blocks || !num_blocks) {
+        set_error("Invalid markdown stream parameters");
+        return BERDCORE_ERROR_INVALID_PARAM;
+    }
+    
+    auto st = static_cast<BerdCoreMarkdownStreamState*>(stream);
+    if (st->finished) {
+        set_error("Markdown stream already finished");
+        return BERDCORE_ERROR_INVALID_PARAM;
+    }
+    st->updates.clear();
+    st->stream.append(text, length, &st->updates);
+    markdown_stream_publish(st, blocks, num_blocks, total_blocks);
+    return BERDCORE_SUCCESS;
+}
+
+berdcore_error_t berdcore_markdown_stream_finish(
+    berdcore_markdown_stream_t stream,
+    const berdcore_markdown_block_t** blocks,
+    int* num_blocks,
+    int* total_blocks
+) {
+    if (!stream || !blocks || !num_blocks) {
+        set_error("Invalid markdown stream parameters");
+        return BERDCORE_ERROR_INVALID_PARAM;
+    }
+    
+    auto st = static_cast<BerdCoreMarkdownStreamState*>(stream);
+    st->updates.clear();
+    if (!st->finished) {
+        st->stream.finish(&st->updates);
+        st->finished = true;
+    }
+    markdown_stream_publish(st, blocks, num_blocks, total_blocks);
+    return BERDCORE_SUCCESS;
+}
+
+void berdcore_markdown_stream_free(berdcore_markdown_stream_t stream) {
+    delete static_cast<BerdCoreMarkdownStreamState*>(stream);
+}
+
+// Spans collected by a code block scan
+struct BerdCoreCodeSpanSink {
+    berdcore_code_span_t* spans;
+    int max_spans;
+    int count;
+    bool stop_when_full;
+};
+
+// Helper: Store a span; stops the scan once the sink is full if asked to
+static bool code_span_collect(const berdcore_code_span_t* span, void* user_data) {
+    auto sink = static_cast<BerdCoreCodeSpanSink*>(user_data);
+    if (sink->count < sink->max_spans) sink->spans[sink->count] = *span;
+    sink->count++;
+    return !sink->stop_when_full || sink->count < sink->max_spans;
+}
+
+berdcore_error_t berdcore_find_code_blocks(
+    const char* markdown,
+    size_t length,
+    berdcore_code_span_t* spans,
+    int max_spans,
+    int* num_spans
+) {
+    if ((!markdown && length > 0) || (!spans && max_spans > 0) || !num_spans) {
+        set_error("Invalid code block parameters");
+        return BERDCORE_ERROR_INVALID_PARAM;
+    }
+    
+    berdcore_code_scanner_t scanner;
+    berdcore_code_scanner_init(&scanner);
+    BerdCoreCodeSpanSink sink = {spans, std::max(0, max_spans), 0, false};
+    markdown_scan_code(markdown, length, true, &scanner, code_span_collect, &sink);
+    *num_spans = sink.count;
+    return BERDCORE_SUCCESS;
+}
+
+void berdcore_code_scanner_init(berdcore_code_scanner_t* scanner) {
+    if (scanner) memset(scanner, 0, sizeof(*scanner));
+}
+
+berdcore_error_t berdcore_code_scanner_feed(
+    berdcore_code_scanner_t* scanner,
+    const char* text,
+    size_t length,
+    int is_final,
+    berdcore_code_span_t* spans,
+    int max_spans,
+    int* num_spans
+) {
+    if (!scanner || (!text && length > 0) || !spans || max_spans < 1 || !num_spans ||
+        scanner->position > length) {
+        set_error("Invalid code scanner parameters");
+        return BERDCORE_ERROR_INVALID_PARAM;
+    }
+    
+    BerdCoreCodeSpanSink sink = {spans, max_spans, 0, true};
+    markdown_scan_code(text, length, is_final != 0, scanner, code_span_collect, &sink);
+    // The block still being generated, as far as it has arrived
+    if (scanner->in_block && sink.count < max_spans) {
+        spans[sink.count++] = scanner->current;
+    }
+    *num_spans = sink.count;
+    return BERDCORE_SUCCESS;
+}
+
+berdcore_error_t berdcore_extract_code_blocks(
+    const char* markdown,
+    char*** languages,
+    char*** codes,
+    int* num_blocks
+) {
+    if (!markdown || !languages || !codes || !num_blocks) {
+        set_error("Invalid code block parameters");
+        return BERDCORE_ERROR_INVALID_PARAM;
+    }
+    *languages = nullptr;
+    *codes = nullptr;
+    *num_blocks = 0;
+    
+    size_t length = strlen(markdown);
+    int count = 0;
+    berdcore_find_code_blocks(markdown, length, nullptr, 0, &count);
+    if (count == 0) return BERDCORE_SUCCESS;
+    
+    std::vector<berdcore_code_span_t> spans(count);
+    berdcore_find_code_blocks(markdown, length, spans.data(), count, &count);
+    *languages = static_cast<char**>(malloc(sizeof(char*) * count));
+    *codes = static_cast<char**>(malloc(sizeof(char*) * count));
+    for (int i = 0; i < count; i++) {
+        (*languages)[i] = strndup(markdown + spans[i].language_offset, spans[i].language_length);
+        (*codes)[i] = strndup(markdown + spans[i].code_offset, spans[i].code_length);
+    }
+    *num_blocks = count;
+    return BERDCORE_SUCCESS;
+}
+
+void berdcore_free_code_blocks(char** languages, char** codes, int num_blocks) {
+    for (int i = 0; i < num_blocks; i++) {
+        if (languages) free(languages[i]);
+        if (codes) free(codes[i]);
+    }
+    free(languages);
+    free(codes);
+}
+
+void berdcore_free_string(char* str) {
+    if (str) free(str);
+}
+
+// ============================================================================
+// CONVERSATION MANAGEMENT
+// ============================================================================
+
+// Helper: Role of message i
+static std::string_view conversation_role(const BerdCoreConversation* c, size_t i) {
+    const BerdCoreConversationEntry& e = c->entries[i];
+    return std::string_view(c->arena.data() + e.role_offset, e.role_length);
+}
+
+// Helper: Content of message i
+static std::string_view conversation_content(const BerdCoreConversation* c, size_t i) {
+    const BerdCoreConversationEntry& e = c->entries[i];
+    return std::string_view(c->arena.data() + e.content_offset, e.content_length);
+}
+
+// Helper: Append a message to the arena and the serialized array
+static void conversation_append(BerdCoreConversation* c, std::string_view role,
+                                std::string_view content, int token_count) {
+    BerdCoreConversationEntry e;
+    e.role_offset = c->arena.size();
+    e.role_length = role.size();
+    c->arena.append(role.data(), role.size());
+    e.content_offset = c->arena.size();
+    e.content_length = content.size();
+    c->arena.append(content.data(), content.size());
+    e.token_count = token_count;
+    e.json_offset = 0;
+    c->entries.push_back(e);
+}
+
+// Helper: Serialize the messages added since the last call
+static const std::string& conversation_json(BerdCoreConversation* c) {
+    if (c->json_count == c->entries.size()) return c->json;
+    
+    c->json.pop_back(); // reopen the array
+    for (size_t i = c->json_count; i < c->entries.size(); i++) {
+        std::string_view role = conversation_role(c, i);
+        std::string_view content = conversation_content(c, i);
+        c->entries[i].json_offset = c->json.size();
+        if (i > 0) c->json += ',';
+        c->json += "{\"role\":";
+        json_append_quoted(&c->json, role.data(), role.size());
+        c->json += ",\"content\":";
+        json_append_quoted(&c->json, content.data(), content.size());
+        c->json += '}';
+    }
+    c->json += ']';
+    c->json_count = c->entries.size();
+    return c->json;
+}
+
+// Helper: Drop all messages from index count on
+static void conversation_truncate(BerdCoreConversation* c, size_t count) {
+    if (count >= c->entries.size()) return;
+    
+    const BerdCoreConversationEntry& e = c->entries[count];
+    c->arena.resize(e.role_offset);
+    if (count < c->json_count) {
+        c->json.resize(e.json_offset);
+        c->json += ']';
+        c->json_count = count;
+    }
+    if (count < c->saved_count) {
+        c->saved_path.clear(); // the file has messages we no longer do
+    }
+    c->entries.resize(count);
+}
+
+berdcore_conversation_t berdcore_conversation_create(const char* title) {
+    return new BerdCoreConversation(title);
+}
+
+berdcore_error_t berdcore_conversation_add_message(
+    berdcore_conversation_t conv,
+    const char* role,
+    const char* content
+) {
+    if (!conv || !role || !content) {
+        return BERDCORE_ERROR_INVALID_PARAM;
+    }
+    
+    conversation_append(static_cast<BerdCoreConversation*>(conv), role, content, -1);
+    return BERDCORE_SUCCESS;
+}
+
+size_t berdcore_conversation_get_message_count(berdcore_conversation_t conv) {
+    if (!conv) return 0;
+    return static_cast<BerdCoreConversation*>(conv)->entries.size();
+}
+
+berdcore_error_t berdcore_conversation_get_message(
+    berdcore_conversation_t conv,
+    size_t index,
+    berdcore_message_t* message,
+    int* token_count
+) {
+    auto c = static_cast<BerdCoreConversation*>(conv);
+    if (!c || !message || index >= c->entries.size()) {
+        set_error("Invalid parameters for get_message");
+        return BERDCORE_ERROR_INVALID_PARAM;
+    }
+    
+    std::string_view role = conversation_role(c, index);
+    std::string_view content = conversation_content(c, index);
+    message->role = role.data();
+    message->role_length = role.size();
+    message->content = content.data();
+    message->content_length = content.size();
+    if (token_count) *token_count = c->entries[index].token_count;
+    return BERDCORE_SUCCESS;
+}
+
+const char* berdcore_conversation_get_json(berdcore_conversation_t conv, size_t* length) {
+    if (!conv) {
+        if (length) *length = 0;
+        return nullptr;
+    }
+    const std::string& json = conversation_json(static_cast<BerdCoreConversation*>(conv));
+    if (length) *length = json.size();
+    return json.c_str();
+}
+
+char* berdcore_conversation_to_json(berdcore_conversation_t conv) {
+    if (!conv) return nullptr;
+    return strdup(conversation_json(static_cast<BerdCoreConversation*>(conv)).c_str());
+}
+
+// Conversation files are an append-only log that loads with one read into
+// the arena and a walk over fixed-size record headers. All integers are
+// little-endian.
+//
+//   file header    "BERDCONV" u32 version, u32 title_length, title, pad to 8
+//   record         u32 type, u32 role_length, u32 content_length,
+//                  i32 token_count, role, content, pad to 8
+//
+// Saving again appends records for new messages only. A torn record at the
+// end (e.g. after a crash mid-append) is ignored on load, and record types
+// other than MESSAGE are skipped so newer files stay readable.
+//
+// Only text and token counts are stored, not token IDs: the engine neither
+// exposes its tokenizer nor accepts tokens as input, so a loaded
+// conversation is prefilled from its text when a session first uses it.
+
+static const char CONV_FILE_MAGIC[8] = {'B', 'E', 'R', 'D', 'C', 'O', 'N', 'V'};
+static const uint32_t CONV_FILE_VERSION = 1;
+static const uint32_t CONV_RECORD_MESSAGE = 1;
+
+struct ConvFileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t title_length;
+};
+
+struct ConvRecordHeader {
+    uint32_t type;
+    uint32_t role_length;
+    uint32_t content_length;
+    int32_t token_count;
+};
+
+// Helper: Round up to the record alignment
+static size_t conv_align(size_t n) {
+    return (n + 7) & ~(size_t)7;
+}
+
+// Helper: Append records for messages [first, entries.size()) to out
+static void conv_encode_records(const BerdCoreConversation* c, size_t first, std::string* out) {
+    for (size_t i = first; i < c->entries.size(); i++) {
+        std::string_view role = conversation_role(c, i);
+        std::string_view content = conversation_content(c, i);
+        ConvRecordHeader rec = {CONV_RECORD_MESSAGE, (uint32_t)role.size(),
+                                (uint32_t)content.size(), (int32_t)c->entries[i].token_count};
+        size_t start = out->size();
+        out->append(reinterpret_cast<const char*>(&rec), sizeof(rec));
+        out->append(role.data(), role.size());
+        out->append(content.data(), content.size());
+        out->resize(start + conv_align(out->size() - start), '\0');
+    }
+}
+
+// Helper: pread() exactly length bytes at offset
+static bool conv_read_all(int fd, char* out, size_t length, off_t offset) {
+    size_t done = 0;
+    while (done < length) {
+        ssize_t n = pread(fd, out + done, length - done, offset + (off_t)done);
+        if (n <= 0) return false;
+        done += (size_t)n;
+    }
+    return true;
+}
+
+// Helper: write() all of data
+static bool conv_write_all(int fd, const std::string& data) {
+    size_t done = 0;
+    while (done < data.size()) {
+        ssize_t n = write(fd, data.data() + done, data.size() - done);
+        if (n < 0) return false;
+        done += (size_t)n;
+    }
+    return true;
+}
+
+berdcore_error_t berdcore_conversation_save(berdcore_conversation_t conv, const char* path) {
+    if (!conv || !path) {
+        set_error("Invalid parameters for conversation save");
+        return BERDCORE_ERROR_INVALID_PARAM;
+    }
+    
+    auto c = static_cast<BerdCoreConversation*>(conv);
+    struct stat st;
+    bool append = c->saved_path == path && stat(path, &st) == 0 && st.st_size == c->saved_size;
+    
+    std::string data;
+    if (append) {
+        if (c->saved_count == c->entries.size()) return BERDCORE_SUCCESS;
+        conv_encode_records(c, c->saved_count, &data);
         
-        if (i < num_fetched && fetched_content[i]) {
-            std::string content = fetched_content[i];
-            if (content.length() > 800) {
-                content = content.substr(0, 800) + "...";
-            }
-            prompt << "Content: " << content << "\n";
-        } else {
-            prompt << "Snippet: " << results[i].snippet << "\n";
+        int fd = open(path, O_WRONLY | O_APPEND);
+        if (fd < 0 || !conv_write_all(fd, data) || fsync(fd) != 0) {
+            if (fd >= 0) close(fd);
+            set_error("Failed to append to conversation file: " + std::string(path));
+            return BERDCORE_ERROR_INVALID_PARAM;
         }
-        prompt << "\n";
+        close(fd);
+        c->saved_size += (off_t)data.size();
+    } else {
+        // Write a fresh file next to the target and move it into place
+        ConvFileHeader header;
+        memcpy(header.magic, CONV_FILE_MAGIC, sizeof(header.magic));
+        header.version = CONV_FILE_VERSION;
+        header.title_length = (uint32_t)c->title.size();
+        data.append(reinterpret_cast<const char*>(&header), sizeof(header));
+        data.append(c->title);
+        data.resize(conv_align(data.size()), '\0');
+        conv_encode_records(c, 0, &data);
+        
+        std::string tmp_path = std::string(path) + ".tmp";
+        int fd = open(tmp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0 || !conv_write_all(fd, data) || fsync(fd) != 0) {
+            if (fd >= 0) close(fd);
+            unlink(tmp_path.c_str());
+            set_error("Failed to write conversation file: " + std::string(path));
+            return BERDCORE_ERROR_INVALID_PARAM;
+        }
+        close(fd);
+        if (rename(tmp_path.c_str(), path) != 0) {
+            unlink(tmp_path.c_str());
+            set_error("Failed to replace conversation file: " + std::string(path));
+            return BERDCORE_ERROR_INVALID_PARAM;
+        }
+        c->saved_path = path;
+        c->saved_size = (off_t)data.size();
+    }
+    c->saved_count = c->entries.size();
+    return BERDCORE_SUCCESS;
+}
+
+berdcore_conversation_t berdcore_conversation_load(const char* path) {
+    if (!path) {
+        set_error("Invalid path for conversation load");
+        return nullptr;
     }
     
-    prompt << "---\n\n";
-    prompt << "Please provide a comprehensive answer using the above sources. ";
-    prompt << "Include relevant citations using [1], [2], etc.";
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        set_error("Cannot open conversation file: " + std::string(path));
+        return nullptr;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(ConvFileHeader)) {
+        close(fd);
+        set_error("Not a conversation file: " + std::string(path));
+        return nullptr;
+    }
+    size_t size = (size_t)st.st_size;
+    ConvFileHeader header;
+    if (!conv_read_all(fd, reinterpret_cast<char*>(&header), sizeof(header), 0)) {
+        close(fd);
+        set_error("Cannot read conversation file: " + std::string(path));
+        return nullptr;
+    }
+    size_t records = conv_align(sizeof(header) + header.title_length);
+    if (memcmp(header.magic, CONV_FILE_MAGIC, sizeof(header.magic)) != 0 ||
+        header.version != CONV_FILE_VERSION || records > size) {
+        close(fd);
+        set_error("Not a conversation file: " + std::string(path));
+        return nullptr;
+    }
     
-    return strdup(prompt.str().c_str());
+    // The records area is read straight into the arena, the only copy made;
+    // entries point at the role and content bytes between the record headers
+    auto c = new BerdCoreConversation(nullptr);
+    c->title.resize(header.title_length);
+    c->arena.resize(size - records);
+    bool read_ok = conv_read_all(fd, &c->title[0], c->title.size(), (off_t)sizeof(header)) &&
+                   conv_read_all(fd, &c->arena[0], c->arena.size(), (off_t)records);
+    close(fd);
+    if (!read_ok) {
+        delete c;
+        set_error("Cannot read conversation file: " + std::string(path));
+        return nullptr;
+    }
+    
+    size_t pos = 0;
+    while (pos + sizeof(ConvRecordHeader) <= c->arena.size()) {
+        ConvRecordHeader rec;
+        memcpy(&rec, c->arena.data() + pos, sizeof(rec));
+        size_t body = pos + sizeof(rec);
+        size_t next = pos + conv_align(sizeof(rec) + (size_t)rec.role_length + rec.content_length);
+        if (next > c->arena.size()) break; // torn tail
+        
+        if (rec.type == CONV_RECORD_MESSAGE) {
+            BerdCoreConversationEntry e;
+            e.role_offset = body;
+            e.role_length = rec.role_length;
+            e.content_offset = body + rec.role_length;
+            e.content_length = rec.content_length;
+            e.json_offset = 0;
+            e.token_count = rec.token_count;
+            c->entries.push_back(e);
+        }
+        pos = next;
+    }
+    
+    // Only a file that ends with a complete record can be appended to
+    if (pos == c->arena.size()) {
+        c->saved_path = path;
+        c->saved_count = c->entries.size();
+        c->saved_size = (off_t)size;
+    }
+    log_info("Loaded " + std::to_string(c->entries.size()) + " messages from " + path);
+    return c;
+}
+
+void berdcore_conversation_free(berdcore_conversation_t conv) {
+    if (!conv) return;
+    delete static_cast<BerdCoreConversation*>(conv);
 }
 
 // ============================================================================
-// MARKDOWN PROCESSING
+// SESSIONS
 // ============================================================================
 
-char* berdcore_markdown_to_html(const char* markdown) {
-    // TODO: Implement proper markdown parser
-    // For now, return copy
-    return markdown ? strdup(markdown) : nullptr;
+berdcore_session_t berdcore_session_create(
+    berdcore_model_t model,
+    berdcore_conversation_t conv
+) {
+    if (!model || !conv) {
+        set_error("Invalid parameters for session");
+        return nullptr;
+    }
+    
+    return new BerdCoreSession(g_next_session_id++,
+                               static_cast<BerdCoreModel*>(model),
+                               static_cast<BerdCoreConversation*>(conv));
 }
 
-berdcore_error_t berdcore_extract_code_blocks(
-    const char* markdown,
-    char*** languages,
-    char*** codes,
-    int* num_blocks
+berdcore_error_t berdcore_session_set_context_policy(
+    berdcore_session_t session,
+    const berdcore_context_options_t* options
 ) {
-    // TODO: Implement code block extraction
-    if (num_blocks) *num_blocks = 0;
+    if (!session || !options) {
+        set_error("Invalid parameters for context policy");
+        return BERDCORE_ERROR_INVALID_PARAM;
+    }
+    
+    auto s = static_cast<BerdCoreSession*>(session);
+    std::lock_guard<std::mutex> lock(s->model->inference_mutex);
+    s->context = *options;
     return BERDCORE_SUCCESS;
 }
 
-void berdcore_free_string(char* str) {
-    if (str) free(str);
+// Helper: Estimated tokens of a message, from the engine count when known
+static int estimate_message_tokens(const BerdCoreModel* m, const BerdCoreConversation* c, size_t i) {
+    int known = c->entries[i].token_count;
+    if (known >= 0) return known;
+    
+    // Chat template overhead is a handful of tokens per message
+    return (int)(c->entries[i].content_length / m->bytes_per_token) + 4;
+}
+
+// Helper: Estimated tokens the engine would see for the session window
+static int estimate_window_tokens(const BerdCoreSession* s) {
+    const BerdCoreConversation* c = s->conversation;
+    size_t head = std::min(s->head_count, c->entries.size());
+    int total = (int)(s->summary.size() / s->model->bytes_per_token);
+    for (size_t i = 0; i < head; i++) {
+        total += estimate_message_tokens(s->model, c, i);
+    }
+    for (size_t i = std::max(s->window_start, head); i < c->entries.size(); i++) {
+        total += estimate_message_tokens(s->model, c, i);
+    }
+    return total;
+}
+
+// Helper: Summarize the messages that are leaving the window into
+// s->summary, using the session's slot (caller holds inference_mutex and
+// has dropped the slot's KV state)
+static void summarize_dropped(BerdCoreSession* s, BerdCoreKvSlot* slot, size_t from, size_t to) {
+    BerdCoreModel* m = s->model;
+    BerdCoreConversation* c = s->conversation;
+    
+    std::string transcript;
+    if (!s->summary.empty()) {
+        transcript += "Earlier summary: " + s->summary + "\n\n";
+    }
+    for (size_t i = from; i < to; i++) {
+        transcript.append(conversation_role(c, i));
+        transcript += ": ";
+        transcript.append(conversation_content(c, i));
+        transcript += "\n\n";
+    }
+    
+    const char* instruction = s->context.summary_prompt ? s->context.summary_prompt :
+        "Summarize this conversation in a few sentences. Keep names, facts, decisions "
+        "and open questions. Reply with the summary only.";
+    std::string request;
+    BerdCoreJsonWriter json(&request);
+    json.begin_array();
+    json.begin_object();
+    json.key("role");
+    json.string("system");
+    json.key("content");
+    json.string(instruction);
+    json.end_object();
+    json.begin_object();
+    json.key("role");
+    json.string("user");
+    json.key("content");
+    json.string(transcript);
+    json.end_object();
+    json.end_array();
+    
+    berdcore_inference_options_t opts = {0.3f, 0.9f, 40,
+                                         s->context.summary_max_tokens > 0 ? s->context.summary_max_tokens : 256,
+                                         nullptr, nullptr};
+    BerdCoreTokenSink sink{nullptr, nullptr, nullptr};
+    int prefill_tokens = 0;
+    int decode_tokens = 0;
+    m->last_reused_tokens = 0;
+    if (run_completion(m, slot, request.c_str(), &opts, sink, &prefill_tokens, &decode_tokens) == BERDCORE_SUCCESS) {
+        s->summary = trim_whitespace(m->response);
+        log_info("Summarized " + std::to_string(to - from) + " messages into " +
+                 std::to_string(decode_tokens) + " tokens");
+    } else {
+        log_info("Summary failed, dropping messages without one");
+    }
+    drop_kv_state(slot);
+}
+
+// Helper: Move the window forward so the next turn fits the context
+// (caller holds inference_mutex). Trims to target_tokens rather than just
+// under the limit so the re-prefill this causes is paid once per many turns.
+static void apply_context_policy(BerdCoreSession* s, BerdCoreKvSlot* slot, int max_tokens) {
+    BerdCoreModel* m = s->model;
+    BerdCoreConversation* c = s->conversation;
+    const berdcore_context_options_t& ctx = s->context;
+    if (ctx.policy == BERDCORE_CONTEXT_NONE) return;
+    
+    int reserve = ctx.reserve_tokens > 0 ? ctx.reserve_tokens : max_tokens;
+    if (estimate_window_tokens(s) + reserve <= m->context_size) return;
+    
+    // Leading system messages are always kept; drop-middle also keeps the
+    // first turns after them
+    size_t head = 0;
+    while (head < c->entries.size() && conversation_role(c, head) == "system") head++;
+    if (ctx.policy == BERDCORE_CONTEXT_DROP_MIDDLE) {
+        head += ctx.keep_first_messages > 0 ? (size_t)ctx.keep_first_messages : 2;
+    }
+    size_t last = c->entries.size() - 1; // the message being answered is always sent
+    head = std::min(head, last);
+    if (s->head_count != head) {
+        s->head_count = head;
+        s->window_start = std::max(s->window_start, head);
+    }
+    
+    int target = ctx.target_tokens > 0 ? ctx.target_tokens : m->context_size * 3 / 4;
+    target -= reserve;
+    size_t old_start = s->window_start;
+    int total = estimate_window_tokens(s);
+    while (s->window_start < last && total > target) {
+        total -= estimate_message_tokens(m, c, s->window_start);
+        s->window_start++;
+    }
+    if (s->window_start == old_start) return;
+    
+    drop_kv_state(slot);
+    if (ctx.policy == BERDCORE_CONTEXT_SUMMARIZE) {
+        summarize_dropped(s, slot, old_start, s->window_start);
+    }
+    s->window_version++;
+    log_info("Context window now starts at message " + std::to_string(s->window_start));
+}
+
+// Helper: Messages JSON for the session window
+static const char* session_window_json(BerdCoreSession* s) {
+    BerdCoreConversation* c = s->conversation;
+    if (s->window_start == 0 && s->summary.empty()) {
+        return conversation_json(c).c_str();
+    }
+    
+    s->window_json.clear();
+    BerdCoreJsonWriter json(&s->window_json);
+    json.begin_array();
+    for (size_t i = 0; i < c->entries.size(); i++) {
+        if (i == s->head_count && !s->summary.empty()) {
+            json.begin_object();
+            json.key("role");
+            json.string("system");
+            json.key("content");
+            json.string("Summary of the earlier conversation: " + s->summary);
+            json.end_object();
+        }
+        if (i >= s->head_count && i < s->window_start) continue;
+        
+        std::string_view role = conversation_role(c, i);
+        std::string_view content = conversation_content(c, i);
+        json.begin_object();
+        json.key("role");
+        json.string(role.data(), role.size());
+        json.key("content");
+        json.string(content.data(), content.size());
+        json.end_object();
+    }
+    json.end_array();
+    return s->window_json.c_str();
+}
+
+// Helper: Append a turn to the session and generate the reply
+static berdcore_error_t session_generate(
+    BerdCoreSession* s,
+    const char* role,
+    const char* content,
+    const berdcore_inference_options_t* options,
+    const berdcore_streaming_options_t* streaming,
+    const BerdCoreTokenSink& sink
+) {
+    uint64_t request_start_ns = t_request_start_ns ? t_request_start_ns : monotonic_ns();
+    BerdCoreModel* m = s->model;
+    if (!m->is_ready) {
+        set_error("Model not ready");
+        return BERDCORE_ERROR_NOT_INITIALIZED;
+    }
+    
+    std::unique_lock<std::mutex> lock = lock_inference(m);
+    m->request_start_ns = request_start_ns;
+    if (!rehydrate_for_use_locked(m)) {
+        return BERDCORE_ERROR_MODEL_LOAD_FAILED;
+    }
+    batcher_begin(&m->batcher, streaming);
+    
+    // Conversations only grow, so the KV state is still a prefix of the
+    // history as long as the session's slot has not been evicted.
+    int reused_tokens = 0;
+    BerdCoreKvSlot* slot = find_owned_slot(m, s->id);
+    BerdCoreConversation* c = s->conversation;
+    if (slot && s->kv_count <= c->entries.size() && s->kv_window_version == s->window_version) {
+        reused_tokens = slot->kv_tokens;
+    } else {
+        if (slot) drop_kv_state(slot);
+        slot = acquire_free_slot(m);
+    }
+    m->last_reused_tokens = reused_tokens;
+    
+    size_t turn_start = c->entries.size();
+    conversation_append(c, role, content, -1);
+    
+    // A moved window is not a continuation of the resident KV state
+    int max_tokens = options && options->max_tokens > 0 ? options->max_tokens : 512;
+    apply_context_policy(s, slot, max_tokens);
+    if (s->kv_window_version != s->window_version) {
+        reused_tokens = 0;
+    }
+    m->last_reused_tokens = reused_tokens;
+    
+    int prefill_tokens = 0;
+    int decode_tokens = 0;
+    berdcore_error_t err = run_completion(m, slot, session_window_json(s), options, sink,
+                                          &prefill_tokens, &decode_tokens);
+    if (err != BERDCORE_SUCCESS) {
+        // Leave the conversation as it was before the turn
+        conversation_truncate(c, turn_start);
+        return err;
+    }
+    
+    // With the earlier turns resident, the prefill covers exactly the new
+    // message (plus its chat template tokens)
+    if (s->kv_count == turn_start && (reused_tokens > 0 || turn_start == 0)) {
+        c->entries[turn_start].token_count = prefill_tokens;
+    }
+    conversation_append(c, "assistant", m->response, decode_tokens);
+    if (m->reply_rewritten) {
+        drop_kv_state(slot);
+        m->last_stats.kv_cache_bytes = kv_cache_usage(m);
+        return BERDCORE_SUCCESS;
+    }
+    s->kv_count = c->entries.size();
+    s->kv_window_version = s->window_version;
+    
+    // Replies carry no template tokens, so they calibrate token estimates
+    if (decode_tokens >= 16) {
+        m->bytes_per_token = 0.8f * m->bytes_per_token + 0.2f * ((float)m->response.size() / decode_tokens);
+    }
+    
+    slot->kv_messages.clear();
+    slot->kv_owner = s->id;
+    slot->kv_resident = true;
+    slot->kv_tokens = reused_tokens + prefill_tokens + decode_tokens;
+    slot->last_used = ++m->kv_clock;
+    enforce_kv_budget(m, slot);
+    m->last_stats.kv_cache_bytes = kv_cache_usage(m);
+    
+    return BERDCORE_SUCCESS;
+}
+
+berdcore_error_t berdcore_session_append_and_generate(
+    berdcore_session_t session,
+    const char* role,
+    const char* content,
+    const berdcore_inference_options_t* options,
+    berdcore_token_callback_t token_callback,
+    void* user_data
+) {
+    if (!session || !role || !content) {
+        set_error("Invalid parameters for session generate");
+        return BERDCORE_ERROR_INVALID_PARAM;
+    }
+    
+    BerdCoreTokenSink sink{token_callback, nullptr, user_data};
+    return session_generate(static_cast<BerdCoreSession*>(session), role, content,
+                            options, nullptr, sink);
+}
+
+berdcore_error_t berdcore_session_append_and_generate_batched(
+    berdcore_session_t session,
+    const char* role,
+    const char* content,
+    const berdcore_inference_options_t* options,
+    const berdcore_streaming_options_t* streaming,
+    berdcore_token_batch_callback_t batch_callback,
+    void* user_data
+) {
+    if (!session || !role || !content || !batch_callback) {
+        set_error("Invalid parameters for session generate");
+        return BERDCORE_ERROR_INVALID_PARAM;
+    }
+    
+    BerdCoreTokenSink sink{nullptr, batch_callback, user_data};
+    return session_generate(static_cast<BerdCoreSession*>(session), role, content,
+                            options, streaming, sink);
+}
+
+void berdcore_session_free(berdcore_session_t session) {
+    if (!session) return;
+    auto s = static_cast<BerdCoreSession*>(session);
+    
+    // Release the session's KV slot so it can be reused right away
+    {
+        std::lock_guard<std::mutex> lock(s->model->inference_mutex);
+        for (const auto& slot : s->model->kv_slots) {
+            if (slot->kv_owner == s->id) drop_kv_state(slot.get());
+        }
+    }
+    delete s;
 }
 
 // ============================================================================
-// CONVERSATION MANAGEMENT
+// LOCAL RETRIEVAL
 // ============================================================================
 
-berdcore_conversation_t berdcore_conversation_create(const char* title) {
-    return new BerdCoreConversation(title);
+// Longest embedding berdcore_embed accepts from the engine
+static const size_t BERDCORE_MAX_EMBEDDING_DIM = 8192;
+
+// Context size of the embedding context; passages are far shorter
+static const int BERDCORE_EMBED_CONTEXT = 1024;
+
+struct BerdCoreIndex {
+    BerdCoreModel* model;
+    std::mutex mutex;
+    BerdCoreVectorIndex vectors;
+    std::vector<uint64_t> seen;  // hashes of indexed (ref, text) pairs, sorted
+    
+    explicit BerdCoreIndex(BerdCoreModel* m) : model(m) {}
+};
+
+// Helper: Embed text with the model's embedding context
+static berdcore_error_t embed_text(BerdCoreModel* m, const char* text, std::vector<float>* embedding) {
+    if (!m->is_ready) {
+        set_error("Model not ready");
+        return BERDCORE_ERROR_NOT_INITIALIZED;
+    }
+    
+    std::unique_lock<std::mutex> lock = lock_inference(m);
+    if (!rehydrate_for_use_locked(m)) {
+        return BERDCORE_ERROR_MODEL_LOAD_FAILED;
+    }
+    if (!m->embed_context) {
+        m->embed_context = cactus_init(m->model_path.c_str(), std::min(m->context_size, BERDCORE_EMBED_CONTEXT));
+        if (!m->embed_context) {
+            set_error("Failed to create embedding context");
+            return BERDCORE_ERROR_MODEL_LOAD_FAILED;
+        }
+    }
+    
+    BERDCORE_TRACE_SCOPE("embed");
+    const berdcore_thread_config_t& tc = m->thread_config;
+    BerdCoreThreadPlacement placement;
+    placement.apply(tc.qos, tc.prefill_cores, tc.prefill_threads > 0 ? tc.prefill_threads : tc.num_threads);
+    embedding->resize(BERDCORE_MAX_EMBEDDING_DIM);
+    size_t dim = 0;
+    int rc = cactus_embed(m->embed_context, text, embedding->data(),
+                          embedding->size() * sizeof(float), &dim);
+    if (rc < 0 || dim == 0 || dim > embedding->size()) {
+        set_error("Embedding failed");
+        return BERDCORE_ERROR_INFERENCE_FAILED;
+    }
+    embedding->resize(dim);
+    return BERDCORE_SUCCESS;
 }
 
-berdcore_error_t berdcore_conversation_add_message(
+// Helper: 64-bit FNV-1a over ref and text, to skip passages already indexed
+static uint64_t index_item_hash(std::string_view ref, std::string_view text) {
+    uint64_t h = 1469598103934665603ull;
+    for (std::string_view part : {ref, std::string_view("\0", 1), text}) {
+        for (unsigned char c : part) {
+            h ^= c;
+            h *= 1099511628211ull;
+        }
+    }
+    return h;
+}
+
+// Helper: Embed and add one passage unless it is already in the index
+static berdcore_error_t index_add_passage(BerdCoreIndex* index, std::string_view title,
+                                          std::string_view ref, std::string_view text) {
+    uint64_t hash = index_item_hash(ref, text);
+    {
+        std::lock_guard<std::mutex> lock(index->mutex);
+        if (std::binary_search(index->seen.begin(), index->seen.end(), hash)) {
+            return BERDCORE_SUCCESS;
+        }
+    }
+    
+    std::vector<float> embedding;
+    berdcore_error_t err = embed_text(index->model, std::string(text).c_str(), &embedding);
+    if (err != BERDCORE_SUCCESS) {
+        return err;
+    }
+    
+    std::lock_guard<std::mutex> lock(index->mutex);
+    BerdCoreIndexItem item;
+    item.title.assign(title.data(), title.size());
+    item.ref.assign(ref.data(), ref.size());
+    item.text.assign(text.data(), text.size());
+    if (!index->vectors.add(embedding.data(), embedding.size(), std::move(item))) {
+        set_error("Embedding dimension does not match the index");
+        return BERDCORE_ERROR_INVALID_PARAM;
+    }
+    index->seen.insert(std::upper_bound(index->seen.begin(), index->seen.end(), hash), hash);
+    return BERDCORE_SUCCESS;
+}
+
+// Helper: Split text into passages and index each
+static berdcore_error_t index_add(BerdCoreIndex* index, std::string_view title,
+                                  std::string_view ref, std::string_view text) {
+    std::vector<PromptPassage> passages;
+    prompt_split_passages(0, text, &passages);
+    for (const auto& passage : passages) {
+        berdcore_error_t err = index_add_passage(index, title, ref, passage.text);
+        if (err != BERDCORE_SUCCESS) {
+            return err;
+        }
+    }
+    return BERDCORE_SUCCESS;
+}
+
+berdcore_error_t berdcore_embed(
+    berdcore_model_t model,
+    const char* text,
+    float* embedding,
+    size_t max_dim,
+    size_t* dim
+) {
+    if (!model || !text || !embedding || !dim) {
+        set_error("Invalid embedding parameters");
+        return BERDCORE_ERROR_INVALID_PARAM;
+    }
+    
+    std::vector<float> result;
+    berdcore_error_t err = embed_text(static_cast<BerdCoreModel*>(model), text, &result);
+    if (err != BERDCORE_SUCCESS) {
+        return err;
+    }
+    *dim = result.size();
+    if (result.size() > max_dim) {
+        set_error("Embedding buffer too small");
+        return BERDCORE_ERROR_INVALID_PARAM;
+    }
+    memcpy(embedding, result.data(), result.size() * sizeof(float));
+    return BERDCORE_SUCCESS;
+}
+
+berdcore_index_t berdcore_index_create(berdcore_model_t model) {
+    if (!model) {
+        set_error("Invalid model for index");
+        return nullptr;
+    }
+    return new BerdCoreIndex(static_cast<BerdCoreModel*>(model));
+}
+
+berdcore_index_t berdcore_index_load(berdcore_model_t model, const char* path) {
+    if (!model || !path) {
+        set_error("Invalid index load parameters");
+        return nullptr;
+    }
+    
+    auto index = new BerdCoreIndex(static_cast<BerdCoreModel*>(model));
+    if (!index->vectors.load(path)) {
+        set_error("Failed to load index: " + std::string(path));
+        delete index;
+        return nullptr;
+    }
+    for (size_t id = 0; id < index->vectors.size(); id++) {
+        const BerdCoreIndexItem& item = index->vectors.item(id);
+        index->seen.push_back(index_item_hash(item.ref, item.text));
+    }
+    std::sort(index->seen.begin(), index->seen.end());
+    return index;
+}
+
+berdcore_error_t berdcore_index_save(berdcore_index_t index, const char* path) {
+    if (!index || !path) {
+        set_error("Invalid index save parameters");
+        return BERDCORE_ERROR_INVALID_PARAM;
+    }
+    
+    auto idx = static_cast<BerdCoreIndex*>(index);
+    std::lock_guard<std::mutex> lock(idx->mutex);
+    if (!idx->vectors.save(path)) {
+        set_error("Failed to save index: " + std::string(path));
+        return BERDCORE_ERROR_INVALID_PARAM;
+    }
+    return BERDCORE_SUCCESS;
+}
+
+berdcore_error_t berdcore_index_add_text(
+    berdcore_index_t index,
+    const char* title,
+    const char* ref,
+    const char* text
+) {
+    if (!index || !text) {
+        set_error("Invalid index parameters");
+        return BERDCORE_ERROR_INVALID_PARAM;
+    }
+    return index_add(static_cast<BerdCoreIndex*>(index), title ? title : "", ref ? ref : "", text);
+}
+
+berdcore_error_t berdcore_index_add_conversation(
+    berdcore_index_t index,
     berdcore_conversation_t conv,
-    const char* role,
-    const char* content
+    size_t first_message
 ) {
-    if (!conv || !role || !content) {
+    if (!index || !conv) {
+        set_error("Invalid index parameters");
         return BERDCORE_ERROR_INVALID_PARAM;
     }
     
+    auto idx = static_cast<BerdCoreIndex*>(index);
     auto c = static_cast<BerdCoreConversation*>(conv);
-    c->messages.emplace_back(role, content);
+    for (size_t i = first_message; i < c->entries.size(); i++) {
+        std::string_view role = conversation_role(c, i);
+        if (role != "user" && role != "assistant") continue;
+        
+        std::string ref = "conversation:" + c->title + "#" + std::to_string(i);
+        berdcore_error_t err = index_add(idx, c->title, ref, conversation_content(c, i));
+        if (err != BERDCORE_SUCCESS) {
+            return err;
+        }
+    }
     return BERDCORE_SUCCESS;
 }
 
-char* berdcore_conversation_to_json(berdcore_conversation_t conv) {
-    if (!conv) return nullptr;
+size_t berdcore_index_size(berdcore_index_t index) {
+    if (!index) return 0;
+    auto idx = static_cast<BerdCoreIndex*>(index);
+    std::lock_guard<std::mutex> lock(idx->mutex);
+    return idx->vectors.size();
+}
+
+berdcore_error_t berdcore_index_search(
+    berdcore_index_t index,
+    const char* query,
+    int max_results,
+    berdcore_search_result_t** results,
+    float* scores,
+    int* num_results
+) {
+    if (!index || !query || max_results <= 0 || !results || !num_results) {
+        set_error("Invalid index search parameters");
+        return BERDCORE_ERROR_INVALID_PARAM;
+    }
+    *results = nullptr;
+    *num_results = 0;
     
-    auto c = static_cast<BerdCoreConversation*>(conv);
-    Json::Value messages(Json::arrayValue);
+    auto idx = static_cast<BerdCoreIndex*>(index);
+    std::vector<float> embedding;
+    berdcore_error_t err = embed_text(idx->model, query, &embedding);
+    if (err != BERDCORE_SUCCESS) {
+        return err;
+    }
     
-    for (const auto& msg : c->messages) {
-        Json::Value message;
-        message["role"] = msg.first;
-        message["content"] = msg.second;
-        messages.append(message);
+    std::lock_guard<std::mutex> lock(idx->mutex);
+    std::vector<std::pair<float, size_t>> hits;
+    {
+        BERDCORE_TRACE_SCOPE("index_search");
+        idx->vectors.search(embedding.data(), embedding.size(), (size_t)max_results, &hits);
     }
     
-    Json::StreamWriterBuilder writer;
-    std::string json_str = Json::writeString(writer, messages);
-    return strdup(json_str.c_str());
+    *num_results = (int)hits.size();
+    *results = new berdcore_search_result_t[hits.size() > 0 ? hits.size() : 1];
+    for (size_t i = 0; i < hits.size(); i++) {
+        const BerdCoreIndexItem& item = idx->vectors.item(hits[i].second);
+        (*results)[i].title = strdup(item.title.c_str());
+        (*results)[i].url = strdup(item.ref.c_str());
+        (*results)[i].snippet = strdup(item.text.c_str());
+        if (scores) scores[i] = hits[i].first;
+    }
+    return BERDCORE_SUCCESS;
 }
 
-void berdcore_conversation_free(berdcore_conversation_t conv) {
-    if (!conv) return;
-    delete static_cast<BerdCoreConversation*>(conv);
+void berdcore_index_free(berdcore_index_t index) {
+    delete static_cast<BerdCoreIndex*>(index);
 }
 
 // ============================================================================
@@ -469,3 +4182,15 @@ const char* berdcore_get_last_error(void) {
 void berdcore_set_log_level(int level) {
     g_log_level = level;
 }
+
+void berdcore_set_device_state(berdcore_thermal_state_t thermal_state, int low_power_mode) {
+    int level = std::max(0, std::min((int)thermal_state, (int)BERDCORE_THERMAL_CRITICAL));
+    g_thermal_state = level;
+    g_low_power_mode = low_power_mode != 0;
+}
+
+void berdcore_get_cpu_topology(int* performance_cores, int* efficiency_cores) {
+    const BerdCoreCpuTopology& topo = cpu_topology();
+    if (performance_cores) *performance_cores = topo.performance_cores;
+    if (efficiency_cores) *efficiency_cores = topo.efficiency_cores;
+}
@@ -0,0 +1,317 @@
+#include "berdcore_cache.h"
+#include <atomic>
+#include <cctype>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Cache files: a fixed header, then key, etag, last_modified and body. The
+// body hash catches torn or corrupted files; the stored key catches the
+// (unlikely) case of two keys hashing to the same file name.
+static const char CACHE_FILE_MAGIC[8] = {'B', 'E', 'R', 'D', 'C', 'A', 'C', 'H'};
+static const uint32_t CACHE_FILE_VERSION = 1;
+static const char CACHE_FILE_SUFFIX[] = ".cache";
+
+struct CacheFileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t key_length;
+    int64_t stored_at;
+    int64_t expires_at;
+    uint64_t source_limit;
+    uint32_t etag_length;
+    uint32_t last_modified_length;
+    uint64_t body_length;
+    uint64_t body_hash;
+};
+
+// Bookkeeping charged per memory entry on top of its strings
+static const size_t CACHE_ENTRY_OVERHEAD = 128;
+
+typedef std::list<std::pair<std::string, BerdCoreCacheEntry>> CacheLru;
+
+struct CacheState {
+    std::mutex mutex;
+    BerdCoreCacheConfig config;
+    CacheLru lru;  // most recently used first
+    std::unordered_map<std::string, CacheLru::iterator> index;
+    size_t bytes;
+
+    CacheState() : bytes(0) {
+        config.memory_budget_bytes = 16 * 1024 * 1024;
+        config.search_ttl_seconds = 10 * 60;
+        config.page_ttl_seconds = 60 * 60;
+    }
+};
+
+static CacheState& cache_state() {
+    static CacheState* state = new CacheState();
+    return *state;
+}
+
+// Helper: 64-bit FNV-1a
+static uint64_t cache_hash(const char* data, size_t length) {
+    uint64_t h = 1469598103934665603ull;
+    for (size_t i = 0; i < length; i++) {
+        h ^= (unsigned char)data[i];
+        h *= 1099511628211ull;
+    }
+    return h;
+}
+
+// Helper: Bytes an entry is charged against the memory budget
+static size_t cache_entry_bytes(const std::string& key, const BerdCoreCacheEntry& entry) {
+    return key.size() + entry.body.size() + entry.etag.size() + entry.last_modified.size() +
+           CACHE_ENTRY_OVERHEAD;
+}
+
+// Helper: Evict least recently used entries until the budget holds
+static void cache_evict_locked(CacheState& state) {
+    while (state.bytes > state.config.memory_budget_bytes && !state.lru.empty()) {
+        auto& last = state.lru.back();
+        state.bytes -= cache_entry_bytes(last.first, last.second);
+        state.index.erase(last.first);
+        state.lru.pop_back();
+    }
+}
+
+// Helper: Insert or replace key in memory
+static void cache_insert_locked(CacheState& state, const std::string& key, const BerdCoreCacheEntry& entry) {
+    auto it = state.index.find(key);
+    if (it != state.index.end()) {
+        state.bytes -= cache_entry_bytes(key, it->second->second);
+        state.lru.erase(it->second);
+        state.index.erase(it);
+    }
+    if (cache_entry_bytes(key, entry) > state.config.memory_budget_bytes) return;
+
+    state.lru.emplace_front(key, entry);
+    state.index[key] = state.lru.begin();
+    state.bytes += cache_entry_bytes(key, entry);
+    cache_evict_locked(state);
+}
+
+// Helper: File holding key in directory
+static std::string cache_file_path(const std::string& directory, const std::string& key) {
+    char name[32];
+    snprintf(name, sizeof(name), "%016llx", (unsigned long long)cache_hash(key.data(), key.size()));
+    return directory + "/" + name + CACHE_FILE_SUFFIX;
+}
+
+// Helper: read() exactly length bytes
+static bool cache_read_all(int fd, char* data, size_t length) {
+    while (length > 0) {
+        ssize_t n = read(fd, data, length);
+        if (n <= 0) return false;
+        data += n;
+        length -= (size_t)n;
+    }
+    return true;
+}
+
+// Helper: Load key from its cache file
+static bool cache_read_file(const std::string& directory, const std::string& key, BerdCoreCacheEntry* entry) {
+    int fd = open(cache_file_path(directory, key).c_str(), O_RDONLY);
+    if (fd < 0) return false;
+
+    CacheFileHeader header;
+    bool ok = cache_read_all(fd, reinterpret_cast<char*>(&header), sizeof(header)) &&
+              memcmp(header.magic, CACHE_FILE_MAGIC, sizeof(CACHE_FILE_MAGIC)) == 0 &&
+              header.version == CACHE_FILE_VERSION &&
+              header.key_length == key.size();
+
+    std::string stored_key;
+    if (ok) {
+        stored_key.resize(header.key_length);
+        entry->etag.resize(header.etag_length);
+        entry->last_modified.resize(header.last_modified_length);
+        entry->body.resize(header.body_length);
+        ok = cache_read_all(fd, &stored_key[0], stored_key.size()) &&
+             stored_key == key &&
+             cache_read_all(fd, &entry->etag[0], entry->etag.size()) &&
+             cache_read_all(fd, &entry->last_modified[0], entry->last_modified.size()) &&
+             cache_read_all(fd, &entry->body[0], entry->body.size()) &&
+             cache_hash(entry->body.data(), entry->body.size()) == header.body_hash;
+    }
+    close(fd);
+    if (!ok) return false;
+
+    entry->stored_at = header.stored_at;
+    entry->expires_at = header.expires_at;
+    entry->source_limit = header.source_limit;
+    return true;
+}
+
+// Helper: Write key's cache file, replacing any previous one atomically
+static void cache_write_file(const std::string& directory, const std::string& key,
+                             const BerdCoreCacheEntry& entry) {
+    static std::atomic<uint32_t> counter(0);
+
+    CacheFileHeader header;
+    memcpy(header.magic, CACHE_FILE_MAGIC, sizeof(CACHE_FILE_MAGIC));
+    header.version = CACHE_FILE_VERSION;
+    header.key_length = (uint32_t)key.size();
+    header.stored_at = entry.stored_at;
+    header.expires_at = entry.expires_at;
+    header.source_limit = entry.source_limit;
+    header.etag_length = (uint32_t)entry.etag.size();
+    header.last_modified_length = (uint32_t)entry.last_modified.size();
+    header.body_length = entry.body.size();
+    header.body_hash = cache_hash(entry.body.data(), entry.body.size());
+
+    std::string data(reinterpret_cast<const char*>(&header), sizeof(header));
+    data += key;
+    data += entry.etag;
+    data += entry.last_modified;
+    data += entry.body;
+
+    std::string path = cache_file_path(directory, key);
+    std::string tmp = path + ".tmp" + std::to_string(getpid()) + "-" + std::to_string(counter++);
+    int fd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) return;
+
+    const char* p = data.data();
+    size_t left = data.size();
+    while (left > 0) {
+        ssize_t n = write(fd, p, left);
+        if (n <= 0) break;
+        p += n;
+        left -= (size_t)n;
+    }
+    close(fd);
+    if (left != 0 || rename(tmp.c_str(), path.c_str()) != 0) {
+        unlink(tmp.c_str());
+    }
+}
+
+void cache_configure(const BerdCoreCacheConfig& config) {
+    CacheState& state = cache_state();
+    std::lock_guard<std::mutex> lock(state.mutex);
+    state.config = config;
+    cache_evict_locked(state);
+}
+
+BerdCoreCacheConfig cache_config() {
+    CacheState& state = cache_state();
+    std::lock_guard<std::mutex> lock(state.mutex);
+    return state.config;
+}
+
+void cache_clear(bool include_disk) {
+    CacheState& state = cache_state();
+    std::string directory;
+    {
+        std::lock_guard<std::mutex> lock(state.mutex);
+        state.lru.clear();
+        state.index.clear();
+        state.bytes = 0;
+        directory = state.config.directory;
+    }
+    if (!include_disk || directory.empty()) return;
+
+    DIR* dir = opendir(directory.c_str());
+    if (!dir) return;
+    size_t suffix_length = strlen(CACHE_FILE_SUFFIX);
+    while (struct dirent* ent = readdir(dir)) {
+        size_t length = strlen(ent->d_name);
+        if (length > suffix_length &&
+            strcmp(ent->d_name + length - suffix_length, CACHE_FILE_SUFFIX) == 0) {
+            unlink((directory + "/" + ent->d_name).c_str());
+        }
+    }
+    closedir(dir);
+}
+
+std::string cache_search_key(const char* query, int max_results) {
+    std::string key = "search:" + std::to_string(max_results) + ":";
+    bool space = false;
+    for (const char* p = query; *p; p++) {
+        unsigned char c = (unsigned char)*p;
+        if (isspace(c)) {
+            space = true;
+            continue;
+        }
+        if (space && key.back() != ':') key.push_back(' ');
+        space = false;
+        key.push_back((char)tolower(c));
+    }
+    return key;
+}
+
+std::string cache_url_key(const char* url) {
+    while (isspace((unsigned char)*url)) url++;
+    std::string u(url);
+    while (!u.empty() && isspace((unsigned char)u.back())) u.pop_back();
+
+    size_t hash = u.find('#');
+    if (hash != std::string::npos) u.resize(hash);
+
+    // Scheme and host are case-insensitive; the path is not
+    size_t scheme_end = u.find("://");
+    size_t host_start = scheme_end == std::string::npos ? 0 : scheme_end + 3;
+    size_t host_end = u.find_first_of("/?", host_start);
+    if (host_end == std::string::npos) host_end = u.size();
+    for (size_t i = 0; i < host_end; i++) {
+        u[i] = (char)tolower((unsigned char)u[i]);
+    }
+
+    std::string scheme = scheme_end == std::string::npos ? "" : u.substr(0, scheme_end);
+    const char* default_port = scheme == "https" ? ":443" : scheme == "http" ? ":80" : nullptr;
+    if (default_port) {
+        size_t port_length = strlen(default_port);
+        if (host_end - host_start > port_length &&
+            u.compare(host_end - port_length, port_length, default_port) == 0) {
+            u.erase(host_end - port_length, port_length);
+            host_end -= port_length;
+        }
+    }
+    if (host_end == u.size()) u.push_back('/');
+
+    return "page:" + u;
+}
+
+bool cache_lookup(const std::string& key, BerdCoreCacheEntry* entry) {
+    CacheState& state = cache_state();
+    std::string directory;
+    {
+        std::lock_guard<std::mutex> lock(state.mutex);
+        auto it = state.index.find(key);
+        if (it != state.index.end()) {
+            state.lru.splice(state.lru.begin(), state.lru, it->second);
+            *entry = it->second->second;
+            return true;
+        }
+        directory = state.config.directory;
+    }
+    if (directory.empty()) return false;
+
+    // Disk hits are promoted so the next lookup stays in memory
+    if (!cache_read_file(directory, key, entry)) return false;
+    std::lock_guard<std::mutex> lock(state.mutex);
+    cache_insert_locked(state, key, *entry);
+    return true;
+}
+
+void cache_store(const std::string& key, const BerdCoreCacheEntry& entry) {
+    CacheState& state = cache_state();
+    std::string directory;
+    {
+        std::lock_guard<std::mutex> lock(state.mutex);
+        cache_insert_locked(state, key, entry);
+        directory = state.config.directory;
+    }
+    if (!directory.empty()) {
+        cache_write_file(directory, key, entry);
+    }
+}
+
+int64_t cache_now() {
+    return (int64_t)time(nullptr);
+}
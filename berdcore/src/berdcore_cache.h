@@ -0,0 +1,84 @@
+#ifndef BERDCORE_CACHE_H
+#define BERDCORE_CACHE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// ============================================================================
+// SEARCH AND PAGE CACHE (internal)
+// ============================================================================
+// Results of searches and page fetches, keyed by the normalized query or
+// URL. Entries live in a byte-bounded LRU in memory and, when a directory is
+// configured, as one file per key on disk, so they survive restarts. Pages
+// are stored as extracted text, never raw HTML. Stale pages that carry an
+// ETag or Last-Modified are revalidated with a conditional request instead
+// of being fetched again.
+// ============================================================================
+
+struct BerdCoreCacheEntry {
+    std::string body;             // extracted text, or encoded search results
+    std::string etag;
+    std::string last_modified;
+    int64_t stored_at;            // seconds since the epoch
+    int64_t expires_at;
+    uint64_t source_limit;        // byte cap the body was fetched under (0 = complete)
+
+    BerdCoreCacheEntry() : stored_at(0), expires_at(0), source_limit(0) {}
+
+    bool fresh(int64_t now) const { return now < expires_at; }
+
+    // Whether the body holds at least what a fetch capped at limit would
+    bool covers(uint64_t limit) const { return source_limit == 0 || limit <= source_limit; }
+};
+
+// Cache configuration (the defaults apply until cache_configure is called)
+struct BerdCoreCacheConfig {
+    std::string directory;        // empty = memory only
+    size_t memory_budget_bytes;
+    int search_ttl_seconds;       // < 0 disables caching of searches
+    int page_ttl_seconds;         // < 0 disables caching of pages
+};
+
+/**
+ * Replace the configuration; entries over the new memory budget are evicted
+ */
+void cache_configure(const BerdCoreCacheConfig& config);
+
+/**
+ * Current configuration
+ */
+BerdCoreCacheConfig cache_config();
+
+/**
+ * Drop every entry from memory, and the cache files too if include_disk
+ */
+void cache_clear(bool include_disk);
+
+/**
+ * Key for a search: whitespace collapsed, lowercased, with the result count
+ */
+std::string cache_search_key(const char* query, int max_results);
+
+/**
+ * Key for a page: scheme and host lowercased, default port and fragment dropped
+ */
+std::string cache_url_key(const char* url);
+
+/**
+ * Look up key in memory, then on disk. Stale entries are returned too;
+ * check entry->fresh() before using one without revalidating.
+ */
+bool cache_lookup(const std::string& key, BerdCoreCacheEntry* entry);
+
+/**
+ * Insert or replace the entry for key (written through to disk if configured)
+ */
+void cache_store(const std::string& key, const BerdCoreCacheEntry& entry);
+
+/**
+ * Seconds since the epoch
+ */
+int64_t cache_now();
+
+#endif // BERDCORE_CACHE_H
@@ -0,0 +1,322 @@
+#include "berdcore_html.h"
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <strings.h>
+
+// Elements whose content is never readable text
+static const char* const HTML_SKIPPED[] = {
+    "aside", "button", "footer", "form", "head", "iframe", "nav", "noscript",
+    "script", "select", "style", "svg", "template",
+};
+
+// Elements holding the main content of a page
+static const char* const HTML_MAIN[] = {"article", "main"};
+
+// Elements that end a line of text
+static const char* const HTML_BLOCKS[] = {
+    "address", "blockquote", "br", "dd", "div", "dl", "dt", "figcaption",
+    "h1", "h2", "h3", "h4", "h5", "h6", "header", "hr", "li", "ol", "p", "pre",
+    "section", "table", "td", "th", "title", "tr", "ul",
+};
+
+// Main content shorter than this is ignored in favour of the whole page
+static const size_t HTML_MIN_MAIN_TEXT = 200;
+
+// Longest entity we decode, '&' and ';' included
+static const size_t HTML_MAX_ENTITY = 12;
+
+// Helper: Whether name (length n) is in the list
+template <size_t N>
+static bool html_tag_in(const char* name, size_t n, const char* const (&list)[N]) {
+    for (const char* tag : list) {
+        if (strlen(tag) == n && strncasecmp(tag, name, n) == 0) return true;
+    }
+    return false;
+}
+
+// Helper: Whether c is HTML whitespace
+static bool html_space(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\f';
+}
+
+// Helper: Encode code point cp as UTF-8 into buf; returns the length
+static size_t html_utf8(unsigned long cp, char* buf) {
+    if (cp == 0 || cp > 0x10FFFF || (cp >= 0xD800 && cp <= 0xDFFF)) cp = 0xFFFD;
+    if (cp < 0x80) {
+        buf[0] = (char)cp;
+        return 1;
+    }
+    if (cp < 0x800) {
+        buf[0] = (char)(0xC0 | (cp >> 6));
+        buf[1] = (char)(0x80 | (cp & 0x3F));
+        return 2;
+    }
+    if (cp < 0x10000) {
+        buf[0] = (char)(0xE0 | (cp >> 12));
+        buf[1] = (char)(0x80 | ((cp >> 6) & 0x3F));
+        buf[2] = (char)(0x80 | (cp & 0x3F));
+        return 3;
+    }
+    buf[0] = (char)(0xF0 | (cp >> 18));
+    buf[1] = (char)(0x80 | ((cp >> 12) & 0x3F));
+    buf[2] = (char)(0x80 | ((cp >> 6) & 0x3F));
+    buf[3] = (char)(0x80 | (cp & 0x3F));
+    return 4;
+}
+
+// Helper: Drop a UTF-8 sequence left incomplete at the end of text, as when
+// the budget runs out inside a character that was split between chunks
+static void html_trim_partial_utf8(std::string* text) {
+    size_t i = text->size();
+    size_t back = 0;
+    while (i > 0 && back < 4 && ((unsigned char)(*text)[i - 1] & 0xC0) == 0x80) {
+        i--;
+        back++;
+    }
+    if (i == 0) return;
+    unsigned char lead = (unsigned char)(*text)[i - 1];
+    size_t need = lead >= 0xF0 ? 4 : lead >= 0xE0 ? 3 : lead >= 0xC0 ? 2 : 1;
+    if (back + 1 < need) text->resize(i - 1);
+}
+
+BerdCoreHtmlExtractor::BerdCoreHtmlExtractor(size_t budget)
+    : budget_(budget > 0 ? budget : SIZE_MAX), main_depth_(0), main_seen_(false),
+      in_comment_(false), full_(false) {}
+
+void BerdCoreHtmlExtractor::put(const char* s, size_t n) {
+    auto emit = [&](Output& out) {
+        if (out.capped) return;
+        if (!out.text.empty() && out.pending) {
+            if (out.text.size() >= budget_) {
+                html_trim_partial_utf8(&out.text);
+                out.capped = true;
+                return;
+            }
+            out.text.push_back(out.pending == 2 ? '\n' : ' ');
+        }
+        out.pending = 0;
+
+        size_t room = budget_ - std::min(budget_, out.text.size());
+        if (n <= room) {
+            out.text.append(s, n);
+            return;
+        }
+        // Cut before the character that would cross the budget
+        size_t cut = room;
+        while (cut > 0 && ((unsigned char)s[cut] & 0xC0) == 0x80) cut--;
+        out.text.append(s, cut);
+        html_trim_partial_utf8(&out.text);
+        out.capped = true;
+    };
+    emit(all_);
+    if (main_depth_ > 0) emit(main_);
+    full_ = main_seen_ ? main_.capped : all_.capped;
+}
+
+void BerdCoreHtmlExtractor::space() {
+    if (all_.pending < 1) all_.pending = 1;
+    if (main_depth_ > 0 && main_.pending < 1) main_.pending = 1;
+}
+
+void BerdCoreHtmlExtractor::line() {
+    all_.pending = 2;
+    if (main_depth_ > 0) main_.pending = 2;
+}
+
+size_t BerdCoreHtmlExtractor::tag(const char* s, size_t n, size_t i, bool final) {
+    if (n - i < 4) {
+        if (!final) return 0;
+    } else if (strncmp(s + i, "<!--", 4) == 0) {
+        in_comment_ = true;
+        return i + 4;
+    }
+
+    const char* close = static_cast<const char*>(memchr(s + i, '>', n - i));
+    if (!close) return final ? n : 0;
+    size_t tag_end = (size_t)(close - s) + 1;
+
+    bool closing = s[i + 1] == '/';
+    size_t name_start = i + (closing ? 2 : 1);
+    size_t name_end = name_start;
+    while (name_end < tag_end && isalnum((unsigned char)s[name_end])) name_end++;
+    const char* name = s + name_start;
+    size_t name_len = name_end - name_start;
+    bool self_closing = tag_end >= 2 && s[tag_end - 2] == '/';
+
+    // Page headers are chrome; an article's own header is content
+    bool skipped = html_tag_in(name, name_len, HTML_SKIPPED) ||
+                   (main_depth_ == 0 && name_len == 6 && strncasecmp(name, "header", 6) == 0);
+    if (!closing && !self_closing && skipped) {
+        skip_until_.assign(name, name_len);
+        line();
+        return tag_end;
+    }
+
+    if (html_tag_in(name, name_len, HTML_MAIN)) {
+        line();
+        if (closing) {
+            if (main_depth_ > 0) main_depth_--;
+        } else if (!self_closing) {
+            main_depth_++;
+            main_seen_ = true;
+        }
+    } else if (html_tag_in(name, name_len, HTML_BLOCKS)) {
+        line();
+    }
+    return tag_end;
+}
+
+size_t BerdCoreHtmlExtractor::entity(const char* s, size_t n, size_t i, bool final) {
+    size_t end = i + 1;
+    while (end < n && end - i < HTML_MAX_ENTITY && s[end] != ';') end++;
+    if (end >= n && !final && n - i < HTML_MAX_ENTITY) return 0;
+    if (end >= n || s[end] != ';') {
+        put("&", 1);
+        return i + 1;
+    }
+
+    const char* name = s + i + 1;
+    size_t len = end - i - 1;
+    unsigned long cp = 0;
+    if (len > 1 && name[0] == '#') {
+        bool hex = name[1] == 'x' || name[1] == 'X';
+        size_t digits = hex ? 2 : 1;
+        char number[HTML_MAX_ENTITY];
+        memcpy(number, name + digits, len - digits);
+        number[len - digits] = '\0';
+        cp = strtoul(number, nullptr, hex ? 16 : 10);
+    } else {
+        static const struct { const char* name; unsigned long cp; } named[] = {
+            {"amp", '&'}, {"lt", '<'}, {"gt", '>'}, {"quot", '"'}, {"apos", '\''},
+            {"nbsp", 0xA0}, {"copy", 0xA9}, {"reg", 0xAE}, {"deg", 0xB0}, {"middot", 0xB7},
+            {"agrave", 0xE0}, {"aacute", 0xE1}, {"auml", 0xE4}, {"ccedil", 0xE7},
+            {"egrave", 0xE8}, {"eacute", 0xE9}, {"iacute", 0xED}, {"ntilde", 0xF1},
+            {"oacute", 0xF3}, {"ouml", 0xF6}, {"uacute", 0xFA}, {"uuml", 0xFC},
+            {"ndash", 0x2013}, {"mdash", 0x2014}, {"lsquo", 0x2018}, {"rsquo", 0x2019},
+            {"ldquo", 0x201C}, {"rdquo", 0x201D}, {"bull", 0x2022}, {"hellip", 0x2026},
+        };
+        for (const auto& e : named) {
+            if (strlen(e.name) == len && strncmp(e.name, name, len) == 0) {
+                cp = e.cp;
+                break;
+            }
+        }
+        if (cp == 0) {
+            put("&", 1);
+            return i + 1;
+        }
+    }
+
+    if (cp == 0xA0) {
+        space();
+    } else {
+        char buf[4];
+        put(buf, html_utf8(cp, buf));
+    }
+    return end + 1;
+}
+
+size_t BerdCoreHtmlExtractor::process(const char* s, size_t n, bool final) {
+    size_t i = 0;
+    while (i < n && !full_) {
+        if (in_comment_) {
+            size_t j = i;
+            while (j + 3 <= n && strncmp(s + j, "-->", 3) != 0) j++;
+            if (j + 3 > n) {
+                // Keep a possible partial "--" for the next chunk
+                return final ? n : std::max(i, n - std::min(n, (size_t)2));
+            }
+            in_comment_ = false;
+            i = j + 3;
+            continue;
+        }
+
+        if (!skip_until_.empty()) {
+            size_t len = skip_until_.size();
+            size_t j = i;
+            for (; j + len + 2 <= n; j++) {
+                if (s[j] == '<' && s[j + 1] == '/' && strncasecmp(s + j + 2, skip_until_.c_str(), len) == 0) break;
+            }
+            if (j + len + 2 > n) {
+                // A close tag may start within the last len + 1 bytes
+                return final ? n : std::max(i, n - std::min(n, len + 1));
+            }
+            skip_until_.clear();
+            i = j;
+            continue;
+        }
+
+        char c = s[i];
+        if (c == '<') {
+            if (i + 1 >= n && !final) return i;
+            char next = i + 1 < n ? s[i + 1] : '\0';
+            // A '<' that cannot open a tag is plain text
+            if (isalpha((unsigned char)next) || next == '/' || next == '!' || next == '?') {
+                size_t used = tag(s, n, i, final);
+                if (used == 0) return i;
+                i = used;
+                continue;
+            }
+        }
+
+        if (c == '&') {
+            size_t used = entity(s, n, i, final);
+            if (used == 0) return i;
+            i = used;
+            continue;
+        }
+
+        if (html_space(c)) {
+            space();
+            i++;
+            continue;
+        }
+
+        // Copy the run of plain text up to the next markup or whitespace
+        size_t run = i + 1;
+        while (run < n && s[run] != '<' && s[run] != '&' && !html_space(s[run])) run++;
+        put(s + i, run - i);
+        i = run;
+    }
+    return n;
+}
+
+bool BerdCoreHtmlExtractor::feed(const char* data, size_t length) {
+    if (full_) return false;
+
+    if (carry_.empty()) {
+        size_t used = process(data, length, false);
+        carry_.assign(data + used, length - used);
+    } else {
+        carry_.append(data, length);
+        size_t used = process(carry_.data(), carry_.size(), false);
+        carry_.erase(0, used);
+    }
+    if (full_) carry_.clear();
+    return !full_;
+}
+
+std::string BerdCoreHtmlExtractor::finish() {
+    if (!carry_.empty()) {
+        process(carry_.data(), carry_.size(), true);
+        carry_.clear();
+    }
+    if (main_.text.size() >= HTML_MIN_MAIN_TEXT) {
+        return std::move(main_.text);
+    }
+    return std::move(all_.text);
+}
+
+bool html_is_markup(const char* content_type, const char* body, size_t length) {
+    if (content_type && *content_type) {
+        return strcasestr(content_type, "html") != nullptr || strcasestr(content_type, "xml") != nullptr;
+    }
+
+    // No type given: sniff for a leading tag
+    size_t i = 0;
+    while (i < length && isspace((unsigned char)body[i])) i++;
+    return i < length && body[i] == '<';
+}
@@ -0,0 +1,69 @@
+#ifndef BERDCORE_HTML_H
+#define BERDCORE_HTML_H
+
+#include <cstddef>
+#include <string>
+
+// ============================================================================
+// HTML TO TEXT (internal)
+// ============================================================================
+// Reduces a page to the readable text a prompt needs while it downloads:
+// tags are dropped, script, style and navigation elements skipped, common
+// entities decoded and whitespace collapsed, with a line break wherever a
+// block element ends. Text inside <main> or <article> is collected apart
+// from the rest and preferred when the page has enough of it.
+// ============================================================================
+
+class BerdCoreHtmlExtractor {
+public:
+    // budget: bytes of text after which extraction stops (0 = no limit)
+    explicit BerdCoreHtmlExtractor(size_t budget = 0);
+
+    /**
+     * Feed the next chunk of the document. Constructs split across chunks
+     * are carried over. Returns false once the budget is full, after which
+     * the rest of the document is not needed.
+     */
+    bool feed(const char* data, size_t length);
+
+    /**
+     * Flush what is left and return the text (main content when present)
+     */
+    std::string finish();
+
+    // Whether feed() stopped because the budget was reached
+    bool full() const { return full_; }
+
+private:
+    struct Output {
+        std::string text;
+        int pending;  // 0 none, 1 space, 2 line break
+        bool capped;  // the budget is reached
+        Output() : pending(0), capped(false) {}
+    };
+
+    size_t process(const char* s, size_t n, bool final);
+    size_t tag(const char* s, size_t n, size_t i, bool final);
+    size_t entity(const char* s, size_t n, size_t i, bool final);
+    void put(const char* s, size_t n);
+    void space();
+    void line();
+
+    size_t budget_;
+    std::string carry_;        // unfinished tag, entity or close-tag prefix
+    Output all_;
+    Output main_;
+    int main_depth_;           // open <main>/<article> elements
+    bool main_seen_;
+    std::string skip_until_;   // element whose content is being skipped
+    bool in_comment_;
+    bool full_;
+};
+
+/**
+ * Whether a response with this Content-Type (may be NULL) and body should be
+ * treated as HTML
+ */
+bool html_is_markup(const char* content_type, const char* body, size_t length);
+
+#endif // BERDCORE_HTML_H
@@ -0,0 +1,99 @@
+#include "berdcore_http.h"
+#include <mutex>
+#include <vector>
+
+// Idle handles kept for reuse; more are created on demand
+static const size_t HTTP_POOL_MAX_IDLE = 8;
+
+struct HttpPool {
+    CURLSH* share;
+    std::mutex share_locks[CURL_LOCK_DATA_LAST];
+    std::mutex idle_mutex;
+    std::vector<CURL*> idle;
+
+    HttpPool() : share(nullptr) {}
+};
+
+static HttpPool* g_http_pool = nullptr;
+static std::once_flag g_http_once;
+
+static void http_share_lock(CURL*, curl_lock_data data, curl_lock_access, void* userp) {
+    static_cast<HttpPool*>(userp)->share_locks[data].lock();
+}
+
+static void http_share_unlock(CURL*, curl_lock_data data, void* userp) {
+    static_cast<HttpPool*>(userp)->share_locks[data].unlock();
+}
+
+// Helper: Create the pool on first use. It lives for the rest of the
+// process, as handles may be in use on any thread at exit.
+static HttpPool* http_pool() {
+    std::call_once(g_http_once, [] {
+        curl_global_init(CURL_GLOBAL_DEFAULT);
+
+        auto pool = new HttpPool();
+        pool->share = curl_share_init();
+        if (pool->share) {
+            curl_share_setopt(pool->share, CURLSHOPT_LOCKFUNC, http_share_lock);
+            curl_share_setopt(pool->share, CURLSHOPT_UNLOCKFUNC, http_share_unlock);
+            curl_share_setopt(pool->share, CURLSHOPT_USERDATA, pool);
+            curl_share_setopt(pool->share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+            curl_share_setopt(pool->share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+            curl_share_setopt(pool->share, CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT);
+        }
+        g_http_pool = pool;
+    });
+    return g_http_pool;
+}
+
+CURL* http_acquire() {
+    HttpPool* pool = http_pool();
+
+    CURL* curl = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(pool->idle_mutex);
+        if (!pool->idle.empty()) {
+            curl = pool->idle.back();
+            pool->idle.pop_back();
+        }
+    }
+    if (curl) {
+        curl_easy_reset(curl);
+    } else {
+        curl = curl_easy_init();
+        if (!curl) return nullptr;
+    }
+
+    if (pool->share) {
+        curl_easy_setopt(curl, CURLOPT_SHARE, pool->share);
+    }
+    curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
+    curl_easy_setopt(curl, CURLOPT_TCP_KEEPALIVE, 1L);
+    curl_easy_setopt(curl, CURLOPT_HTTP_VERSION, (long)CURL_HTTP_VERSION_2TLS);
+    curl_easy_setopt(curl, CURLOPT_PIPEWAIT, 1L);
+    curl_easy_setopt(curl, CURLOPT_ACCEPT_ENCODING, "");
+    return curl;
+}
+
+void http_release(CURL* curl) {
+    if (!curl) return;
+    HttpPool* pool = http_pool();
+
+    {
+        std::lock_guard<std::mutex> lock(pool->idle_mutex);
+        if (pool->idle.size() < HTTP_POOL_MAX_IDLE) {
+            pool->idle.push_back(curl);
+            return;
+        }
+    }
+    curl_easy_cleanup(curl);
+}
+
+CURLM* http_multi_create() {
+    http_pool();
+    CURLM* multi = curl_multi_init();
+    if (multi) {
+        curl_multi_setopt(multi, CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX);
+    }
+    return multi;
+}
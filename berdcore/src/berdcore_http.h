@@ -0,0 +1,25 @@
+#ifndef BERDCORE_HTTP_H
+#define BERDCORE_HTTP_H
+
+#include <curl/curl.h>
+
+// ============================================================================
+// HTTP CONNECTION POOL (internal)
+// ============================================================================
+// All requests go through easy handles attached to one process-wide CURLSH
+// that shares the DNS cache, TLS sessions and the connection cache, so a
+// repeated search reuses the warm connection to the API instead of paying
+// for DNS, TCP and TLS again. Handles are recycled with curl_easy_reset.
+// ============================================================================
+
+// Take a reset handle from the pool, configured for keep-alive and HTTP/2
+// and attached to the shared caches (NULL if curl cannot allocate one)
+CURL* http_acquire();
+
+// Return a handle to the pool (it must not be attached to a multi handle)
+void http_release(CURL* curl);
+
+// New multi handle that multiplexes over HTTP/2 where the server allows it
+CURLM* http_multi_create();
+
+#endif // BERDCORE_HTTP_H
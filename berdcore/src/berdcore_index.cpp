@@ -0,0 +1,418 @@
+#include "berdcore_index.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <queue>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#if defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+#if defined(__APPLE__)
+#include <sys/sysctl.h>
+#endif
+
+// Below this many vectors a flat scan is fast enough and exact
+static const size_t INDEX_IVF_MIN_VECTORS = 1024;
+
+// Training points per list, and Lloyd iterations
+static const size_t INDEX_TRAIN_POINTS_PER_LIST = 32;
+static const int INDEX_TRAIN_ITERATIONS = 8;
+
+// Index files: a header, the items, then codes, scales, centroids and the
+// list of every vector
+static const char INDEX_FILE_MAGIC[8] = {'B', 'E', 'R', 'D', 'V', 'I', 'D', 'X'};
+static const uint32_t INDEX_FILE_VERSION = 1;
+static const uint32_t INDEX_NO_LIST = UINT32_MAX;
+
+struct IndexFileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t dim;
+    uint64_t count;
+    uint64_t trained_size;
+    uint32_t list_count;
+    uint32_t reserved;
+};
+
+// ============================================================================
+// KERNELS
+// ============================================================================
+
+#if defined(__aarch64__)
+#if defined(__ARM_FEATURE_DOTPROD)
+#define BERDCORE_DOTPROD_ALWAYS 1
+#define BERDCORE_DOTPROD_TARGET
+#elif defined(__clang__)
+#define BERDCORE_DOTPROD_TARGET __attribute__((target("dotprod")))
+#endif
+
+#ifdef BERDCORE_DOTPROD_TARGET
+// SDOT: 16 int8 products summed into 4 lanes per instruction (A13 and later)
+BERDCORE_DOTPROD_TARGET
+static int32_t dot_i8_sdot(const int8_t* a, const int8_t* b, size_t n) {
+    int32x4_t acc0 = vdupq_n_s32(0);
+    int32x4_t acc1 = vdupq_n_s32(0);
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        acc0 = vdotq_s32(acc0, vld1q_s8(a + i), vld1q_s8(b + i));
+        acc1 = vdotq_s32(acc1, vld1q_s8(a + i + 16), vld1q_s8(b + i + 16));
+    }
+    for (; i + 16 <= n; i += 16) {
+        acc0 = vdotq_s32(acc0, vld1q_s8(a + i), vld1q_s8(b + i));
+    }
+    int32_t sum = vaddvq_s32(vaddq_s32(acc0, acc1));
+    for (; i < n; i++) sum += (int32_t)a[i] * b[i];
+    return sum;
+}
+
+// Helper: Whether the CPU has the dot-product extension
+static bool cpu_has_dotprod() {
+#if defined(BERDCORE_DOTPROD_ALWAYS)
+    return true;
+#elif defined(__APPLE__)
+    int value = 0;
+    size_t size = sizeof(value);
+    return sysctlbyname("hw.optional.arm.FEAT_DotProd", &value, &size, nullptr, 0) == 0 && value != 0;
+#else
+    return false;
+#endif
+}
+#endif
+
+// Plain NEON: widening multiplies into int16, pairwise-accumulated into int32
+static int32_t dot_i8_neon(const int8_t* a, const int8_t* b, size_t n) {
+    int32x4_t acc = vdupq_n_s32(0);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        int8x16_t va = vld1q_s8(a + i);
+        int8x16_t vb = vld1q_s8(b + i);
+        acc = vpadalq_s16(acc, vmull_s8(vget_low_s8(va), vget_low_s8(vb)));
+        acc = vpadalq_s16(acc, vmull_high_s8(va, vb));
+    }
+    int32_t sum = vaddvq_s32(acc);
+    for (; i < n; i++) sum += (int32_t)a[i] * b[i];
+    return sum;
+}
+#endif
+
+int32_t index_dot_i8(const int8_t* a, const int8_t* b, size_t n) {
+#if defined(__aarch64__)
+#ifdef BERDCORE_DOTPROD_TARGET
+    static const bool has_dotprod = cpu_has_dotprod();
+    if (has_dotprod) return dot_i8_sdot(a, b, n);
+#endif
+    return dot_i8_neon(a, b, n);
+#else
+    int32_t sum = 0;
+    for (size_t i = 0; i < n; i++) sum += (int32_t)a[i] * b[i];
+    return sum;
+#endif
+}
+
+// Helper: Dot product of two float vectors
+static float dot_f32(const float* a, const float* b, size_t n) {
+    float sum = 0.0f;
+    for (size_t i = 0; i < n; i++) sum += a[i] * b[i];
+    return sum;
+}
+
+// Helper: Scale v to unit length (left as is if it is all zeros)
+static void normalize(float* v, size_t n) {
+    float norm = std::sqrt(dot_f32(v, v, n));
+    if (norm == 0.0f) return;
+    for (size_t i = 0; i < n; i++) v[i] /= norm;
+}
+
+// ============================================================================
+// INDEX
+// ============================================================================
+
+void BerdCoreVectorIndex::quantize(const float* vector, int8_t* code, float* scale) const {
+    std::vector<float> unit(vector, vector + dim_);
+    normalize(unit.data(), dim_);
+
+    float max_abs = 0.0f;
+    for (float x : unit) max_abs = std::max(max_abs, std::fabs(x));
+    *scale = max_abs / 127.0f;
+    for (size_t i = 0; i < dim_; i++) {
+        code[i] = *scale > 0.0f ? (int8_t)std::lrint(unit[i] / *scale) : 0;
+    }
+}
+
+size_t BerdCoreVectorIndex::nearest_list(const float* unit) const {
+    size_t best = 0;
+    float best_score = -2.0f;
+    for (size_t l = 0; l < lists_.size(); l++) {
+        float score = dot_f32(unit, &centroids_[l * dim_], dim_);
+        if (score > best_score) {
+            best_score = score;
+            best = l;
+        }
+    }
+    return best;
+}
+
+bool BerdCoreVectorIndex::add(const float* vector, size_t dim, BerdCoreIndexItem item) {
+    if (dim == 0) return false;
+    if (dim_ == 0) dim_ = dim;
+    if (dim != dim_) return false;
+
+    size_t id = items_.size();
+    codes_.resize((id + 1) * dim_);
+    scales_.push_back(0.0f);
+    quantize(vector, &codes_[id * dim_], &scales_[id]);
+    items_.push_back(std::move(item));
+
+    if (!lists_.empty()) {
+        std::vector<float> unit(vector, vector + dim_);
+        normalize(unit.data(), dim_);
+        lists_[nearest_list(unit.data())].push_back((uint32_t)id);
+    }
+    if (size() >= INDEX_IVF_MIN_VECTORS && size() >= 2 * trained_size_) {
+        train();
+    }
+    return true;
+}
+
+// Spherical k-means over a sample of the (dequantized) vectors, then every
+// vector is filed under its nearest centroid
+void BerdCoreVectorIndex::train() {
+    size_t n = size();
+    size_t list_count = std::min<size_t>(1024, std::max<size_t>(16, (size_t)std::sqrt((double)n)));
+    size_t stride = std::max<size_t>(1, n / (list_count * INDEX_TRAIN_POINTS_PER_LIST));
+
+    std::vector<float> points;
+    for (size_t id = 0; id < n; id += stride) {
+        for (size_t d = 0; d < dim_; d++) {
+            points.push_back(codes_[id * dim_ + d] * scales_[id]);
+        }
+    }
+    size_t point_count = points.size() / dim_;
+    list_count = std::min(list_count, point_count);
+
+    // Start from evenly spaced sample points
+    centroids_.assign(list_count * dim_, 0.0f);
+    for (size_t l = 0; l < list_count; l++) {
+        memcpy(&centroids_[l * dim_], &points[(l * point_count / list_count) * dim_], dim_ * sizeof(float));
+    }
+    lists_.assign(list_count, std::vector<uint32_t>());
+
+    std::vector<float> sums(list_count * dim_);
+    std::vector<size_t> counts(list_count);
+    for (int iteration = 0; iteration < INDEX_TRAIN_ITERATIONS; iteration++) {
+        std::fill(sums.begin(), sums.end(), 0.0f);
+        std::fill(counts.begin(), counts.end(), 0);
+        for (size_t p = 0; p < point_count; p++) {
+            const float* point = &points[p * dim_];
+            size_t l = nearest_list(point);
+            for (size_t d = 0; d < dim_; d++) sums[l * dim_ + d] += point[d];
+            counts[l]++;
+        }
+        for (size_t l = 0; l < list_count; l++) {
+            if (counts[l] == 0) continue;  // empty lists keep their centroid
+            memcpy(&centroids_[l * dim_], &sums[l * dim_], dim_ * sizeof(float));
+            normalize(&centroids_[l * dim_], dim_);
+        }
+    }
+
+    std::vector<float> unit(dim_);
+    for (size_t id = 0; id < n; id++) {
+        for (size_t d = 0; d < dim_; d++) unit[d] = codes_[id * dim_ + d] * scales_[id];
+        lists_[nearest_list(unit.data())].push_back((uint32_t)id);
+    }
+    trained_size_ = n;
+}
+
+void BerdCoreVectorIndex::search(const float* query, size_t dim, size_t k,
+                                 std::vector<std::pair<float, size_t>>* hits) const {
+    hits->clear();
+    if (dim != dim_ || items_.empty() || k == 0) return;
+
+    std::vector<float> unit(query, query + dim_);
+    normalize(unit.data(), dim_);
+    std::vector<int8_t> code(dim_);
+    float scale;
+    quantize(query, code.data(), &scale);
+
+    // Min-heap of the best k so far
+    typedef std::pair<float, size_t> Hit;
+    std::priority_queue<Hit, std::vector<Hit>, std::greater<Hit>> best;
+    auto consider = [&](size_t id) {
+        float score = index_dot_i8(code.data(), &codes_[id * dim_], dim_) * scale * scales_[id];
+        if (best.size() < k) {
+            best.emplace(score, id);
+        } else if (score > best.top().first) {
+            best.pop();
+            best.emplace(score, id);
+        }
+    };
+
+    if (lists_.empty()) {
+        for (size_t id = 0; id < items_.size(); id++) consider(id);
+    } else {
+        // Probe the lists whose centroids are closest to the query
+        size_t probes = std::min(lists_.size(), std::max<size_t>(4, lists_.size() / 8));
+        std::vector<std::pair<float, size_t>> order(lists_.size());
+        for (size_t l = 0; l < lists_.size(); l++) {
+            order[l] = {dot_f32(unit.data(), &centroids_[l * dim_], dim_), l};
+        }
+        std::partial_sort(order.begin(), order.begin() + probes, order.end(),
+                          [](const std::pair<float, size_t>& a, const std::pair<float, size_t>& b) {
+                              return a.first > b.first;
+                          });
+        for (size_t p = 0; p < probes; p++) {
+            for (uint32_t id : lists_[order[p].second]) consider(id);
+        }
+    }
+
+    hits->resize(best.size());
+    for (size_t i = hits->size(); i > 0; i--) {
+        // Rounding can put a near-identical vector just past 1
+        (*hits)[i - 1] = {std::min(best.top().first, 1.0f), best.top().second};
+        best.pop();
+    }
+}
+
+// Helper: Append a length-prefixed string
+static void index_put_string(std::string* out, const std::string& s) {
+    uint32_t length = (uint32_t)s.size();
+    out->append(reinterpret_cast<const char*>(&length), sizeof(length));
+    out->append(s);
+}
+
+// Helper: Read a length-prefixed string at *pos
+static bool index_get_string(const std::string& data, size_t* pos, std::string* s) {
+    uint32_t length;
+    if (data.size() - *pos < sizeof(length)) return false;
+    memcpy(&length, data.data() + *pos, sizeof(length));
+    *pos += sizeof(length);
+    if (data.size() - *pos < length) return false;
+    s->assign(data.data() + *pos, length);
+    *pos += length;
+    return true;
+}
+
+// Helper: Copy bytes bytes at *pos into out
+static bool index_get_bytes(const std::string& data, size_t* pos, void* out, size_t bytes) {
+    if (data.size() - *pos < bytes) return false;
+    memcpy(out, data.data() + *pos, bytes);
+    *pos += bytes;
+    return true;
+}
+
+bool BerdCoreVectorIndex::save(const std::string& path) const {
+    IndexFileHeader header;
+    memcpy(header.magic, INDEX_FILE_MAGIC, sizeof(INDEX_FILE_MAGIC));
+    header.version = INDEX_FILE_VERSION;
+    header.dim = (uint32_t)dim_;
+    header.count = items_.size();
+    header.trained_size = trained_size_;
+    header.list_count = (uint32_t)lists_.size();
+    header.reserved = 0;
+
+    std::string data(reinterpret_cast<const char*>(&header), sizeof(header));
+    for (const auto& item : items_) {
+        index_put_string(&data, item.title);
+        index_put_string(&data, item.ref);
+        index_put_string(&data, item.text);
+    }
+    data.append(reinterpret_cast<const char*>(codes_.data()), codes_.size());
+    data.append(reinterpret_cast<const char*>(scales_.data()), scales_.size() * sizeof(float));
+    data.append(reinterpret_cast<const char*>(centroids_.data()), centroids_.size() * sizeof(float));
+    std::vector<uint32_t> assignment(items_.size(), INDEX_NO_LIST);
+    for (size_t l = 0; l < lists_.size(); l++) {
+        for (uint32_t id : lists_[l]) assignment[id] = (uint32_t)l;
+    }
+    data.append(reinterpret_cast<const char*>(assignment.data()), assignment.size() * sizeof(uint32_t));
+
+    // Written beside the target and renamed over it, so a crash never
+    // leaves a half-written index
+    std::string tmp = path + ".tmp";
+    int fd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) return false;
+    const char* p = data.data();
+    size_t left = data.size();
+    while (left > 0) {
+        ssize_t n = write(fd, p, left);
+        if (n <= 0) break;
+        p += n;
+        left -= (size_t)n;
+    }
+    bool ok = left == 0 && fsync(fd) == 0;
+    close(fd);
+    if (!ok || rename(tmp.c_str(), path.c_str()) != 0) {
+        unlink(tmp.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool BerdCoreVectorIndex::load(const std::string& path) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+    struct stat st;
+    std::string data;
+    bool ok = fstat(fd, &st) == 0;
+    if (ok) {
+        data.resize((size_t)st.st_size);
+        size_t done = 0;
+        while (done < data.size()) {
+            ssize_t n = read(fd, &data[done], data.size() - done);
+            if (n <= 0) break;
+            done += (size_t)n;
+        }
+        ok = done == data.size();
+    }
+    close(fd);
+
+    IndexFileHeader header;
+    size_t pos = 0;
+    if (!ok || !index_get_bytes(data, &pos, &header, sizeof(header)) ||
+        memcmp(header.magic, INDEX_FILE_MAGIC, sizeof(INDEX_FILE_MAGIC)) != 0 ||
+        header.version != INDEX_FILE_VERSION) {
+        return false;
+    }
+    // Every vector costs at least its code and scale, which bounds count
+    size_t count = (size_t)header.count;
+    size_t dim = header.dim;
+    if (count > data.size() || (count > 0 && dim == 0) || (dim > 0 && count > data.size() / dim) ||
+        (dim > 0 && header.list_count > data.size() / (dim * sizeof(float)))) {
+        return false;
+    }
+
+    BerdCoreVectorIndex loaded;
+    loaded.dim_ = dim;
+    loaded.trained_size_ = (size_t)header.trained_size;
+    loaded.items_.resize(count);
+    for (auto& item : loaded.items_) {
+        if (!index_get_string(data, &pos, &item.title) ||
+            !index_get_string(data, &pos, &item.ref) ||
+            !index_get_string(data, &pos, &item.text)) {
+            return false;
+        }
+    }
+    loaded.codes_.resize(count * dim);
+    loaded.scales_.resize(count);
+    loaded.centroids_.resize((size_t)header.list_count * dim);
+    std::vector<uint32_t> assignment(count);
+    if (!index_get_bytes(data, &pos, loaded.codes_.data(), loaded.codes_.size()) ||
+        !index_get_bytes(data, &pos, loaded.scales_.data(), count * sizeof(float)) ||
+        !index_get_bytes(data, &pos, loaded.centroids_.data(), loaded.centroids_.size() * sizeof(float)) ||
+        !index_get_bytes(data, &pos, assignment.data(), count * sizeof(uint32_t))) {
+        return false;
+    }
+    loaded.lists_.assign(header.list_count, std::vector<uint32_t>());
+    for (size_t id = 0; id < count; id++) {
+        if (assignment[id] == INDEX_NO_LIST) {
+            if (header.list_count > 0) return false;
+            continue;
+        }
+        if (assignment[id] >= header.list_count) return false;
+        loaded.lists_[assignment[id]].push_back((uint32_t)id);
+    }
+
+    *this = std::move(loaded);
+    return true;
+}
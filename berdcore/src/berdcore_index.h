@@ -0,0 +1,71 @@
+#ifndef BERDCORE_INDEX_H
+#define BERDCORE_INDEX_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+// ============================================================================
+// VECTOR INDEX (internal)
+// ============================================================================
+// Embeddings are normalized and quantized to int8 with one float scale per
+// vector, a quarter of the float size, and compared with integer dot
+// products (NEON dot-product instructions where the CPU has them). Small
+// indexes are scanned exhaustively. Past INDEX_IVF_MIN_VECTORS the vectors
+// are partitioned by k-means into inverted lists (IVF) and a query scans
+// only the lists of its nearest centroids. Lists are rebuilt each time the
+// index doubles; vectors added in between join their nearest list.
+// ============================================================================
+
+// What an indexed passage came from, returned with each hit
+struct BerdCoreIndexItem {
+    std::string title;
+    std::string ref;   // URL, or conversation:<title>#<message>
+    std::string text;
+};
+
+class BerdCoreVectorIndex {
+public:
+    BerdCoreVectorIndex() : dim_(0), trained_size_(0) {}
+
+    size_t dim() const { return dim_; }
+    size_t size() const { return items_.size(); }
+    const BerdCoreIndexItem& item(size_t id) const { return items_[id]; }
+
+    /**
+     * Add a vector of any length; false if its dimension differs from the
+     * vectors already in the index
+     */
+    bool add(const float* vector, size_t dim, BerdCoreIndexItem item);
+
+    /**
+     * Up to k (cosine similarity, id) pairs, best first
+     */
+    void search(const float* query, size_t dim, size_t k, std::vector<std::pair<float, size_t>>* hits) const;
+
+    bool save(const std::string& path) const;
+    bool load(const std::string& path);
+
+private:
+    void quantize(const float* vector, int8_t* code, float* scale) const;
+    size_t nearest_list(const float* unit) const;
+    void train();
+
+    size_t dim_;
+    std::vector<int8_t> codes_;   // size() * dim_
+    std::vector<float> scales_;   // per vector
+    std::vector<BerdCoreIndexItem> items_;
+
+    std::vector<float> centroids_;              // lists_.size() * dim_, unit length
+    std::vector<std::vector<uint32_t>> lists_;  // ids per centroid (empty = flat)
+    size_t trained_size_;                       // size() when the lists were built
+};
+
+/**
+ * Dot product of two int8 vectors
+ */
+int32_t index_dot_i8(const int8_t* a, const int8_t* b, size_t n);
+
+#endif // BERDCORE_INDEX_H
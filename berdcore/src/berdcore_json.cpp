@@ -0,0 +1,132 @@
+#include "berdcore_json.h"
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+// Helper: Length of the well-formed UTF-8 sequence at s[i] (lead byte 0x80
+// or above), 0 if it is malformed or cut short
+static size_t json_utf8_length(const unsigned char* s, size_t i, size_t length) {
+    unsigned char c = s[i];
+    size_t n;
+    unsigned char low = 0x80, high = 0xBF;  // allowed range of the second byte
+    if (c >= 0xC2 && c <= 0xDF) {
+        n = 2;
+    } else if (c >= 0xE0 && c <= 0xEF) {
+        n = 3;
+        if (c == 0xE0) low = 0xA0;          // overlong
+        if (c == 0xED) high = 0x9F;         // surrogates
+    } else if (c >= 0xF0 && c <= 0xF4) {
+        n = 4;
+        if (c == 0xF0) low = 0x90;          // overlong
+        if (c == 0xF4) high = 0x8F;         // above U+10FFFF
+    } else {
+        return 0;
+    }
+    if (length - i < n || s[i + 1] < low || s[i + 1] > high) return 0;
+    for (size_t k = 2; k < n; k++) {
+        if ((s[i + k] & 0xC0) != 0x80) return 0;
+    }
+    return n;
+}
+
+void json_append_quoted(std::string* out, const char* s, size_t length) {
+    static const char hex[] = "0123456789abcdef";
+
+    out->push_back('"');
+    if (length == 0) {
+        out->push_back('"');
+        return;
+    }
+    size_t run = 0;  // start of the pending run of characters that need no escaping
+    for (size_t i = 0; i < length; i++) {
+        unsigned char c = (unsigned char)s[i];
+        if (c >= 0x80) {
+            // Text cut mid-character (or not UTF-8 at all) would make the
+            // document invalid, so bad bytes become U+FFFD
+            size_t n = json_utf8_length(reinterpret_cast<const unsigned char*>(s), i, length);
+            if (n > 0) {
+                i += n - 1;
+                continue;
+            }
+            out->append(s + run, i - run);
+            run = i + 1;
+            out->append("\xEF\xBF\xBD");
+            continue;
+        }
+        if (c >= 0x20 && c != '"' && c != '\\') continue;
+
+        out->append(s + run, i - run);
+        run = i + 1;
+        switch (c) {
+            case '"':  out->append("\\\""); break;
+            case '\\': out->append("\\\\"); break;
+            case '\b': out->append("\\b"); break;
+            case '\f': out->append("\\f"); break;
+            case '\n': out->append("\\n"); break;
+            case '\r': out->append("\\r"); break;
+            case '\t': out->append("\\t"); break;
+            default: {
+                char esc[6] = {'\\', 'u', '0', '0', hex[c >> 4], hex[c & 0xf]};
+                out->append(esc, sizeof(esc));
+            }
+        }
+    }
+    out->append(s + run, length - run);
+    out->push_back('"');
+}
+
+void BerdCoreJsonWriter::value_prefix() {
+    if (after_key_) {
+        after_key_ = false;
+        return;
+    }
+    if (depth_ == 0) return;
+
+    uint64_t bit = 1ull << (depth_ - 1);
+    if (has_items_ & bit) out_->push_back(',');
+    has_items_ |= bit;
+}
+
+void BerdCoreJsonWriter::open(char c) {
+    out_->push_back(c);
+    depth_++;
+    has_items_ &= ~(1ull << (depth_ - 1));
+}
+
+void BerdCoreJsonWriter::close(char c) {
+    out_->push_back(c);
+    depth_--;
+}
+
+void BerdCoreJsonWriter::key(const char* name) {
+    value_prefix();
+    json_append_quoted(out_, name, strlen(name));
+    out_->push_back(':');
+    after_key_ = true;
+}
+
+void BerdCoreJsonWriter::string(const char* s) {
+    if (!s) {
+        null();
+        return;
+    }
+    string(s, strlen(s));
+}
+
+void BerdCoreJsonWriter::number(double value) {
+    if (!std::isfinite(value)) {
+        null();
+        return;
+    }
+    value_prefix();
+    char buf[32];
+    int n = snprintf(buf, sizeof(buf), "%.9g", value);
+    out_->append(buf, n);
+}
+
+void BerdCoreJsonWriter::integer(int64_t value) {
+    value_prefix();
+    char buf[24];
+    int n = snprintf(buf, sizeof(buf), "%lld", (long long)value);
+    out_->append(buf, n);
+}
@@ -0,0 +1,56 @@
+#ifndef BERDCORE_JSON_H
+#define BERDCORE_JSON_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// ============================================================================
+// JSON WRITER (internal)
+// ============================================================================
+// Appends compact JSON to a caller-owned string. Callers keep the string
+// around (per model or per thread) and clear() it before each use, so once
+// its capacity has grown no call allocates. Nesting is tracked in a bit
+// mask, which limits documents to 64 levels.
+// ============================================================================
+
+// Append s as a quoted, escaped JSON string; malformed UTF-8 bytes are
+// written as U+FFFD
+void json_append_quoted(std::string* out, const char* s, size_t length);
+
+class BerdCoreJsonWriter {
+public:
+    explicit BerdCoreJsonWriter(std::string* out)
+        : out_(out), depth_(0), has_items_(0), after_key_(false) {}
+
+    void begin_object() { value_prefix(); open('{'); }
+    void end_object() { close('}'); }
+    void begin_array() { value_prefix(); open('['); }
+    void end_array() { close(']'); }
+
+    // Object key; the next call writes its value
+    void key(const char* name);
+
+    void string(const char* s, size_t length) { value_prefix(); json_append_quoted(out_, s, length); }
+    void string(const char* s);
+    void string(const std::string& s) { string(s.data(), s.size()); }
+    void number(double value);
+    void integer(int64_t value);
+    void boolean(bool value) { value_prefix(); out_->append(value ? "true" : "false"); }
+    void null() { value_prefix(); out_->append("null"); }
+
+    // Already-serialized JSON value, written as-is
+    void raw(const char* json) { value_prefix(); out_->append(json); }
+
+private:
+    void value_prefix();
+    void open(char c);
+    void close(char c);
+
+    std::string* out_;
+    int depth_;
+    uint64_t has_items_;  // bit per nesting level: container already has an item
+    bool after_key_;
+};
+
+#endif // BERDCORE_JSON_H
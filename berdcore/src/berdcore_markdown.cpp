@@ -0,0 +1,1201 @@
+#include "berdcore_markdown.h"
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <cstring>
+
+typedef std::vector<std::string_view> MdLines;
+
+enum MdKind {
+    MD_PARAGRAPH,
+    MD_SETEXT,      // paragraph closed by a === or --- underline
+    MD_HEADING,
+    MD_FENCE,
+    MD_INDENTED,
+    MD_RULE,
+    MD_QUOTE,
+    MD_LIST,
+    MD_TABLE,
+};
+
+// A top-level block as a range of lines
+struct MdBlock {
+    size_t begin;
+    size_t end;
+    MdKind kind;
+};
+
+struct MdFence {
+    char ch;
+    size_t length;
+    size_t indent;
+    std::string_view info;
+};
+
+struct MdListItem {
+    bool ordered;
+    char marker;           // bullet character, or '.' / ')' after the number
+    long start;
+    size_t marker_end;     // byte offset just past the marker
+    size_t padding;        // columns between the marker and the content
+    size_t content;        // column where the item's content starts
+};
+
+static void md_render_blocks(const MdLines& lines, bool tight, std::string* out);
+static void md_split_blocks(const MdLines& lines, std::vector<MdBlock>* blocks);
+static void md_inline(std::string_view s, std::string* out);
+
+// ----------------------------------------------------------------------------
+// Lines
+// ----------------------------------------------------------------------------
+
+// Helper: Whether c is a space or tab
+static bool md_space(char c) {
+    return c == ' ' || c == '\t';
+}
+
+// Helper: Whether the line is empty or whitespace
+static bool md_blank(std::string_view line) {
+    for (char c : line) {
+        if (!md_space(c)) return false;
+    }
+    return true;
+}
+
+// Helper: Columns of leading whitespace (tabs stop every 4 columns)
+static size_t md_indent(std::string_view line) {
+    size_t cols = 0;
+    for (char c : line) {
+        if (c == ' ') cols++;
+        else if (c == '\t') cols += 4 - cols % 4;
+        else break;
+    }
+    return cols;
+}
+
+// Helper: Drop up to cols columns of leading whitespace
+static std::string_view md_strip_columns(std::string_view line, size_t cols) {
+    size_t i = 0;
+    size_t c = 0;
+    while (i < line.size() && c < cols && md_space(line[i])) {
+        c += line[i] == '\t' ? 4 - c % 4 : 1;
+        i++;
+    }
+    return line.substr(i);
+}
+
+// Helper: Drop leading and trailing whitespace
+static std::string_view md_trim(std::string_view s) {
+    while (!s.empty() && md_space(s.front())) s.remove_prefix(1);
+    while (!s.empty() && md_space(s.back())) s.remove_suffix(1);
+    return s;
+}
+
+// Helper: Split text into lines without their terminators
+static void md_split_lines(std::string_view text, MdLines* lines) {
+    size_t start = 0;
+    while (start < text.size()) {
+        size_t nl = text.find('\n', start);
+        size_t end = nl == std::string_view::npos ? text.size() : nl;
+        std::string_view line = text.substr(start, end - start);
+        if (!line.empty() && line.back() == '\r') line.remove_suffix(1);
+        lines->push_back(line);
+        if (nl == std::string_view::npos) break;
+        start = nl + 1;
+    }
+}
+
+// ----------------------------------------------------------------------------
+// Block starts
+// ----------------------------------------------------------------------------
+
+// Helper: Whether the line opens a code fence indented at most max_indent
+static bool md_fence_open(std::string_view line, MdFence* fence, size_t max_indent = 3) {
+    size_t indent = md_indent(line);
+    if (indent > max_indent) return false;
+    std::string_view s = md_strip_columns(line, indent);
+    if (s.empty() || (s[0] != '`' && s[0] != '~')) return false;
+
+    size_t n = 0;
+    while (n < s.size() && s[n] == s[0]) n++;
+    if (n < 3) return false;
+    std::string_view info = md_trim(s.substr(n));
+    if (s[0] == '`' && info.find('`') != std::string_view::npos) return false;
+
+    fence->ch = s[0];
+    fence->length = n;
+    fence->indent = indent;
+    fence->info = info;
+    return true;
+}
+
+// Helper: Whether the line closes the fence
+static bool md_fence_close(std::string_view line, const MdFence& fence, size_t max_indent = 3) {
+    if (md_indent(line) > max_indent) return false;
+    std::string_view s = md_trim(line);
+    size_t n = 0;
+    while (n < s.size() && s[n] == fence.ch) n++;
+    return n >= fence.length && n == s.size();
+}
+
+// Helper: Level of an ATX heading (0 if not one), with its text
+static int md_atx_level(std::string_view line, std::string_view* content) {
+    if (md_indent(line) > 3) return 0;
+    std::string_view s = md_trim(line);
+    size_t n = 0;
+    while (n < s.size() && s[n] == '#') n++;
+    if (n == 0 || n > 6 || (n < s.size() && !md_space(s[n]))) return 0;
+
+    if (content) {
+        std::string_view c = md_trim(s.substr(n));
+        // Drop a closing run of '#' that follows a space
+        size_t end = c.size();
+        while (end > 0 && c[end - 1] == '#') end--;
+        if (end == 0) {
+            c = std::string_view();
+        } else if (end < c.size() && md_space(c[end - 1])) {
+            c = md_trim(c.substr(0, end));
+        }
+        *content = c;
+    }
+    return (int)n;
+}
+
+// Helper: Whether the line is a thematic break (***, ---, ___)
+static bool md_rule(std::string_view line) {
+    if (md_indent(line) > 3) return false;
+    char ch = 0;
+    size_t n = 0;
+    for (char c : line) {
+        if (md_space(c)) continue;
+        if ((c != '*' && c != '-' && c != '_') || (ch && c != ch)) return false;
+        ch = c;
+        n++;
+    }
+    return n >= 3;
+}
+
+// Helper: Heading level of a setext underline (0 if not one)
+static int md_setext_level(std::string_view line) {
+    if (md_indent(line) > 3) return 0;
+    std::string_view s = md_trim(line);
+    if (s.empty() || (s[0] != '=' && s[0] != '-')) return 0;
+    for (char c : s) {
+        if (c != s[0]) return 0;
+    }
+    return s[0] == '=' ? 1 : 2;
+}
+
+// Helper: Whether the line is part of a block quote
+static bool md_quote(std::string_view line) {
+    if (md_indent(line) > 3) return false;
+    std::string_view s = md_trim(line);
+    return !s.empty() && s[0] == '>';
+}
+
+// Helper: Line with its quote marker and one following space removed
+// (a lazy continuation line has no marker and is kept as it is)
+static std::string_view md_quote_strip(std::string_view line) {
+    if (!md_quote(line)) return line;
+    size_t i = line.find('>') + 1;
+    if (i < line.size() && md_space(line[i])) i++;
+    return line.substr(i);
+}
+
+// Helper: Whether the line starts a list item
+static bool md_list_item(std::string_view line, MdListItem* item) {
+    size_t indent = md_indent(line);
+    if (indent > 3) return false;
+    size_t start = line.size() - md_strip_columns(line, indent).size();
+    size_t i = start;
+
+    MdListItem it;
+    it.ordered = false;
+    it.start = 1;
+    if (i < line.size() && (line[i] == '-' || line[i] == '+' || line[i] == '*')) {
+        it.marker = line[i];
+        i++;
+    } else {
+        long value = 0;
+        while (i < line.size() && isdigit((unsigned char)line[i]) && i - start < 9) {
+            value = value * 10 + (line[i] - '0');
+            i++;
+        }
+        if (i == start || i >= line.size() || (line[i] != '.' && line[i] != ')')) return false;
+        it.ordered = true;
+        it.marker = line[i];
+        it.start = value;
+        i++;
+    }
+    if (i < line.size() && !md_space(line[i])) return false;
+
+    it.marker_end = i;
+    size_t marker_cols = indent + (i - start);
+    size_t spaces = md_indent(line.substr(i));
+    // Content indented five or more is indented code within the item
+    it.padding = (md_blank(line.substr(i)) || spaces > 4) ? 1 : spaces;
+    it.content = marker_cols + it.padding;
+    *item = it;
+    return true;
+}
+
+// Helper: Whether the line starts a block that can interrupt a paragraph
+static bool md_interrupts(std::string_view line) {
+    MdFence fence;
+    MdListItem item;
+    if (md_atx_level(line, nullptr) || md_fence_open(line, &fence) || md_rule(line) || md_quote(line)) {
+        return true;
+    }
+    // Only non-empty items, and ordered ones numbered 1, start a list here
+    return md_list_item(line, &item) && !md_blank(line.substr(item.marker_end)) &&
+           (!item.ordered || item.start == 1);
+}
+
+// Helper: Cells of a table row, split at unescaped pipes
+static std::vector<std::string_view> md_table_cells(std::string_view line) {
+    std::string_view s = md_trim(line);
+    if (!s.empty() && s[0] == '|') s.remove_prefix(1);
+    if (!s.empty() && s.back() == '|' && !(s.size() >= 2 && s[s.size() - 2] == '\\')) s.remove_suffix(1);
+
+    std::vector<std::string_view> cells;
+    size_t start = 0;
+    for (size_t i = 0; i <= s.size(); i++) {
+        if (i < s.size() && s[i] == '\\') {
+            i++;
+            continue;
+        }
+        if (i == s.size() || s[i] == '|') {
+            cells.push_back(md_trim(s.substr(start, i - start)));
+            start = i + 1;
+        }
+    }
+    return cells;
+}
+
+// Helper: Whether the line is a table delimiter row; collects alignments ('l', 'c', 'r' or 0)
+static bool md_table_delimiter(std::string_view line, std::vector<char>* aligns) {
+    if (md_indent(line) > 3 || line.find('|') == std::string_view::npos) return false;
+    for (std::string_view cell : md_table_cells(line)) {
+        bool left = !cell.empty() && cell.front() == ':';
+        bool right = cell.size() > 1 && cell.back() == ':';
+        std::string_view dashes = cell.substr(left ? 1 : 0, cell.size() - (left ? 1 : 0) - (right ? 1 : 0));
+        if (dashes.empty() || dashes.find_first_not_of('-') != std::string_view::npos) return false;
+        if (aligns) aligns->push_back(left && right ? 'c' : right ? 'r' : left ? 'l' : 0);
+    }
+    return true;
+}
+
+// Helper: Whether a table (header row, then delimiter row) starts at line i
+static bool md_table_start(const MdLines& lines, size_t i) {
+    if (i + 1 >= lines.size() || lines[i].find('|') == std::string_view::npos) return false;
+    std::vector<char> aligns;
+    return md_table_delimiter(lines[i + 1], &aligns) && aligns.size() == md_table_cells(lines[i]).size();
+}
+
+// ----------------------------------------------------------------------------
+// Block structure
+// ----------------------------------------------------------------------------
+
+// Helper: End of the list starting at line i, optionally with each item's first line
+static size_t md_list_end(const MdLines& lines, size_t i, const MdListItem& first,
+                          std::vector<std::pair<size_t, MdListItem>>* items) {
+    MdListItem current = first;
+    if (items) items->push_back({i, first});
+
+    size_t end = i + 1;
+    for (size_t j = i + 1; j < lines.size(); j++) {
+        std::string_view line = lines[j];
+        if (md_blank(line)) continue;
+        if (md_indent(line) >= current.content) {
+            end = j + 1;
+            continue;
+        }
+
+        MdListItem next;
+        bool is_item = md_list_item(line, &next) && !md_rule(line);
+        if (is_item && next.ordered == first.ordered && next.marker == first.marker) {
+            current = next;
+            if (items) items->push_back({j, next});
+            end = j + 1;
+            continue;
+        }
+        // Lazy continuation of the item's last paragraph
+        if (!is_item && !md_blank(lines[j - 1]) && !md_interrupts(line)) {
+            end = j + 1;
+            continue;
+        }
+        break;
+    }
+    return end;
+}
+
+// Helper: Whether line j, which has no quote marker, is a lazy continuation
+// of a paragraph inside the quote that starts at line i
+static bool md_quote_lazy(const MdLines& lines, size_t i, size_t j) {
+    if (md_blank(lines[j]) || md_interrupts(lines[j]) || md_blank(md_quote_strip(lines[j - 1]))) {
+        return false;
+    }
+    // The quote's content with line j appended must still end in the block
+    // the previous line was in, and that block must be paragraph text
+    MdLines inner;
+    for (size_t k = i; k < j; k++) inner.push_back(md_quote_strip(lines[k]));
+    inner.push_back(lines[j]);
+    std::vector<MdBlock> blocks;
+    md_split_blocks(inner, &blocks);
+    const MdBlock& last = blocks.back();
+    return last.begin + 1 < inner.size() &&
+           (last.kind == MD_PARAGRAPH || last.kind == MD_LIST || last.kind == MD_QUOTE);
+}
+
+// Helper: End (exclusive) of the block starting at the non-blank line i
+static size_t md_block_end(const MdLines& lines, size_t i, MdKind* kind) {
+    std::string_view line = lines[i];
+    size_t n = lines.size();
+    MdFence fence;
+    MdListItem item;
+
+    if (md_indent(line) >= 4) {
+        *kind = MD_INDENTED;
+        size_t end = i + 1;
+        for (size_t j = i + 1; j < n; j++) {
+            if (md_blank(lines[j])) continue;
+            if (md_indent(lines[j]) < 4) break;
+            end = j + 1;
+        }
+        return end;
+    }
+    if (md_fence_open(line, &fence)) {
+        *kind = MD_FENCE;
+        for (size_t j = i + 1; j < n; j++) {
+            if (md_fence_close(lines[j], fence)) return j + 1;
+        }
+        return n;
+    }
+    if (md_atx_level(line, nullptr)) {
+        *kind = MD_HEADING;
+        return i + 1;
+    }
+    // Before lists, which "* * *" would also match
+    if (md_rule(line)) {
+        *kind = MD_RULE;
+        return i + 1;
+    }
+    if (md_quote(line)) {
+        *kind = MD_QUOTE;
+        size_t j = i + 1;
+        while (j < n && (md_quote(lines[j]) || md_quote_lazy(lines, i, j))) j++;
+        return j;
+    }
+    if (md_list_item(line, &item)) {
+        *kind = MD_LIST;
+        return md_list_end(lines, i, item, nullptr);
+    }
+    if (md_table_start(lines, i)) {
+        *kind = MD_TABLE;
+        size_t j = i + 2;
+        while (j < n && !md_blank(lines[j]) && !md_interrupts(lines[j])) j++;
+        return j;
+    }
+
+    *kind = MD_PARAGRAPH;
+    for (size_t j = i + 1; j < n; j++) {
+        if (md_blank(lines[j])) return j;
+        if (md_setext_level(lines[j])) {
+            *kind = MD_SETEXT;
+            return j + 1;
+        }
+        if (md_interrupts(lines[j]) || md_table_start(lines, j)) return j;
+    }
+    return n;
+}
+
+// Helper: Split lines into blocks; blank lines between blocks belong to none
+static void md_split_blocks(const MdLines& lines, std::vector<MdBlock>* blocks) {
+    size_t i = 0;
+    while (i < lines.size()) {
+        if (md_blank(lines[i])) {
+            i++;
+            continue;
+        }
+        MdBlock block;
+        block.begin = i;
+        block.end = md_block_end(lines, i, &block.kind);
+        blocks->push_back(block);
+        i = block.end;
+    }
+}
+
+// ----------------------------------------------------------------------------
+// Inline content
+// ----------------------------------------------------------------------------
+
+// Text, or a run of emphasis delimiters waiting to be matched
+struct MdPiece {
+    std::string html;
+    char delim;            // '*', '_' or '~' for a delimiter run, else 0
+    size_t count;          // delimiters not matched yet
+    size_t length;         // length of the run as written
+    bool can_open;
+    bool can_close;
+    std::string before;    // closing tags, emitted before the leftover delimiters
+    std::string after;     // opening tags, emitted after them
+
+    MdPiece() : delim(0), count(0), length(0), can_open(false), can_close(false) {}
+};
+
+// Helper: Append s with HTML special characters escaped
+static void md_escape(std::string_view s, std::string* out) {
+    for (char c : s) {
+        switch (c) {
+            case '&': *out += "&amp;"; break;
+            case '<': *out += "&lt;"; break;
+            case '>': *out += "&gt;"; break;
+            case '"': *out += "&quot;"; break;
+            default: out->push_back(c); break;
+        }
+    }
+}
+
+// Helper: Whether c is ASCII punctuation
+static bool md_punct(char c) {
+    return c > 0 && ispunct((unsigned char)c);
+}
+
+// Helper: Whether c is whitespace for flanking rules (line ends count)
+static bool md_white(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\f' || c == '\v';
+}
+
+// Helper: Length of a character or numeric reference at s[i] ('&'), 0 if none
+static size_t md_entity(std::string_view s, size_t i) {
+    size_t j = i + 1;
+    if (j < s.size() && s[j] == '#') j++;
+    size_t start = j;
+    while (j < s.size() && j - start < 32 && isalnum((unsigned char)s[j])) j++;
+    return (j > start && j < s.size() && s[j] == ';') ? j + 1 - i : 0;
+}
+
+// Helper: Text with backslash escapes removed
+static std::string md_unescape(std::string_view s) {
+    std::string out;
+    for (size_t i = 0; i < s.size(); i++) {
+        if (s[i] == '\\' && i + 1 < s.size() && md_punct(s[i + 1])) i++;
+        out.push_back(s[i]);
+    }
+    return out;
+}
+
+// Helper: Whether a link destination is safe to emit: relative, or an
+// http, https or mailto URL. The scheme is read the way a browser reads it,
+// with leading controls and spaces trimmed and tabs and newlines dropped,
+// so "java\tscript:" counts as javascript.
+static bool md_safe_url(const std::string& url) {
+    size_t i = 0;
+    while (i < url.size() && (unsigned char)url[i] <= ' ') i++;
+    std::string scheme;
+    for (; i < url.size(); i++) {
+        char c = url[i];
+        if (c == '\t' || c == '\r' || c == '\n') continue;
+        if (c == ':') {
+            return scheme == "http" || scheme == "https" || scheme == "mailto";
+        }
+        if (c == '/' || c == '?' || c == '#') return true;
+        scheme.push_back((char)tolower((unsigned char)c));
+    }
+    return true;
+}
+
+// Helper: Append <a href="url">label</a> with an already rendered label
+static void md_anchor(const std::string& url, std::string_view title, std::string_view label_html,
+                      std::string* out) {
+    if (!md_safe_url(url)) {
+        out->append(label_html.data(), label_html.size());
+        return;
+    }
+    *out += "<a href=\"";
+    md_escape(url, out);
+    if (!title.empty()) {
+        *out += "\" title=\"";
+        md_escape(md_unescape(title), out);
+    }
+    *out += "\">";
+    out->append(label_html.data(), label_html.size());
+    *out += "</a>";
+}
+
+// Helper: End of the run of c starting at s[i]
+static size_t md_run_end(std::string_view s, size_t i, char c) {
+    while (i < s.size() && s[i] == c) i++;
+    return i;
+}
+
+// Helper: Parse [label](destination "title") or an image at s[i]; returns the end, 0 if none
+static size_t md_link(std::string_view s, size_t i, std::string* out) {
+    bool image = s[i] == '!';
+    size_t open = i + (image ? 1 : 0);
+    size_t n = s.size();
+
+    // Matching bracket, skipping escapes and code spans
+    int depth = 0;
+    size_t close = open;
+    for (; close < n; close++) {
+        char c = s[close];
+        if (c == '\\') {
+            close++;
+        } else if (c == '`') {
+            size_t run = md_run_end(s, close, '`');
+            size_t match = s.find(std::string(run - close, '`'), run);
+            close = match == std::string_view::npos ? run - 1 : match + (run - close) - 1;
+        } else if (c == '[') {
+            depth++;
+        } else if (c == ']' && --depth == 0) {
+            break;
+        }
+    }
+    if (close + 1 >= n || s[close + 1] != '(') return 0;
+    std::string_view label = s.substr(open + 1, close - open - 1);
+
+    size_t k = close + 2;
+    while (k < n && md_white(s[k])) k++;
+    std::string_view dest;
+    if (k < n && s[k] == '<') {
+        size_t end = s.find_first_of(">\n", k + 1);
+        if (end == std::string_view::npos || s[end] != '>') return 0;
+        dest = s.substr(k + 1, end - k - 1);
+        k = end + 1;
+    } else {
+        size_t start = k;
+        int parens = 0;
+        while (k < n && !md_white(s[k])) {
+            if (s[k] == '\\' && k + 1 < n) {
+                k += 2;
+                continue;
+            }
+            if (s[k] == '(') {
+                parens++;
+            } else if (s[k] == ')') {
+                if (parens == 0) break;
+                parens--;
+            }
+            k++;
+        }
+        dest = s.substr(start, k - start);
+    }
+
+    while (k < n && md_white(s[k])) k++;
+    std::string_view title;
+    if (k < n && (s[k] == '"' || s[k] == '\'' || s[k] == '(')) {
+        char quote = s[k] == '(' ? ')' : s[k];
+        size_t t = k + 1;
+        while (t < n && s[t] != quote) t += s[t] == '\\' ? 2 : 1;
+        if (t >= n) return 0;
+        title = s.substr(k + 1, t - k - 1);
+        k = t + 1;
+        while (k < n && md_white(s[k])) k++;
+    }
+    if (k >= n || s[k] != ')') return 0;
+
+    std::string url = md_unescape(dest);
+    if (image) {
+        if (md_safe_url(url)) {
+            *out += "<img src=\"";
+            md_escape(url, out);
+            *out += "\" alt=\"";
+            md_escape(md_unescape(label), out);
+            *out += "\" />";
+        } else {
+            md_escape(md_unescape(label), out);
+        }
+    } else {
+        std::string label_html;
+        md_inline(label, &label_html);
+        md_anchor(url, title, label_html, out);
+    }
+    return k + 1;
+}
+
+// Helper: Parse <scheme:...> at s[i]; returns the end, 0 if none
+static size_t md_autolink(std::string_view s, size_t i, std::string* out) {
+    size_t j = i + 1;
+    size_t scheme = j;
+    while (j < s.size() && j - scheme < 32 && (isalnum((unsigned char)s[j]) || s[j] == '+' || s[j] == '.' || s[j] == '-')) j++;
+    if (j - scheme < 2 || j >= s.size() || s[j] != ':' || !isalpha((unsigned char)s[scheme])) return 0;
+    while (j < s.size() && s[j] != '>' && s[j] != '<' && !md_white(s[j])) j++;
+    if (j >= s.size() || s[j] != '>') return 0;
+
+    std::string url(s.substr(i + 1, j - i - 1));
+    std::string label;
+    md_escape(url, &label);
+    md_anchor(url, std::string_view(), label, out);
+    return j + 1;
+}
+
+// Helper: Parse a bare http(s) URL at s[i]; returns the end, 0 if none
+static size_t md_bare_url(std::string_view s, size_t i, std::string* out) {
+    std::string_view rest = s.substr(i);
+    size_t scheme = rest.compare(0, 8, "https://") == 0 ? 8 : rest.compare(0, 7, "http://") == 0 ? 7 : 0;
+    if (scheme == 0) return 0;
+
+    size_t end = scheme;
+    while (end < rest.size() && !md_white(rest[end]) && rest[end] != '<') end++;
+    // Trailing punctuation belongs to the sentence, as does an unbalanced ')'
+    while (end > scheme) {
+        char c = rest[end - 1];
+        if (strchr(".,:;!?\"'*_~", c)) {
+            end--;
+        } else if (c == ')' && std::count(rest.begin(), rest.begin() + end, '(') <
+                                std::count(rest.begin(), rest.begin() + end, ')')) {
+            end--;
+        } else {
+            break;
+        }
+    }
+    if (end == scheme) return 0;
+
+    std::string url(rest.substr(0, end));
+    std::string label;
+    md_escape(url, &label);
+    md_anchor(url, std::string_view(), label, out);
+    return i + end;
+}
+
+// Helper: Match emphasis delimiters (CommonMark's delimiter run algorithm)
+static void md_emphasis(std::vector<MdPiece>* pieces) {
+    std::vector<MdPiece>& p = *pieces;
+    for (size_t c = 0; c < p.size(); c++) {
+        if (!p[c].delim || !p[c].can_close) continue;
+
+        while (p[c].count > 0) {
+            size_t o = c;
+            bool found = false;
+            while (o > 0) {
+                o--;
+                const MdPiece& q = p[o];
+                if (q.delim != p[c].delim || q.count == 0 || !q.can_open) continue;
+                // Rule of three, for runs that can both open and close
+                if ((q.can_close || p[c].can_open) && (q.length + p[c].length) % 3 == 0 &&
+                    !(q.length % 3 == 0 && p[c].length % 3 == 0)) {
+                    continue;
+                }
+                found = true;
+                break;
+            }
+            if (!found) break;
+
+            MdPiece& q = p[o];
+            size_t use = p[c].delim == '~' || (q.count >= 2 && p[c].count >= 2) ? 2 : 1;
+            const char* tag = p[c].delim == '~' ? "del" : use == 2 ? "strong" : "em";
+            q.after = std::string("<") + tag + ">" + q.after;
+            p[c].before += std::string("</") + tag + ">";
+            q.count -= use;
+            p[c].count -= use;
+            // Unmatched delimiters inside the pair stay literal
+            for (size_t m = o + 1; m < c; m++) {
+                p[m].can_open = false;
+                p[m].can_close = false;
+            }
+        }
+    }
+}
+
+// Helper: Render inline markdown as HTML
+static void md_inline(std::string_view s, std::string* out) {
+    std::vector<MdPiece> pieces;
+    std::string text;
+    auto flush = [&]() {
+        if (text.empty()) return;
+        pieces.emplace_back();
+        pieces.back().html.swap(text);
+    };
+
+    size_t n = s.size();
+    size_t i = 0;
+    while (i < n) {
+        char c = s[i];
+        switch (c) {
+            case '\\':
+                if (i + 1 < n && s[i + 1] == '\n') {
+                    text += "<br />\n";
+                    i += 2;
+                } else if (i + 1 < n && md_punct(s[i + 1])) {
+                    md_escape(s.substr(i + 1, 1), &text);
+                    i += 2;
+                } else {
+                    text.push_back('\\');
+                    i++;
+                }
+                continue;
+
+            case '`': {
+                size_t run = md_run_end(s, i, '`') - i;
+                size_t j = i + run;
+                size_t close = std::string_view::npos;
+                while ((j = s.find('`', j)) != std::string_view::npos) {
+                    size_t end = md_run_end(s, j, '`');
+                    if (end - j == run) {
+                        close = j;
+                        break;
+                    }
+                    j = end;
+                }
+                if (close == std::string_view::npos) {
+                    text.append(run, '`');
+                    i += run;
+                    continue;
+                }
+                std::string code(s.substr(i + run, close - i - run));
+                std::replace(code.begin(), code.end(), '\n', ' ');
+                if (code.size() >= 2 && code.front() == ' ' && code.back() == ' ' &&
+                    code.find_first_not_of(' ') != std::string::npos) {
+                    code = code.substr(1, code.size() - 2);
+                }
+                text += "<code>";
+                md_escape(code, &text);
+                text += "</code>";
+                i = close + run;
+                continue;
+            }
+
+            case '*':
+            case '_':
+            case '~': {
+                size_t end = md_run_end(s, i, c);
+                char prev = i > 0 ? s[i - 1] : ' ';
+                char next = end < n ? s[end] : ' ';
+                bool left = !md_white(next) && (!md_punct(next) || md_white(prev) || md_punct(prev));
+                bool right = !md_white(prev) && (!md_punct(prev) || md_white(next) || md_punct(next));
+                // Strikethrough only for "~~", so "~5 min" stays literal
+                if (c == '~' && end - i != 2) {
+                    text.append(end - i, c);
+                    i = end;
+                    continue;
+                }
+                flush();
+                pieces.emplace_back();
+                MdPiece& p = pieces.back();
+                p.delim = c;
+                p.count = end - i;
+                p.length = end - i;
+                p.can_open = c == '_' ? left && (!right || md_punct(prev)) : left;
+                p.can_close = c == '_' ? right && (!left || md_punct(next)) : right;
+                i = end;
+                continue;
+            }
+
+            case '!':
+            case '[':
+                if (c == '[' || (i + 1 < n && s[i + 1] == '[')) {
+                    size_t end = md_link(s, i, &text);
+                    if (end) {
+                        i = end;
+                        continue;
+                    }
+                }
+                text.push_back(c);
+                i++;
+                continue;
+
+            case '<': {
+                size_t end = md_autolink(s, i, &text);
+                if (end) {
+                    i = end;
+                } else {
+                    text += "&lt;";
+                    i++;
+                }
+                continue;
+            }
+
+            case 'h':
+                if (i == 0 || md_white(s[i - 1]) || s[i - 1] == '(') {
+                    size_t end = md_bare_url(s, i, &text);
+                    if (end) {
+                        i = end;
+                        continue;
+                    }
+                }
+                text.push_back(c);
+                i++;
+                continue;
+
+            case '\n': {
+                size_t spaces = 0;
+                while (spaces < text.size() && text[text.size() - 1 - spaces] == ' ') spaces++;
+                text.resize(text.size() - spaces);
+                text += spaces >= 2 ? "<br />\n" : "\n";
+                i++;
+                continue;
+            }
+
+            case '&': {
+                size_t entity = md_entity(s, i);
+                if (entity) {
+                    text.append(s.substr(i, entity));
+                    i += entity;
+                } else {
+                    text += "&amp;";
+                    i++;
+                }
+                continue;
+            }
+
+            case '>':
+                text += "&gt;";
+                i++;
+                continue;
+
+            case '"':
+                text += "&quot;";
+                i++;
+                continue;
+
+            default: {
+                // Copy the run of ordinary characters
+                size_t end = i + 1;
+                while (end < n && !strchr("\\`*_~![<h\n&>\"", s[end])) end++;
+                text.append(s.substr(i, end - i));
+                i = end;
+                continue;
+            }
+        }
+    }
+    flush();
+
+    md_emphasis(&pieces);
+    for (const MdPiece& p : pieces) {
+        if (!p.delim) {
+            *out += p.html;
+            continue;
+        }
+        *out += p.before;
+        out->append(p.count, p.delim);
+        *out += p.after;
+    }
+}
+
+// ----------------------------------------------------------------------------
+// Blocks
+// ----------------------------------------------------------------------------
+
+// Helper: Lines joined for inline rendering, without leading whitespace or trailing whitespace at the end
+static std::string md_join(const MdLines& lines, size_t begin, size_t end) {
+    std::string text;
+    for (size_t i = begin; i < end; i++) {
+        std::string_view line = lines[i];
+        while (!line.empty() && md_space(line.front())) line.remove_prefix(1);
+        if (i > begin) text.push_back('\n');
+        text.append(line);
+    }
+    while (!text.empty() && md_space(text.back())) text.pop_back();
+    return text;
+}
+
+// Helper: Append a code block
+static void md_code_block(const MdLines& lines, size_t begin, size_t end, size_t indent,
+                          std::string_view info, std::string* out) {
+    std::string_view language = info.substr(0, std::min(info.size(), info.find_first_of(" \t")));
+    if (language.empty()) {
+        *out += "<pre><code>";
+    } else {
+        *out += "<pre><code class=\"language-";
+        md_escape(md_unescape(language), out);
+        *out += "\">";
+    }
+    for (size_t i = begin; i < end; i++) {
+        md_escape(md_strip_columns(lines[i], indent), out);
+        out->push_back('\n');
+    }
+    *out += "</code></pre>";
+}
+
+// Helper: Append a table
+static void md_table(const MdLines& lines, size_t begin, size_t end, std::string* out) {
+    std::vector<char> aligns;
+    md_table_delimiter(lines[begin + 1], &aligns);
+
+    auto row = [&](std::string_view line, const char* cell_tag) {
+        std::vector<std::string_view> cells = md_table_cells(line);
+        *out += "<tr>\n";
+        for (size_t c = 0; c < aligns.size(); c++) {
+            *out += "<";
+            *out += cell_tag;
+            if (aligns[c]) {
+                *out += aligns[c] == 'l' ? " align=\"left\"" : aligns[c] == 'r' ? " align=\"right\"" : " align=\"center\"";
+            }
+            *out += ">";
+            if (c < cells.size()) md_inline(cells[c], out);
+            *out += "</";
+            *out += cell_tag;
+            *out += ">\n";
+        }
+        *out += "</tr>\n";
+    };
+
+    *out += "<table>\n<thead>\n";
+    row(lines[begin], "th");
+    *out += "</thead>\n";
+    if (begin + 2 < end) {
+        *out += "<tbody>\n";
+        for (size_t i = begin + 2; i < end; i++) row(lines[i], "td");
+        *out += "</tbody>\n";
+    }
+    *out += "</table>";
+}
+
+// Helper: Append a list
+static void md_list(const MdLines& lines, size_t begin, size_t end, std::string* out) {
+    MdListItem first;
+    md_list_item(lines[begin], &first);
+    std::vector<std::pair<size_t, MdListItem>> items;
+    md_list_end(lines, begin, first, &items);
+
+    // Each item's lines with its indentation removed
+    std::vector<MdLines> contents(items.size());
+    bool loose = false;
+    for (size_t k = 0; k < items.size(); k++) {
+        const MdListItem& item = items[k].second;
+        size_t from = items[k].first;
+        size_t to = k + 1 < items.size() ? items[k + 1].first : end;
+        MdLines& content = contents[k];
+        content.push_back(md_strip_columns(lines[from].substr(item.marker_end), item.padding));
+        for (size_t j = from + 1; j < to; j++) {
+            content.push_back(md_indent(lines[j]) >= item.content ? md_strip_columns(lines[j], item.content) : lines[j]);
+        }
+
+        // A blank line between items or between an item's blocks makes the list loose
+        size_t trailing = 0;
+        while (trailing < content.size() && md_blank(content[content.size() - 1 - trailing])) trailing++;
+        if (trailing > 0 && k + 1 < items.size()) loose = true;
+        content.resize(std::max<size_t>(1, content.size() - std::min(trailing, content.size() - 1)));
+        std::vector<MdBlock> blocks;
+        md_split_blocks(content, &blocks);
+        for (size_t b = 1; b < blocks.size(); b++) {
+            if (blocks[b].begin > blocks[b - 1].end) loose = true;
+        }
+    }
+
+    if (first.ordered) {
+        *out += first.start != 1 ? "<ol start=\"" + std::to_string(first.start) + "\">\n" : "<ol>\n";
+    } else {
+        *out += "<ul>\n";
+    }
+    for (const MdLines& content : contents) {
+        *out += "<li>";
+        std::string body;
+        md_render_blocks(content, !loose, &body);
+        bool inline_first = !loose && !body.empty() && body[0] != '<';
+        if (!inline_first && !body.empty()) out->push_back('\n');
+        *out += body;
+        if (!inline_first && !body.empty()) out->push_back('\n');
+        *out += "</li>\n";
+    }
+    *out += first.ordered ? "</ol>" : "</ul>";
+}
+
+// Helper: Append one block; in tight lists paragraphs have no <p>
+static void md_render_block(const MdLines& lines, const MdBlock& block, bool tight, std::string* out) {
+    switch (block.kind) {
+        case MD_PARAGRAPH:
+        case MD_SETEXT: {
+            bool setext = block.kind == MD_SETEXT;
+            std::string text = md_join(lines, block.begin, block.end - (setext ? 1 : 0));
+            if (setext) {
+                const char* level = md_setext_level(lines[block.end - 1]) == 1 ? "1" : "2";
+                *out += std::string("<h") + level + ">";
+                md_inline(text, out);
+                *out += std::string("</h") + level + ">";
+            } else if (tight) {
+                md_inline(text, out);
+            } else {
+                *out += "<p>";
+                md_inline(text, out);
+                *out += "</p>";
+            }
+            break;
+        }
+
+        case MD_HEADING: {
+            std::string_view content;
+            std::string level = std::to_string(md_atx_level(lines[block.begin], &content));
+            *out += "<h" + level + ">";
+            md_inline(content, out);
+            *out += "</h" + level + ">";
+            break;
+        }
+
+        case MD_FENCE: {
+            MdFence fence;
+            md_fence_open(lines[block.begin], &fence);
+            size_t end = block.end;
+            if (end - 1 > block.begin && md_fence_close(lines[end - 1], fence)) end--;
+            md_code_block(lines, block.begin + 1, end, fence.indent, fence.info, out);
+            break;
+        }
+
+        case MD_INDENTED:
+            md_code_block(lines, block.begin, block.end, 4, std::string_view(), out);
+            break;
+
+        case MD_RULE:
+            *out += "<hr />";
+            break;
+
+        case MD_QUOTE: {
+            MdLines inner;
+            for (size_t i = block.begin; i < block.end; i++) inner.push_back(md_quote_strip(lines[i]));
+            *out += "<blockquote>\n";
+            md_render_blocks(inner, false, out);
+            *out += "\n</blockquote>";
+            break;
+        }
+
+        case MD_LIST:
+            md_list(lines, block.begin, block.end, out);
+            break;
+
+        case MD_TABLE:
+            md_table(lines, block.begin, block.end, out);
+            break;
+    }
+}
+
+// Helper: Append the blocks of lines, separated by newlines
+static void md_render_blocks(const MdLines& lines, bool tight, std::string* out) {
+    std::vector<MdBlock> blocks;
+    md_split_blocks(lines, &blocks);
+    for (size_t b = 0; b < blocks.size(); b++) {
+        if (b > 0) out->push_back('\n');
+        md_render_block(lines, blocks[b], tight, out);
+    }
+}
+
+std::string markdown_render(std::string_view markdown) {
+    MdLines lines;
+    md_split_lines(markdown, &lines);
+    std::string html;
+    md_render_blocks(lines, false, &html);
+    if (!html.empty()) html.push_back('\n');
+    return html;
+}
+
+// ----------------------------------------------------------------------------
+// Streaming
+// ----------------------------------------------------------------------------
+
+void BerdCoreMarkdownStream::append(const char* data, size_t length, std::vector<Block>* updates) {
+    text_.append(data, length);
+    update(false, updates);
+}
+
+void BerdCoreMarkdownStream::finish(std::vector<Block>* updates) {
+    update(true, updates);
+}
+
+void BerdCoreMarkdownStream::update(bool finished, std::vector<Block>* updates) {
+    std::string_view tail(text_.data() + stable_, text_.size() - stable_);
+    MdLines lines;
+    md_split_lines(tail, &lines);
+    std::vector<MdBlock> blocks;
+    md_split_blocks(lines, &blocks);
+
+    // A block is settled once the next block has started on a complete line
+    // and the line after that is complete too (a table header needs the
+    // delimiter row below it before it can end a paragraph)
+    size_t complete = lines.size() - (!tail.empty() && tail.back() != '\n' ? 1 : 0);
+    size_t settled = 0;
+    if (finished) {
+        settled = blocks.size();
+    } else {
+        while (settled + 1 < blocks.size() && blocks[settled + 1].begin + 1 < complete) settled++;
+    }
+
+    for (size_t b = 0; b < settled; b++) {
+        Block block;
+        block.index = final_count_ + b;
+        block.final = true;
+        md_render_block(lines, blocks[b], false, &block.html);
+        updates->push_back(std::move(block));
+    }
+
+    for (size_t b = settled; b < blocks.size(); b++) {
+        std::string html;
+        md_render_block(lines, blocks[b], false, &html);
+        // open_ is still indexed from the old final_count_
+        size_t slot = b;
+        if (slot < open_.size() && open_[slot] == html) continue;
+
+        Block block;
+        block.index = final_count_ + b;
+        block.final = false;
+        block.html = html;
+        updates->push_back(std::move(block));
+        if (slot >= open_.size()) open_.resize(slot + 1);
+        open_[slot] = std::move(html);
+    }
+
+    // Drop the settled blocks and any open block that merged into another
+    open_.erase(open_.begin(), open_.begin() + std::min(settled, open_.size()));
+    open_.resize(blocks.size() - settled);
+
+    if (settled > 0) {
+        stable_ = settled < blocks.size() ? stable_ + (size_t)(lines[blocks[settled].begin].data() - tail.data())
+                                          : text_.size();
+        final_count_ += settled;
+    }
+}
+
+// ----------------------------------------------------------------------------
+// Code block scanning
+// ----------------------------------------------------------------------------
+
+void markdown_scan_code(const char* text, size_t length, bool final, berdcore_code_scanner_t* scanner,
+                        bool (*emit)(const berdcore_code_span_t* span, void* user_data), void* user_data) {
+    size_t pos = scanner->position;
+    while (pos < length) {
+        const char* nl = static_cast<const char*>(memchr(text + pos, '\n', length - pos));
+        if (!nl && !final) break;
+        size_t end = nl ? (size_t)(nl - text) : length;
+        size_t next = nl ? end + 1 : length;
+        std::string_view line(text + pos, end - pos);
+        if (!line.empty() && line.back() == '\r') line.remove_suffix(1);
+
+        MdFence fence;
+        berdcore_code_span_t& current = scanner->current;
+        if (!scanner->in_block) {
+            // Any indentation, so fences nested in list items are found too
+            if (md_fence_open(line, &fence, SIZE_MAX)) {
+                std::string_view language = fence.info.substr(0, std::min(fence.info.size(), fence.info.find_first_of(" \t")));
+                scanner->in_block = 1;
+                scanner->fence_char = fence.ch;
+                scanner->fence_length = fence.length;
+                current.language_offset = language.empty() ? pos : (size_t)(language.data() - text);
+                current.language_length = language.size();
+                current.code_offset = next;
+                current.code_length = 0;
+                current.indent = fence.indent;
+                current.is_closed = 0;
+            }
+        } else {
+            fence.ch = scanner->fence_char;
+            fence.length = scanner->fence_length;
+            if (md_fence_close(line, fence, SIZE_MAX)) {
+                current.code_length = pos - current.code_offset;
+                current.is_closed = 1;
+                scanner->in_block = 0;
+                scanner->position = next;
+                if (!emit(&current, user_data)) return;
+                pos = next;
+                continue;
+            }
+            current.code_length = next - current.code_offset;
+        }
+        pos = next;
+        scanner->position = pos;
+    }
+
+    // Input ended inside a block: report it unclosed
+    if (final && scanner->in_block) {
+        scanner->in_block = 0;
+        emit(&scanner->current, user_data);
+    }
+}
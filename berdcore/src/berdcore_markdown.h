@@ -0,0 +1,72 @@
+#ifndef BERDCORE_MARKDOWN_H
+#define BERDCORE_MARKDOWN_H
+
+#include "berdcore.h"
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// ============================================================================
+// MARKDOWN TO HTML (internal)
+// ============================================================================
+// A CommonMark subset plus the GFM extensions models use most: ATX and
+// setext headings, paragraphs, fenced and indented code, block quotes,
+// nested lists, thematic breaks and tables; code spans, emphasis, strong,
+// strikethrough, links, images, autolinks and hard breaks inline. Raw HTML
+// is escaped rather than passed through, since the input is model output.
+//
+// The document is split into top-level blocks that are rendered
+// independently. The stream keeps the offset of the first block that can
+// still change, so each append re-parses only that tail and reports only
+// the blocks whose HTML changed.
+// ============================================================================
+
+/**
+ * Render a whole document
+ */
+std::string markdown_render(std::string_view markdown);
+
+class BerdCoreMarkdownStream {
+public:
+    struct Block {
+        size_t index;      // position among the top-level blocks
+        std::string html;
+        bool final;        // later text cannot change this block
+    };
+
+    BerdCoreMarkdownStream() : stable_(0), final_count_(0) {}
+
+    /**
+     * Append text and collect the blocks that became final or changed
+     */
+    void append(const char* data, size_t length, std::vector<Block>* updates);
+
+    /**
+     * End of input: every remaining block is reported as final
+     */
+    void finish(std::vector<Block>* updates);
+
+    // Top-level blocks in the document so far; this can shrink by one when
+    // a line that looked like a new block turns out to continue the last one
+    size_t block_count() const { return final_count_ + open_.size(); }
+
+private:
+    void update(bool finished, std::vector<Block>* updates);
+
+    std::string text_;
+    size_t stable_;                  // offset of the first block that may change
+    size_t final_count_;             // blocks before stable_
+    std::vector<std::string> open_;  // last HTML reported for each open block
+};
+
+/**
+ * Scan for fenced code blocks from scanner->position, one line at a time.
+ * Only complete lines are consumed unless final. emit is called for each
+ * block that closes (and, when final, for one left open); returning false
+ * stops the scan just past that block so a later call resumes there.
+ */
+void markdown_scan_code(const char* text, size_t length, bool final, berdcore_code_scanner_t* scanner,
+                        bool (*emit)(const berdcore_code_span_t* span, void* user_data), void* user_data);
+
+#endif // BERDCORE_MARKDOWN_H
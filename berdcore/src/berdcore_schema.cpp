@@ -0,0 +1,617 @@
+#include "berdcore_schema.h"
+#include "berdcore_json.h"
+#include <json/json.h>
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <list>
+#include <mutex>
+
+// Compiled schemas kept for reuse, keyed by their text
+static const size_t SCHEMA_CACHE_ENTRIES = 16;
+
+// Deepest nesting accepted, in the schema and in the value
+static const size_t SCHEMA_MAX_DEPTH = 64;
+
+static std::mutex g_schema_mutex;
+static std::list<std::pair<std::string, std::shared_ptr<const BerdCoreSchema>>> g_schema_cache;  // most recent first
+
+// Object states
+enum { OBJ_KEY_OR_END, OBJ_KEY, OBJ_COLON, OBJ_VALUE, OBJ_COMMA_OR_END };
+
+// Array states
+enum { ARR_VALUE_OR_END, ARR_VALUE, ARR_COMMA_OR_END };
+
+// Number grammar states; ZERO, INT, FRAC and EXP can end a number
+enum { NUM_MINUS, NUM_ZERO, NUM_INT, NUM_DOT, NUM_FRAC, NUM_EXP_MARK, NUM_EXP_SIGN, NUM_EXP };
+
+// String states: 0 plain, 1 after a backslash, 2 to 5 reading \u digits,
+// 6 to 8 waiting for 1 to 3 more bytes of a UTF-8 sequence
+static const uint8_t STR_PLAIN = 0;
+static const uint8_t STR_ESCAPE = 1;
+static const uint8_t STR_HEX = 2;
+static const uint8_t STR_UTF8 = 6;
+
+// Helper: SCHEMA_* bit for a type name, 0 if unknown
+static uint32_t schema_type_bit(const std::string& name) {
+    if (name == "object") return SCHEMA_OBJECT;
+    if (name == "array") return SCHEMA_ARRAY;
+    if (name == "string") return SCHEMA_STRING;
+    if (name == "integer") return SCHEMA_INTEGER;
+    if (name == "number") return SCHEMA_NUMBER;
+    if (name == "boolean") return SCHEMA_BOOLEAN;
+    if (name == "null") return SCHEMA_NULL;
+    return 0;
+}
+
+// Helper: Compact JSON for a scalar; false for objects and arrays
+static bool schema_scalar_json(const Json::Value& v, std::string* out) {
+    out->clear();
+    if (v.isString()) {
+        std::string s = v.asString();
+        json_append_quoted(out, s.data(), s.size());
+    } else if (v.isBool()) {
+        *out = v.asBool() ? "true" : "false";
+    } else if (v.isNull()) {
+        *out = "null";
+    } else if (v.isInt64()) {
+        *out = std::to_string(v.asInt64());
+    } else if (v.isUInt64()) {
+        *out = std::to_string(v.asUInt64());
+    } else if (v.isDouble()) {
+        Json::StreamWriterBuilder writer;
+        writer["indentation"] = "";
+        *out = Json::writeString(writer, v);
+    } else {
+        return false;
+    }
+    return true;
+}
+
+// Helper: Read a non-negative size keyword into *out if present
+static void schema_size(const Json::Value& v, const char* key, size_t* out) {
+    const Json::Value& n = v[key];
+    if (n.isUInt64()) *out = (size_t)n.asUInt64();
+}
+
+// Helper: Compile v into schema->nodes and return its index, or -1 for a
+// schema that allows any value
+static int schema_compile_node(const Json::Value& v, size_t depth, BerdCoreSchema* schema,
+                               std::string* error) {
+    if (!v.isObject() || !error->empty()) return -1;
+    if (depth > SCHEMA_MAX_DEPTH) {
+        *error = "JSON schema nests too deeply";
+        return -1;
+    }
+
+    int index = (int)schema->nodes.size();
+    schema->nodes.emplace_back();
+    // Sub-schemas append to nodes, so fill a copy and store it at the end
+    BerdCoreSchemaNode n;
+
+    const Json::Value& type = v["type"];
+    if (type.isString() || type.isArray()) {
+        Json::Value names = type;
+        if (type.isString()) {
+            names = Json::Value(Json::arrayValue);
+            names.append(type);
+        }
+        for (const auto& name : names) {
+            uint32_t bit = name.isString() ? schema_type_bit(name.asString()) : 0;
+            if (!bit) {
+                *error = "Unknown JSON schema type: " + (name.isString() ? name.asString() : name.toStyledString());
+                return -1;
+            }
+            n.types |= bit;
+        }
+    }
+
+    // Non-scalar enum members are not enforced, so such an enum is dropped
+    if (v.isMember("const")) {
+        n.enum_values.emplace_back();
+        if (!schema_scalar_json(v["const"], &n.enum_values.back())) n.enum_values.clear();
+    } else if (v["enum"].isArray()) {
+        for (const auto& value : v["enum"]) {
+            n.enum_values.emplace_back();
+            if (!schema_scalar_json(value, &n.enum_values.back())) {
+                n.enum_values.clear();
+                break;
+            }
+        }
+    }
+
+    const Json::Value& properties = v["properties"];
+    if (properties.isObject()) {
+        for (const auto& name : properties.getMemberNames()) {
+            BerdCoreSchemaProperty prop;
+            json_append_quoted(&prop.key, name.data(), name.size());
+            prop.node = schema_compile_node(properties[name], depth + 1, schema, error);
+            prop.required = false;
+            n.properties.push_back(std::move(prop));
+        }
+    }
+    if (v["required"].isArray()) {
+        for (const auto& name : v["required"]) {
+            if (!name.isString()) continue;
+            std::string key;
+            std::string s = name.asString();
+            json_append_quoted(&key, s.data(), s.size());
+            auto it = std::find_if(n.properties.begin(), n.properties.end(),
+                                   [&](const BerdCoreSchemaProperty& p) { return p.key == key; });
+            if (it != n.properties.end()) {
+                it->required = true;
+            } else {
+                n.properties.push_back({key, -1, true});
+            }
+        }
+    }
+
+    const Json::Value& additional = v["additionalProperties"];
+    if (additional.isBool()) {
+        n.additional = additional.asBool();
+    } else if (additional.isObject()) {
+        n.additional_node = schema_compile_node(additional, depth + 1, schema, error);
+    }
+    if (v["items"].isObject()) {
+        n.items = schema_compile_node(v["items"], depth + 1, schema, error);
+    }
+    schema_size(v, "minItems", &n.min_items);
+    schema_size(v, "maxItems", &n.max_items);
+    schema_size(v, "minLength", &n.min_length);
+    schema_size(v, "maxLength", &n.max_length);
+
+    schema->nodes[index] = std::move(n);
+    return index;
+}
+
+std::shared_ptr<const BerdCoreSchema> schema_compile(const char* schema_json, std::string* error) {
+    std::string text(schema_json);
+    {
+        std::lock_guard<std::mutex> lock(g_schema_mutex);
+        for (auto it = g_schema_cache.begin(); it != g_schema_cache.end(); ++it) {
+            if (it->first == text) {
+                g_schema_cache.splice(g_schema_cache.begin(), g_schema_cache, it);
+                return it->second;
+            }
+        }
+    }
+
+    Json::CharReaderBuilder reader;
+    std::unique_ptr<Json::CharReader> parser(reader.newCharReader());
+    Json::Value root;
+    std::string errs;
+    if (!parser->parse(text.data(), text.data() + text.size(), &root, &errs)) {
+        *error = "Invalid JSON schema: " + errs.substr(0, errs.find('\n'));
+        return nullptr;
+    }
+    if (!root.isObject() && !root.isBool()) {
+        *error = "A JSON schema must be an object";
+        return nullptr;
+    }
+
+    auto schema = std::make_shared<BerdCoreSchema>();
+    error->clear();
+    schema->root = schema_compile_node(root, 0, schema.get(), error);
+    if (!error->empty()) {
+        return nullptr;
+    }
+
+    std::lock_guard<std::mutex> lock(g_schema_mutex);
+    g_schema_cache.emplace_front(std::move(text), schema);
+    if (g_schema_cache.size() > SCHEMA_CACHE_ENTRIES) {
+        g_schema_cache.pop_back();
+    }
+    return schema;
+}
+
+// Helper: Whether c is JSON whitespace
+static bool schema_space(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+BerdCoreSchemaValidator::BerdCoreSchemaValidator(std::shared_ptr<const BerdCoreSchema> schema)
+    : schema_(std::move(schema)), status_(MORE), started_(false), in_fence_(false),
+      fence_seen_(false), offset_(0), scalar_(NONE), scalar_node_(-1), scalar_state_(0),
+      literal_(nullptr), code_points_(0) {}
+
+BerdCoreSchemaValidator::Status BerdCoreSchemaValidator::feed(const char* data, size_t length) {
+    for (size_t i = 0; i < length && status_ == MORE; i++) {
+        char c = data[i];
+        if (!started_) {
+            // Models often wrap the value in a ```json fence
+            if (in_fence_) {
+                if (c == '\n') in_fence_ = false;
+                offset_++;
+                continue;
+            }
+            if (c == '`' && !fence_seen_) {
+                in_fence_ = fence_seen_ = true;
+                offset_++;
+                continue;
+            }
+            if (schema_space(c)) {
+                offset_++;
+                continue;
+            }
+            started_ = true;
+        }
+
+        int consumed = step(c);
+        if (consumed < 0) {
+            status_ = INVALID;
+            break;
+        }
+        if (consumed) {
+            value_.push_back(c);
+            offset_++;
+        }
+    }
+    return status_;
+}
+
+BerdCoreSchemaValidator::Status BerdCoreSchemaValidator::finish() {
+    if (status_ != MORE) return status_;
+
+    bool number_done = scalar_ == NUMBER && (scalar_state_ == NUM_ZERO || scalar_state_ == NUM_INT ||
+                                             scalar_state_ == NUM_FRAC || scalar_state_ == NUM_EXP);
+    if (number_done && stack_.empty() && enum_allows(true)) {
+        value_done();
+    } else {
+        status_ = INVALID;
+    }
+    return status_;
+}
+
+std::string BerdCoreSchemaValidator::forced() const {
+    if (status_ != MORE || !started_) return std::string();
+
+    // The scalar in progress must have a single way to end
+    std::string out;
+    bool child_open = scalar_ != NONE;
+    if (scalar_ == LITERAL) {
+        out = literal_ + scalar_text_.size();
+    } else if (scalar_ == STRING) {
+        const BerdCoreSchemaNode* n = node(scalar_node_);
+        if (!n || n->enum_values.empty()) return std::string();
+        const std::string* match = nullptr;
+        for (const auto& v : n->enum_values) {
+            if (v.compare(0, scalar_text_.size(), scalar_text_) != 0) continue;
+            if (match) return std::string();
+            match = &v;
+        }
+        if (!match) return std::string();
+        out = match->substr(scalar_text_.size());
+    } else if (child_open) {
+        return std::string();
+    }
+
+    // Then every enclosing container must be unable to take another item
+    for (size_t i = stack_.size(); i-- > 0;) {
+        const Frame& f = stack_[i];
+        const BerdCoreSchemaNode* n = node(f.node);
+        bool after_value = i == stack_.size() - 1 && !child_open;
+        if (after_value && f.state != (f.object ? (int)OBJ_COMMA_OR_END : (int)ARR_COMMA_OR_END)) {
+            return std::string();
+        }
+        if (!n) return std::string();
+        if (f.object) {
+            if (n->additional || f.count < n->properties.size()) return std::string();
+            out.push_back('}');
+        } else {
+            if (f.count + (after_value ? 0 : 1) < n->max_items) return std::string();
+            out.push_back(']');
+        }
+    }
+    return out;
+}
+
+// Helper: Process one byte of the value: 1 consumed, 0 ended a top-level
+// number without being part of it, -1 invalid
+int BerdCoreSchemaValidator::step(char c) {
+    if (scalar_ != NONE) {
+        bool reprocess = false;
+        if (!scalar_step(c, &reprocess)) return -1;
+        if (!reprocess) return 1;
+        if (status_ == COMPLETE) return 0;
+    }
+    if (stack_.empty()) {
+        return begin_value(c, schema_->root) ? 1 : -1;
+    }
+
+    Frame& f = stack_.back();
+    const BerdCoreSchemaNode* n = node(f.node);
+    if (schema_space(c)) return 1;
+    bool ok = false;
+    if (f.object) {
+        switch (f.state) {
+            case OBJ_KEY_OR_END:
+                if (c == '}') {
+                    ok = close_frame();
+                    break;
+                }
+                // fallthrough
+            case OBJ_KEY:
+                if (c == '"') {
+                    scalar_ = KEY;
+                    scalar_text_.assign(1, c);
+                    scalar_state_ = STR_PLAIN;
+                    ok = key_allowed();
+                }
+                break;
+            case OBJ_COLON:
+                if (c == ':') {
+                    f.state = OBJ_VALUE;
+                    ok = true;
+                }
+                break;
+            case OBJ_VALUE:
+                ok = begin_value(c, f.value_node);
+                break;
+            case OBJ_COMMA_OR_END:
+                if (c == '}') {
+                    ok = close_frame();
+                } else if (c == ',') {
+                    // No key can follow once every allowed one is in
+                    f.state = OBJ_KEY;
+                    ok = !n || n->additional || f.count < n->properties.size();
+                }
+                break;
+        }
+    } else {
+        switch (f.state) {
+            case ARR_VALUE_OR_END:
+                if (c == ']') {
+                    ok = close_frame();
+                    break;
+                }
+                // fallthrough
+            case ARR_VALUE:
+                ok = (!n || f.count < n->max_items) && begin_value(c, n ? n->items : -1);
+                break;
+            case ARR_COMMA_OR_END:
+                if (c == ']') {
+                    ok = close_frame();
+                } else if (c == ',') {
+                    f.state = ARR_VALUE;
+                    ok = !n || f.count < n->max_items;
+                }
+                break;
+        }
+    }
+    return ok ? 1 : -1;
+}
+
+// Helper: Start the value whose first byte is c
+bool BerdCoreSchemaValidator::begin_value(char c, int index) {
+    const BerdCoreSchemaNode* n = node(index);
+    uint32_t types = n ? n->types : 0;
+    bool has_enum = n && !n->enum_values.empty();
+    auto allowed = [&](uint32_t bits) { return types == 0 || (types & bits) != 0; };
+
+    if (c == '{' || c == '[') {
+        bool object = c == '{';
+        if (!allowed(object ? SCHEMA_OBJECT : SCHEMA_ARRAY) || has_enum ||
+            stack_.size() >= SCHEMA_MAX_DEPTH) {
+            return false;
+        }
+        Frame f;
+        f.object = object;
+        f.state = object ? (uint8_t)OBJ_KEY_OR_END : (uint8_t)ARR_VALUE_OR_END;
+        f.node = index;
+        f.value_node = -1;
+        f.count = 0;
+        if (object && n) f.seen.assign(n->properties.size(), false);
+        stack_.push_back(std::move(f));
+        return true;
+    }
+
+    scalar_node_ = index;
+    scalar_text_.assign(1, c);
+    if (c == '"') {
+        if (!allowed(SCHEMA_STRING)) return false;
+        scalar_ = STRING;
+        scalar_state_ = STR_PLAIN;
+        code_points_ = 0;
+    } else if (c == 't' || c == 'f' || c == 'n') {
+        if (!allowed(c == 'n' ? SCHEMA_NULL : SCHEMA_BOOLEAN)) return false;
+        scalar_ = LITERAL;
+        literal_ = c == 't' ? "true" : c == 'f' ? "false" : "null";
+    } else if (c == '-' || (c >= '0' && c <= '9')) {
+        if (!allowed(SCHEMA_INTEGER | SCHEMA_NUMBER)) return false;
+        scalar_ = NUMBER;
+        scalar_state_ = c == '-' ? NUM_MINUS : c == '0' ? NUM_ZERO : NUM_INT;
+    } else {
+        return false;
+    }
+    return enum_allows(false);
+}
+
+// Helper: Advance the scalar in progress by c. *reprocess is set when c
+// ended a number and belongs to whatever follows it.
+bool BerdCoreSchemaValidator::scalar_step(char c, bool* reprocess) {
+    const BerdCoreSchemaNode* n = node(scalar_node_);
+
+    if (scalar_ == STRING || scalar_ == KEY) {
+        unsigned char u = (unsigned char)c;
+        if (scalar_state_ == STR_PLAIN) {
+            if (c == '"') {
+                scalar_text_.push_back(c);
+                if (scalar_ == KEY) return end_key();
+                if ((n && code_points_ < n->min_length) || !enum_allows(true)) return false;
+                value_done();
+                return true;
+            }
+            if (u < 0x20) return false;
+            if (c == '\\') scalar_state_ = STR_ESCAPE;
+            if (u >= 0x80) {
+                // Lead byte: how many continuation bytes follow
+                int more = (u >= 0xC2 && u <= 0xDF) ? 1 : (u >= 0xE0 && u <= 0xEF) ? 2 :
+                           (u >= 0xF0 && u <= 0xF4) ? 3 : 0;
+                if (!more) return false;
+                scalar_state_ = (uint8_t)(STR_UTF8 - 1 + more);
+            }
+            code_points_++;
+        } else if (scalar_state_ >= STR_UTF8) {
+            if ((u & 0xC0) != 0x80) return false;
+            scalar_state_ = scalar_state_ == STR_UTF8 ? STR_PLAIN : scalar_state_ - 1;
+        } else if (scalar_state_ == STR_ESCAPE) {
+            if (c == 'u') {
+                scalar_state_ = STR_HEX;
+            } else if (c && strchr("\"\\/bfnrt", c)) {
+                scalar_state_ = STR_PLAIN;
+            } else {
+                return false;
+            }
+        } else {
+            if (!isxdigit(u)) return false;
+            scalar_state_ = scalar_state_ == STR_HEX + 3 ? STR_PLAIN : scalar_state_ + 1;
+        }
+        scalar_text_.push_back(c);
+        if (scalar_ == KEY) return key_allowed();
+        if (n && code_points_ > n->max_length) return false;
+        return enum_allows(false);
+    }
+
+    if (scalar_ == LITERAL) {
+        if (c != literal_[scalar_text_.size()]) return false;
+        scalar_text_.push_back(c);
+        if (!enum_allows(false)) return false;
+        if (!literal_[scalar_text_.size()]) value_done();
+        return true;
+    }
+
+    // NUMBER: -?(0|[1-9][0-9]*)(.[0-9]+)?([eE][+-]?[0-9]+)?
+    bool real = !n || n->types == 0 || (n->types & SCHEMA_NUMBER);
+    bool digit = c >= '0' && c <= '9';
+    bool exponent = (c == 'e' || c == 'E') && real;
+    int next = -1;
+    switch (scalar_state_) {
+        case NUM_MINUS:
+            if (digit) next = c == '0' ? NUM_ZERO : NUM_INT;
+            break;
+        case NUM_ZERO:
+            // JSON has no leading zeros
+            if (digit) return false;
+            // fallthrough
+        case NUM_INT:
+            if (digit) next = NUM_INT;
+            else if (c == '.' && real) next = NUM_DOT;
+            else if (exponent) next = NUM_EXP_MARK;
+            break;
+        case NUM_DOT:
+            if (digit) next = NUM_FRAC;
+            break;
+        case NUM_FRAC:
+            if (digit) next = NUM_FRAC;
+            else if (exponent) next = NUM_EXP_MARK;
+            break;
+        case NUM_EXP_MARK:
+            if (c == '+' || c == '-') next = NUM_EXP_SIGN;
+            else if (digit) next = NUM_EXP;
+            break;
+        case NUM_EXP_SIGN:
+        case NUM_EXP:
+            if (digit) next = NUM_EXP;
+            break;
+    }
+    if (next >= 0) {
+        scalar_state_ = (uint8_t)next;
+        scalar_text_.push_back(c);
+        return enum_allows(false);
+    }
+
+    // Any other byte ends the number, which must be complete by now. A byte
+    // that reads as more of it ("4.2" for an integer, "0x1") is not an end:
+    // at the top level it would leave a different number than was written.
+    if (scalar_state_ != NUM_ZERO && scalar_state_ != NUM_INT &&
+        scalar_state_ != NUM_FRAC && scalar_state_ != NUM_EXP) {
+        return false;
+    }
+    if (isalnum((unsigned char)c) || c == '.' || c == '+' || c == '-') return false;
+    if (!enum_allows(true)) return false;
+    value_done();
+    *reprocess = true;
+    return true;
+}
+
+// Helper: Whether the scalar so far can still match the node's enum, or
+// when whole, matches it exactly
+bool BerdCoreSchemaValidator::enum_allows(bool whole) const {
+    const BerdCoreSchemaNode* n = node(scalar_node_);
+    if (!n || n->enum_values.empty()) return true;
+    for (const auto& v : n->enum_values) {
+        if (whole ? v == scalar_text_ : v.compare(0, scalar_text_.size(), scalar_text_) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Helper: Whether the key so far can still name a property that is allowed
+bool BerdCoreSchemaValidator::key_allowed() const {
+    const Frame& f = stack_.back();
+    const BerdCoreSchemaNode* n = node(f.node);
+    if (!n || n->additional) return true;
+    for (size_t i = 0; i < n->properties.size(); i++) {
+        if (!f.seen[i] && n->properties[i].key.compare(0, scalar_text_.size(), scalar_text_) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Helper: A key closed; look up the schema for its value
+bool BerdCoreSchemaValidator::end_key() {
+    Frame& f = stack_.back();
+    const BerdCoreSchemaNode* n = node(f.node);
+    scalar_ = NONE;
+    f.value_node = -1;
+    if (n) {
+        size_t i = 0;
+        while (i < n->properties.size() && n->properties[i].key != scalar_text_) i++;
+        if (i < n->properties.size()) {
+            if (f.seen[i]) return false;
+            f.seen[i] = true;
+            f.value_node = n->properties[i].node;
+        } else if (!n->additional) {
+            return false;
+        } else {
+            f.value_node = n->additional_node;
+        }
+    }
+    f.count++;
+    f.state = OBJ_COLON;
+    return true;
+}
+
+// Helper: Close the innermost container if its constraints are met
+bool BerdCoreSchemaValidator::close_frame() {
+    const Frame& f = stack_.back();
+    const BerdCoreSchemaNode* n = node(f.node);
+    if (n && f.object) {
+        for (size_t i = 0; i < n->properties.size(); i++) {
+            if (n->properties[i].required && !f.seen[i]) return false;
+        }
+    } else if (n && f.count < n->min_items) {
+        return false;
+    }
+    stack_.pop_back();
+    value_done();
+    return true;
+}
+
+// Helper: The innermost value ended
+void BerdCoreSchemaValidator::value_done() {
+    scalar_ = NONE;
+    if (stack_.empty()) {
+        status_ = COMPLETE;
+        return;
+    }
+    Frame& f = stack_.back();
+    if (f.object) {
+        f.state = OBJ_COMMA_OR_END;
+    } else {
+        f.count++;
+        f.state = ARR_COMMA_OR_END;
+    }
+}
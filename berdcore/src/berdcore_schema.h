@@ -0,0 +1,146 @@
+#ifndef BERDCORE_SCHEMA_H
+#define BERDCORE_SCHEMA_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+// ============================================================================
+// JSON SCHEMA CONSTRAINTS (internal)
+// ============================================================================
+// A schema is compiled once into a flat table of nodes and cached by its
+// text, so requests that repeat a schema skip the parse. The validator is a
+// pushdown automaton over that table that consumes the reply byte by byte
+// as tokens arrive. It knows the moment the value is complete, the first
+// byte that no matching value can contain, and when the rest of the value
+// is forced: an enum with one candidate left, a literal partly written,
+// then closing brackets once nothing else is allowed. Only a tail that ends
+// the value counts, because the FFI cannot resume decoding after injected
+// text, so fixed keys in the middle of an object are never forced.
+//
+// Enforced keywords: type (a name or an array of names), properties,
+// required, additionalProperties, items, minItems, maxItems, minLength,
+// maxLength, and enum and const with scalar values. Anything else (anyOf,
+// $ref, patterns, numeric bounds) is accepted and not enforced. The JSON
+// itself is checked strictly, down to leading zeros in numbers and
+// well-formed UTF-8 in strings.
+// ============================================================================
+
+enum {
+    SCHEMA_OBJECT = 1 << 0,
+    SCHEMA_ARRAY = 1 << 1,
+    SCHEMA_STRING = 1 << 2,
+    SCHEMA_INTEGER = 1 << 3,
+    SCHEMA_NUMBER = 1 << 4,
+    SCHEMA_BOOLEAN = 1 << 5,
+    SCHEMA_NULL = 1 << 6,
+};
+
+struct BerdCoreSchemaProperty {
+    std::string key;   // the name as a quoted JSON string
+    int node;          // -1 = any value
+    bool required;
+};
+
+struct BerdCoreSchemaNode {
+    uint32_t types;                                  // SCHEMA_* bits, 0 = any type
+    std::vector<BerdCoreSchemaProperty> properties;
+    bool additional;                                 // keys outside properties allowed
+    int additional_node;
+    int items;
+    size_t min_items, max_items;
+    size_t min_length, max_length;                   // in code points
+    std::vector<std::string> enum_values;            // compact JSON; empty = no enum
+
+    BerdCoreSchemaNode()
+        : types(0), additional(true), additional_node(-1), items(-1),
+          min_items(0), max_items(SIZE_MAX), min_length(0), max_length(SIZE_MAX) {}
+};
+
+struct BerdCoreSchema {
+    std::vector<BerdCoreSchemaNode> nodes;
+    int root;  // -1 = any JSON value
+};
+
+/**
+ * Compile a schema, or return the cached compilation of the same text.
+ * Returns nullptr with a message in *error if it is not a usable schema.
+ */
+std::shared_ptr<const BerdCoreSchema> schema_compile(const char* schema_json, std::string* error);
+
+class BerdCoreSchemaValidator {
+public:
+    enum Status { MORE, COMPLETE, INVALID };
+
+    explicit BerdCoreSchemaValidator(std::shared_ptr<const BerdCoreSchema> schema);
+
+    /**
+     * Consume generated text. Whitespace and one Markdown fence line before
+     * the value are skipped; nothing after the value is looked at.
+     */
+    Status feed(const char* data, size_t length);
+
+    /**
+     * End of generation: completes a number still being written
+     */
+    Status finish();
+
+    /**
+     * The rest of the value, when every matching continuation is that text:
+     * the end of a scalar with one way left to finish, followed by the
+     * closing brackets of containers that cannot take another item. Empty
+     * otherwise, including whenever a key or value is still to be written.
+     */
+    std::string forced() const;
+
+    Status status() const { return status_; }
+    const std::string& value() const { return value_; }
+
+    // Reply bytes consumed; on INVALID, the offset of the offending byte
+    size_t offset() const { return offset_; }
+
+private:
+    enum Scalar { NONE, STRING, KEY, NUMBER, LITERAL };
+
+    struct Frame {
+        bool object;
+        uint8_t state;
+        int node;
+        int value_node;           // schema for the value after the current key
+        size_t count;             // array items or object keys so far
+        std::vector<bool> seen;   // per property
+    };
+
+    const BerdCoreSchemaNode* node(int index) const {
+        return index >= 0 ? &schema_->nodes[index] : nullptr;
+    }
+    int step(char c);
+    bool begin_value(char c, int node);
+    bool scalar_step(char c, bool* reprocess);
+    bool enum_allows(bool whole) const;
+    bool key_allowed() const;
+    bool end_key();
+    bool close_frame();
+    void value_done();
+
+    std::shared_ptr<const BerdCoreSchema> schema_;
+    Status status_;
+    bool started_;
+    bool in_fence_;
+    bool fence_seen_;
+    size_t offset_;
+    std::string value_;
+    std::vector<Frame> stack_;
+
+    // The scalar being written, innermost
+    Scalar scalar_;
+    int scalar_node_;
+    std::string scalar_text_;   // raw JSON text so far
+    uint8_t scalar_state_;      // escape or number grammar state
+    const char* literal_;       // "true", "false" or "null"
+    size_t code_points_;
+};
+
+#endif // BERDCORE_SCHEMA_H
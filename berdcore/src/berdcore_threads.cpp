@@ -0,0 +1,186 @@
+#include "berdcore_threads.h"
+#include <algorithm>
+#include <climits>
+#include <cstdio>
+#include <thread>
+#include <unistd.h>
+#ifdef __APPLE__
+#include <sys/sysctl.h>
+#endif
+
+#ifdef __APPLE__
+// Helper: Read an integer sysctl, or fallback if it does not exist
+static int threads_sysctl(const char* name, int fallback) {
+    int value = 0;
+    size_t size = sizeof(value);
+    if (sysctlbyname(name, &value, &size, nullptr, 0) != 0) return fallback;
+    return value;
+}
+#endif
+
+#ifdef __linux__
+// Helper: Read a number from a sysfs file, -1 if it is missing
+static long threads_sysfs(const char* path) {
+    FILE* f = fopen(path, "r");
+    if (!f) return -1;
+    long value = -1;
+    if (fscanf(f, "%ld", &value) != 1) value = -1;
+    fclose(f);
+    return value;
+}
+#endif
+
+// Helper: Count the cores of each class
+static BerdCoreCpuTopology detect_topology() {
+    BerdCoreCpuTopology t;
+#ifdef __APPLE__
+    // perflevel0 is the fastest class; single-class machines have no perflevel1
+    int logical = threads_sysctl("hw.logicalcpu", (int)std::thread::hardware_concurrency());
+    t.performance_cores = threads_sysctl("hw.perflevel0.logicalcpu", logical);
+    t.efficiency_cores = threads_sysctl("hw.nperflevels", 1) > 1
+        ? threads_sysctl("hw.perflevel1.logicalcpu", 0) : 0;
+#elif defined(__linux__)
+    // Big cores report a higher capacity (or, without it, a higher maximum
+    // frequency). The lowest tier counts as efficiency cores, every other
+    // tier as performance cores.
+    long n = sysconf(_SC_NPROCESSORS_CONF);
+    std::vector<long> rank(n > 0 ? (size_t)n : 0, 0);
+    long low = LONG_MAX;
+    long high = LONG_MIN;
+    for (size_t cpu = 0; cpu < rank.size(); cpu++) {
+        char path[96];
+        snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%zu/cpu_capacity", cpu);
+        rank[cpu] = threads_sysfs(path);
+        if (rank[cpu] < 0) {
+            snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%zu/cpufreq/cpuinfo_max_freq", cpu);
+            rank[cpu] = std::max(threads_sysfs(path), 0L);
+        }
+        low = std::min(low, rank[cpu]);
+        high = std::max(high, rank[cpu]);
+    }
+    for (size_t cpu = 0; cpu < rank.size(); cpu++) {
+        if (high > low && rank[cpu] == low) {
+            t.efficiency_cpus.push_back((int)cpu);
+        } else {
+            t.performance_cpus.push_back((int)cpu);
+        }
+    }
+    t.performance_cores = (int)t.performance_cpus.size();
+    t.efficiency_cores = (int)t.efficiency_cpus.size();
+#else
+    t.performance_cores = (int)std::thread::hardware_concurrency();
+    t.efficiency_cores = 0;
+#endif
+    t.performance_cores = std::max(t.performance_cores, 1);
+    return t;
+}
+
+const BerdCoreCpuTopology& cpu_topology() {
+    static const BerdCoreCpuTopology topology = detect_topology();
+    return topology;
+}
+
+#ifdef __APPLE__
+
+BerdCoreThreadPlacement::BerdCoreThreadPlacement()
+    : saved_(false), saved_qos_(QOS_CLASS_UNSPECIFIED), saved_priority_(0),
+      current_qos_(QOS_CLASS_UNSPECIFIED) {}
+
+BerdCoreThreadPlacement::~BerdCoreThreadPlacement() {
+    if (saved_ && current_qos_ != saved_qos_) {
+        pthread_set_qos_class_self_np(saved_qos_, saved_priority_);
+    }
+}
+
+void BerdCoreThreadPlacement::apply(berdcore_qos_t qos, berdcore_core_preference_t cores, int threads) {
+    (void)threads;  // no way to bound the cores a thread runs on
+    qos_class_t target = QOS_CLASS_UNSPECIFIED;
+    switch (qos) {
+        case BERDCORE_QOS_USER_INTERACTIVE: target = QOS_CLASS_USER_INTERACTIVE; break;
+        case BERDCORE_QOS_USER_INITIATED: target = QOS_CLASS_USER_INITIATED; break;
+        case BERDCORE_QOS_UTILITY: target = QOS_CLASS_UTILITY; break;
+        case BERDCORE_QOS_BACKGROUND: target = QOS_CLASS_BACKGROUND; break;
+        default: break;
+    }
+    // Background work is kept on the efficiency cores; user-initiated work
+    // and above is scheduled on performance cores first
+    if (cores == BERDCORE_CORES_EFFICIENCY) {
+        target = QOS_CLASS_BACKGROUND;
+    } else if (cores == BERDCORE_CORES_PERFORMANCE && target != QOS_CLASS_USER_INTERACTIVE) {
+        target = QOS_CLASS_USER_INITIATED;
+    }
+
+    if (!saved_) {
+        if (target == QOS_CLASS_UNSPECIFIED) return;
+        if (pthread_get_qos_class_np(pthread_self(), &saved_qos_, &saved_priority_) != 0) return;
+        // A thread that never had a class is restored to the default one
+        if (saved_qos_ == QOS_CLASS_UNSPECIFIED) saved_qos_ = QOS_CLASS_DEFAULT;
+        current_qos_ = saved_qos_;
+        saved_ = true;
+    }
+    if (target == QOS_CLASS_UNSPECIFIED) target = saved_qos_;
+    if (target == current_qos_) return;
+    if (pthread_set_qos_class_self_np(target, target == saved_qos_ ? saved_priority_ : 0) == 0) {
+        current_qos_ = target;
+    }
+}
+
+#elif defined(__linux__)
+
+BerdCoreThreadPlacement::BerdCoreThreadPlacement()
+    : saved_(false), current_cores_(BERDCORE_CORES_ANY), current_threads_(0) {}
+
+BerdCoreThreadPlacement::~BerdCoreThreadPlacement() {
+    if (saved_ && (current_cores_ != BERDCORE_CORES_ANY || current_threads_ > 0)) {
+        sched_setaffinity(0, sizeof(saved_mask_), &saved_mask_);
+    }
+}
+
+void BerdCoreThreadPlacement::apply(berdcore_qos_t qos, berdcore_core_preference_t cores, int threads) {
+    (void)qos;  // thread priorities cannot be raised back without privileges
+    threads = std::max(threads, 0);
+    if (cores == current_cores_ && threads == current_threads_) return;
+    if (!saved_) {
+        if (sched_getaffinity(0, sizeof(saved_mask_), &saved_mask_) != 0) return;
+        saved_ = true;
+    }
+    current_cores_ = cores;
+    current_threads_ = threads;
+
+    // Cores of the preferred class first, limited to those the thread was
+    // allowed to use to begin with
+    const BerdCoreCpuTopology& topo = cpu_topology();
+    std::vector<int> order;
+    if (cores == BERDCORE_CORES_EFFICIENCY && !topo.efficiency_cpus.empty()) {
+        order = topo.efficiency_cpus;
+    } else {
+        order = topo.performance_cpus;
+        if (cores == BERDCORE_CORES_ANY) {
+            order.insert(order.end(), topo.efficiency_cpus.begin(), topo.efficiency_cpus.end());
+        }
+    }
+    cpu_set_t mask;
+    CPU_ZERO(&mask);
+    int used = 0;
+    for (int cpu : order) {
+        if (used == threads && threads > 0) break;
+        if (cpu < CPU_SETSIZE && CPU_ISSET(cpu, &saved_mask_)) {
+            CPU_SET(cpu, &mask);
+            used++;
+        }
+    }
+    if (used == 0 || (cores == BERDCORE_CORES_ANY && threads == 0)) {
+        mask = saved_mask_;
+    }
+    sched_setaffinity(0, sizeof(mask), &mask);
+}
+
+#else
+
+BerdCoreThreadPlacement::BerdCoreThreadPlacement() : saved_(false) {}
+
+BerdCoreThreadPlacement::~BerdCoreThreadPlacement() {}
+
+void BerdCoreThreadPlacement::apply(berdcore_qos_t, berdcore_core_preference_t, int) {}
+
+#endif
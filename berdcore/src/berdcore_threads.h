@@ -0,0 +1,63 @@
+#ifndef BERDCORE_THREADS_H
+#define BERDCORE_THREADS_H
+
+#include "berdcore.h"
+#include <vector>
+#ifdef __APPLE__
+#include <pthread.h>
+#include <pthread/qos.h>
+#elif defined(__linux__)
+#include <sched.h>
+#endif
+
+// ============================================================================
+// THREAD PLACEMENT (internal)
+// ============================================================================
+// Cactus runs its kernels on the thread that calls into it and on worker
+// threads it creates itself, so inference is steered by placing the calling
+// thread. On Apple platforms that means its QoS class, which is what picks
+// performance or efficiency cores there (there is no affinity control);
+// engine threads inherit the class of the thread that creates them. On
+// Linux and Android the thread is pinned to cores of the preferred class,
+// and threads created while the mask is in effect inherit it, which bounds
+// how many cores the kernels can occupy.
+// ============================================================================
+
+struct BerdCoreCpuTopology {
+    int performance_cores;
+    int efficiency_cores;
+    std::vector<int> performance_cpus;  // CPU ids, where the OS allows pinning
+    std::vector<int> efficiency_cpus;
+};
+
+/**
+ * Core classes of this machine, detected on first use
+ */
+const BerdCoreCpuTopology& cpu_topology();
+
+// Moves the calling thread and puts it back as it was when destroyed
+class BerdCoreThreadPlacement {
+public:
+    BerdCoreThreadPlacement();
+    ~BerdCoreThreadPlacement();
+
+    /**
+     * Place the calling thread: a QoS class, a core class and at most
+     * threads cores (0 = no limit). Defaults restore the original placement.
+     */
+    void apply(berdcore_qos_t qos, berdcore_core_preference_t cores, int threads);
+
+private:
+    bool saved_;
+#ifdef __APPLE__
+    qos_class_t saved_qos_;
+    int saved_priority_;
+    qos_class_t current_qos_;
+#elif defined(__linux__)
+    cpu_set_t saved_mask_;
+    berdcore_core_preference_t current_cores_;
+    int current_threads_;
+#endif
+};
+
+#endif // BERDCORE_THREADS_H
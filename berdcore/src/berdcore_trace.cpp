@@ -0,0 +1,179 @@
+#include "berdcore.h"
+#include "berdcore_trace.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <json/json.h>
+
+// Events kept per thread; older ones are overwritten
+static const size_t TRACE_RING_CAPACITY = 8192;
+
+std::atomic<bool> g_trace_enabled(false);
+
+struct TraceEvent {
+    const char* name;
+    uint64_t start_ns;
+    uint64_t end_ns;
+    int64_t arg;
+};
+
+// Single-producer ring owned by one thread at a time. head only grows, and
+// the owner writes slot head % capacity before publishing head + 1, so with
+// head at h the slots of events h - capacity + 1 .. h - 1 are complete and
+// the one of event h - capacity may be mid-write. The exporter copies without
+// stopping the owner and re-reads head afterwards to discard slots that were
+// overwritten while it was reading.
+struct TraceRing {
+    TraceEvent events[TRACE_RING_CAPACITY];
+    std::atomic<uint64_t> head;
+    uint64_t clear_mark;  // events before this index were cleared
+    uint32_t tid;
+    bool in_use;
+
+    explicit TraceRing(uint32_t id) : head(0), clear_mark(0), tid(id), in_use(true) {}
+};
+
+// Rings outlive their threads so their events can still be exported; a ring
+// is handed to the next new thread once its owner exits.
+static std::mutex g_rings_mutex;
+static std::vector<std::unique_ptr<TraceRing>> g_rings;
+static uint32_t g_next_tid = 1;
+
+struct TraceRingLease {
+    TraceRing* ring;
+
+    TraceRingLease() : ring(nullptr) {}
+    ~TraceRingLease() {
+        if (!ring) return;
+        std::lock_guard<std::mutex> lock(g_rings_mutex);
+        ring->in_use = false;
+    }
+};
+
+static thread_local TraceRingLease t_ring;
+
+// Helper: The calling thread's ring, claimed on its first event
+static TraceRing* thread_ring() {
+    if (t_ring.ring) return t_ring.ring;
+
+    std::lock_guard<std::mutex> lock(g_rings_mutex);
+    for (const auto& ring : g_rings) {
+        if (!ring->in_use) {
+            ring->in_use = true;
+            ring->tid = g_next_tid++;
+            ring->head.store(0, std::memory_order_relaxed);
+            ring->clear_mark = 0;
+            t_ring.ring = ring.get();
+            return t_ring.ring;
+        }
+    }
+    g_rings.emplace_back(new TraceRing(g_next_tid++));
+    t_ring.ring = g_rings.back().get();
+    return t_ring.ring;
+}
+
+uint64_t trace_now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void trace_record(const char* name, uint64_t start_ns, uint64_t end_ns, int64_t arg) {
+    TraceRing* ring = thread_ring();
+    uint64_t head = ring->head.load(std::memory_order_relaxed);
+    TraceEvent& event = ring->events[head % TRACE_RING_CAPACITY];
+    event.name = name;
+    event.start_ns = start_ns;
+    event.end_ns = end_ns;
+    event.arg = arg;
+    ring->head.store(head + 1, std::memory_order_release);
+}
+
+#ifdef __APPLE__
+os_log_t trace_signpost_log() {
+    static os_log_t log = os_log_create("com.berd.berdcore", OS_LOG_CATEGORY_POINTS_OF_INTEREST);
+    return log;
+}
+#endif
+
+// ============================================================================
+// PUBLIC API
+// ============================================================================
+
+void berdcore_trace_set_enabled(int enabled) {
+    g_trace_enabled.store(enabled != 0, std::memory_order_relaxed);
+}
+
+void berdcore_trace_clear(void) {
+    std::lock_guard<std::mutex> lock(g_rings_mutex);
+    for (const auto& ring : g_rings) {
+        ring->clear_mark = ring->head.load(std::memory_order_acquire);
+    }
+}
+
+// Helper: Oldest event of a ring with the given head that the owner cannot
+// be writing over
+static uint64_t trace_first_complete(uint64_t head) {
+    return head >= TRACE_RING_CAPACITY ? head - TRACE_RING_CAPACITY + 1 : 0;
+}
+
+char* berdcore_trace_export_chrome(void) {
+    Json::Value events(Json::arrayValue);
+    uint64_t origin_ns = UINT64_MAX;
+
+    struct Pending {
+        TraceEvent event;
+        uint32_t tid;
+    };
+    std::vector<Pending> pending;
+    {
+        std::lock_guard<std::mutex> lock(g_rings_mutex);
+        for (const auto& ring : g_rings) {
+            uint64_t head = ring->head.load(std::memory_order_acquire);
+            uint64_t first = trace_first_complete(head);
+            if (first < ring->clear_mark) first = ring->clear_mark;
+
+            size_t copied_from = pending.size();
+            for (uint64_t i = first; i < head; i++) {
+                pending.push_back({ring->events[i % TRACE_RING_CAPACITY], ring->tid});
+            }
+
+            // Drop whatever the owning thread overwrote while we copied
+            uint64_t head_after = ring->head.load(std::memory_order_acquire);
+            uint64_t valid_from = trace_first_complete(head_after);
+            if (valid_from > first) {
+                size_t overwritten = (size_t)std::min<uint64_t>(valid_from - first, head - first);
+                pending.erase(pending.begin() + copied_from, pending.begin() + copied_from + overwritten);
+            }
+        }
+    }
+
+    for (const auto& p : pending) {
+        if (p.event.start_ns < origin_ns) origin_ns = p.event.start_ns;
+    }
+    for (const auto& p : pending) {
+        Json::Value event;
+        event["name"] = p.event.name;
+        event["cat"] = "berdcore";
+        event["ph"] = "X";
+        event["pid"] = 1;
+        event["tid"] = p.tid;
+        event["ts"] = (p.event.start_ns - origin_ns) / 1e3;
+        event["dur"] = (p.event.end_ns - p.event.start_ns) / 1e3;
+        if (p.event.arg) {
+            event["args"]["value"] = static_cast<Json::Int64>(p.event.arg);
+        }
+        events.append(event);
+    }
+
+    Json::Value root;
+    root["traceEvents"] = events;
+    root["displayTimeUnit"] = "ms";
+
+    Json::StreamWriterBuilder writer;
+    writer["indentation"] = "";
+    return strdup(Json::writeString(writer, root).c_str());
+}
@@ -0,0 +1,96 @@
+#ifndef BERDCORE_TRACE_H
+#define BERDCORE_TRACE_H
+
+#include <atomic>
+#include <cstdint>
+#ifdef __APPLE__
+#include <os/signpost.h>
+#endif
+
+// ============================================================================
+// TRACING (internal)
+// ============================================================================
+// Scoped events are written to a per-thread ring buffer without locks and
+// exported on demand as Chrome trace JSON. On Apple platforms every scope is
+// also an os_signpost interval while Instruments is recording. With both
+// off a scope costs one relaxed atomic load.
+//
+// Event names must be string literals (only the pointer is stored).
+// ============================================================================
+
+extern std::atomic<bool> g_trace_enabled;
+
+uint64_t trace_now_ns();
+
+// Store a finished event in the calling thread's ring
+void trace_record(const char* name, uint64_t start_ns, uint64_t end_ns, int64_t arg);
+
+#ifdef __APPLE__
+os_log_t trace_signpost_log();
+#endif
+
+// Helper: Whether scopes should do any work
+inline bool trace_active() {
+#ifdef __APPLE__
+    return g_trace_enabled.load(std::memory_order_relaxed) ||
+           os_signpost_enabled(trace_signpost_log());
+#else
+    return g_trace_enabled.load(std::memory_order_relaxed);
+#endif
+}
+
+// An interval from begin() (or construction) to end() (or destruction).
+// A scope can be restarted after end() to trace consecutive intervals,
+// such as one decode step per token.
+class BerdCoreTraceScope {
+public:
+    explicit BerdCoreTraceScope(const char* name = nullptr, int64_t arg = 0) : name_(nullptr) {
+        if (name) begin(name, arg);
+    }
+    ~BerdCoreTraceScope() { end(); }
+
+    BerdCoreTraceScope(const BerdCoreTraceScope&) = delete;
+    BerdCoreTraceScope& operator=(const BerdCoreTraceScope&) = delete;
+
+    void begin(const char* name, int64_t arg = 0) {
+        end();
+        if (!trace_active()) return;
+        name_ = name;
+        arg_ = arg;
+        start_ns_ = trace_now_ns();
+#ifdef __APPLE__
+        os_log_t log = trace_signpost_log();
+        signpost_ = os_signpost_id_generate(log);
+        os_signpost_interval_begin(log, signpost_, "berdcore", "%{public}s", name);
+#endif
+    }
+
+    void set_arg(int64_t arg) { arg_ = arg; }
+
+    void end() {
+        if (!name_) return;
+#ifdef __APPLE__
+        os_signpost_interval_end(trace_signpost_log(), signpost_, "berdcore", "%{public}s %lld",
+                                 name_, (long long)arg_);
+#endif
+        if (g_trace_enabled.load(std::memory_order_relaxed)) {
+            trace_record(name_, start_ns_, trace_now_ns(), arg_);
+        }
+        name_ = nullptr;
+    }
+
+private:
+    const char* name_;
+    int64_t arg_;
+    uint64_t start_ns_;
+#ifdef __APPLE__
+    os_signpost_id_t signpost_;
+#endif
+};
+
+#define BERDCORE_TRACE_CONCAT_(a, b) a##b
+#define BERDCORE_TRACE_CONCAT(a, b) BERDCORE_TRACE_CONCAT_(a, b)
+#define BERDCORE_TRACE_SCOPE(name) \
+    BerdCoreTraceScope BERDCORE_TRACE_CONCAT(berdcore_trace_scope_, __LINE__)(name)
+
+#endif // BERDCORE_TRACE_H
@@ -0,0 +1,176 @@
+#include "berdcore_weights.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef __APPLE__
+typedef char mincore_vec_t;
+#else
+typedef unsigned char mincore_vec_t;
+#endif
+
+// A read-only mapping of one weight file, only used for hints and residency
+struct MappedWeightFile {
+    void* addr;
+    size_t size;
+};
+
+// Helper: Layer index from names like "layer_12_attn_q.weights" (-1 if none)
+static int parse_layer_index(const std::string& name) {
+    size_t pos = name.find("layer_");
+    if (pos == std::string::npos) pos = name.find("layers.");
+    if (pos == std::string::npos) return -1;
+    
+    const char* digits = name.c_str() + name.find_first_of("_.", pos) + 1;
+    if (*digits < '0' || *digits > '9') return -1;
+    return atoi(digits);
+}
+
+bool weights_scan_files(const std::string& model_path, std::vector<BerdCoreWeightFile>* files) {
+    files->clear();
+    DIR* dir = opendir(model_path.c_str());
+    if (!dir) return false;
+    
+    while (struct dirent* entry = readdir(dir)) {
+        if (entry->d_name[0] == '.') continue;
+        
+        std::string path = model_path + "/" + entry->d_name;
+        struct stat st;
+        if (stat(path.c_str(), &st) != 0 || !S_ISREG(st.st_mode) || st.st_size == 0) {
+            continue;
+        }
+        files->push_back({path, (size_t)st.st_size, parse_layer_index(entry->d_name)});
+    }
+    closedir(dir);
+    
+    std::sort(files->begin(), files->end(), [](const BerdCoreWeightFile& a, const BerdCoreWeightFile& b) {
+        if (a.layer != b.layer) return a.layer < b.layer;
+        return a.path < b.path;
+    });
+    return true;
+}
+
+// Helper: Map a file read-only (addr is null on failure)
+static MappedWeightFile map_weight_file(const BerdCoreWeightFile& file) {
+    MappedWeightFile mapped{nullptr, file.size};
+    int fd = open(file.path.c_str(), O_RDONLY);
+    if (fd < 0) return mapped;
+    
+    void* addr = mmap(nullptr, file.size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (addr != MAP_FAILED) mapped.addr = addr;
+    return mapped;
+}
+
+// Helper: Resident bytes of one mapping
+static size_t mapped_resident_bytes(const MappedWeightFile& mapped) {
+    if (!mapped.addr) return 0;
+    
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    size_t pages = (mapped.size + page - 1) / page;
+    std::vector<mincore_vec_t> vec(pages);
+    if (mincore(mapped.addr, mapped.size, vec.data()) != 0) return 0;
+    
+    size_t resident = 0;
+    for (size_t i = 0; i < pages; i++) {
+        if (vec[i] & 1) resident += page;
+    }
+    return std::min(resident, mapped.size);
+}
+
+size_t weights_resident_bytes(const std::vector<BerdCoreWeightFile>& files) {
+    size_t resident = 0;
+    for (const auto& file : files) {
+        MappedWeightFile mapped = map_weight_file(file);
+        resident += mapped_resident_bytes(mapped);
+        if (mapped.addr) munmap(mapped.addr, mapped.size);
+    }
+    return resident;
+}
+
+void weights_release(const std::vector<BerdCoreWeightFile>& files) {
+#ifdef POSIX_FADV_DONTNEED
+    for (const auto& file : files) {
+        int fd = open(file.path.c_str(), O_RDONLY);
+        if (fd < 0) continue;
+        posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+        close(fd);
+    }
+#else
+    (void)files;
+#endif
+}
+
+void weights_warm(
+    const std::vector<BerdCoreWeightFile>& files,
+    berdcore_warmup_mode_t mode,
+    const std::atomic<bool>& cancel,
+    const BerdCoreWeightProgress& progress
+) {
+    size_t total = 0;
+    for (const auto& file : files) total += file.size;
+    
+    if (mode == BERDCORE_WARMUP_NONE) {
+        progress(weights_resident_bytes(files), total);
+        return;
+    }
+    
+    std::vector<MappedWeightFile> mapped;
+    mapped.reserve(files.size());
+    for (const auto& file : files) {
+        mapped.push_back(map_weight_file(file));
+    }
+    
+    if (mode == BERDCORE_WARMUP_TOUCH) {
+        // Fault every page in layer order; progress counts bytes touched
+        size_t page = (size_t)sysconf(_SC_PAGESIZE);
+        size_t done = 0;
+        for (const auto& m : mapped) {
+            if (cancel) break;
+            if (m.addr) {
+                const volatile unsigned char* bytes = static_cast<const unsigned char*>(m.addr);
+                unsigned char sink = 0;
+                for (size_t off = 0; off < m.size; off += page) {
+                    sink ^= bytes[off];
+                }
+                (void)sink;
+            }
+            done += m.size;
+            progress(done, total);
+        }
+    } else {
+        // Hint everything in layer order so the kernel reads ahead in the
+        // order prefill needs it, then follow actual residency until it
+        // stops growing
+        for (const auto& m : mapped) {
+            if (m.addr) madvise(m.addr, m.size, MADV_WILLNEED);
+        }
+        
+        size_t last = (size_t)-1;
+        int idle_polls = 0;
+        while (!cancel && idle_polls < 20) {
+            size_t resident = 0;
+            for (const auto& m : mapped) resident += mapped_resident_bytes(m);
+            if (resident != last) {
+                progress(resident, total);
+                last = resident;
+                idle_polls = 0;
+            } else {
+                idle_polls++;
+            }
+            if (resident >= total) break;
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        }
+    }
+    
+    for (const auto& m : mapped) {
+        if (m.addr) munmap(m.addr, m.size);
+    }
+}
@@ -0,0 +1,58 @@
+#ifndef BERDCORE_WEIGHTS_H
+#define BERDCORE_WEIGHTS_H
+
+#include "berdcore.h"
+#include <atomic>
+#include <functional>
+#include <string>
+#include <vector>
+
+// ============================================================================
+// WEIGHT PAGING
+// ============================================================================
+// Cactus maps its weight files itself. These helpers only steer the page
+// cache around it: ordering files by layer, issuing madvise hints and
+// measuring how much of the model is actually resident.
+// ============================================================================
+
+struct BerdCoreWeightFile {
+    std::string path;
+    size_t size;
+    int layer;  // -1 for tensors outside the transformer stack
+};
+
+// Progress callback: bytes resident (or touched) so far, total bytes
+typedef std::function<void(size_t, size_t)> BerdCoreWeightProgress;
+
+/**
+ * List the weight files in a model folder
+ * 
+ * Tensors outside the layer stack (embeddings, norms) come first, then layers
+ * in order, which is the order the first prefill touches them.
+ */
+bool weights_scan_files(const std::string& model_path, std::vector<BerdCoreWeightFile>* files);
+
+/**
+ * Bytes of the given files currently resident in the page cache
+ */
+size_t weights_resident_bytes(const std::vector<BerdCoreWeightFile>& files);
+
+/**
+ * Hint that the files' cached pages can be dropped (no-op where unsupported)
+ */
+void weights_release(const std::vector<BerdCoreWeightFile>& files);
+
+/**
+ * Page weights in according to mode, reporting progress as it goes
+ * 
+ * Returns early once cancel becomes true. BERDCORE_WARMUP_NONE only reports
+ * the current residency once.
+ */
+void weights_warm(
+    const std::vector<BerdCoreWeightFile>& files,
+    berdcore_warmup_mode_t mode,
+    const std::atomic<bool>& cancel,
+    const BerdCoreWeightProgress& progress
+);
+
+#endif // BERDCORE_WEIGHTS_H
@@ -0,0 +1,38 @@
+#ifndef BERDCORE_TEST_H
+#define BERDCORE_TEST_H
+
+#include <cstdio>
+#include <string>
+
+// ============================================================================
+// TEST CHECKS
+// ============================================================================
+// Each test is an executable whose main() runs its cases and returns
+// BERDCORE_TEST_RESULT(). A failed check is reported with its location and
+// counted, and the remaining checks still run.
+// ============================================================================
+
+static int g_test_failures = 0;
+
+#define CHECK(cond)                                                              \
+    do {                                                                         \
+        if (!(cond)) {                                                           \
+            fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+            g_test_failures++;                                                   \
+        }                                                                        \
+    } while (0)
+
+#define CHECK_STR(actual, expected)                                              \
+    do {                                                                         \
+        std::string actual_ = (actual);                                          \
+        std::string expected_ = (expected);                                      \
+        if (actual_ != expected_) {                                              \
+            fprintf(stderr, "%s:%d: %s\n  got:      \"%s\"\n  expected: \"%s\"\n", \
+                    __FILE__, __LINE__, #actual, actual_.c_str(), expected_.c_str()); \
+            g_test_failures++;                                                   \
+        }                                                                        \
+    } while (0)
+
+#define BERDCORE_TEST_RESULT() (g_test_failures == 0 ? 0 : 1)
+
+#endif // BERDCORE_TEST_H
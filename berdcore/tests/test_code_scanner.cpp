@@ -0,0 +1,124 @@
+// Fenced code scanning: spans found in one pass, incrementally, and with
+// the scan stopped and resumed must all be the same
+#include "berdcore_markdown.h"
+#include "berdcore_test.h"
+#include <cstring>
+
+struct Found {
+    const char* text;
+    std::vector<berdcore_code_span_t> spans;
+    size_t stop_after;   // emit returns false once this many are found
+};
+
+// Helper: Collect a span
+static bool collect(const berdcore_code_span_t* span, void* user_data) {
+    auto found = static_cast<Found*>(user_data);
+    found->spans.push_back(*span);
+    return found->spans.size() < found->stop_after;
+}
+
+// Helper: Language and code of a span as "lang|code", plus "!" when unclosed
+static std::string describe(const char* text, const berdcore_code_span_t& span) {
+    std::string out(text + span.language_offset, span.language_length);
+    out += "|";
+    out.append(text + span.code_offset, span.code_length);
+    if (!span.is_closed) out += "!";
+    return out;
+}
+
+// Helper: Scan the whole text in one call
+static std::vector<std::string> scan_whole(const std::string& text) {
+    Found found{text.c_str(), {}, SIZE_MAX};
+    berdcore_code_scanner_t scanner;
+    memset(&scanner, 0, sizeof(scanner));
+    markdown_scan_code(text.c_str(), text.size(), true, &scanner, collect, &found);
+    std::vector<std::string> out;
+    for (const auto& span : found.spans) out.push_back(describe(text.c_str(), span));
+    return out;
+}
+
+// Helper: Scan as the text grows one byte at a time, closed blocks only
+// until the final call
+static std::vector<std::string> scan_growing(const std::string& text) {
+    Found found{text.c_str(), {}, SIZE_MAX};
+    berdcore_code_scanner_t scanner;
+    memset(&scanner, 0, sizeof(scanner));
+    for (size_t n = 0; n <= text.size(); n++) {
+        markdown_scan_code(text.c_str(), n, n == text.size(), &scanner, collect, &found);
+    }
+    std::vector<std::string> out;
+    for (const auto& span : found.spans) out.push_back(describe(text.c_str(), span));
+    return out;
+}
+
+// Helper: Scan with the callback stopping after every block
+static std::vector<std::string> scan_resumed(const std::string& text) {
+    Found found{text.c_str(), {}, 0};
+    berdcore_code_scanner_t scanner;
+    memset(&scanner, 0, sizeof(scanner));
+    size_t before;
+    do {
+        before = found.spans.size();
+        found.stop_after = before + 1;
+        markdown_scan_code(text.c_str(), text.size(), true, &scanner, collect, &found);
+    } while (found.spans.size() > before);
+    std::vector<std::string> out;
+    for (const auto& span : found.spans) out.push_back(describe(text.c_str(), span));
+    return out;
+}
+
+// Helper: Check all three scans against the expected blocks
+static void check_blocks(const std::string& text, const std::vector<std::string>& expected) {
+    for (const auto& blocks : {scan_whole(text), scan_growing(text), scan_resumed(text)}) {
+        CHECK(blocks.size() == expected.size());
+        for (size_t i = 0; i < blocks.size() && i < expected.size(); i++) {
+            CHECK_STR(blocks[i], expected[i]);
+        }
+    }
+}
+
+static void test_fences() {
+    check_blocks("```py\nx = 1\n```\n", {"py|x = 1\n"});
+    check_blocks("text\n```\na\n\nb\n```\nmore\n~~~ sh extra\nls\n~~~\n", {"|a\n\nb\n", "sh|ls\n"});
+    // Closing fences need the same character, at least the same length and
+    // nothing after them but spaces
+    check_blocks("````\n```\n~~~~\n```` x\n````  \n", {"|```\n~~~~\n```` x\n"});
+    // Backticks in the info string do not open a fence
+    check_blocks("```a`b\ncode\n", {});
+    check_blocks("``\nnot\n``\n", {});
+    check_blocks("- item\n    ```js\n    f()\n    ```\n", {"js|    f()\n"});
+    check_blocks("```c\r\nint x;\r\n```\r\n", {"c|int x;\r\n"});
+}
+
+static void test_unterminated() {
+    check_blocks("```py\nx = 1\ny", {"py|x = 1\ny!"});
+    check_blocks("intro\n```", {"|!"});
+    check_blocks("```\n```\n```\nopen\n", {"|", "|open\n!"});
+}
+
+static void test_incremental_open_block() {
+    // While not final, an open block reports only its complete lines and
+    // nothing is emitted before it closes
+    std::string text = "```py\nline one\nline tw";
+    Found found{text.c_str(), {}, SIZE_MAX};
+    berdcore_code_scanner_t scanner;
+    memset(&scanner, 0, sizeof(scanner));
+    markdown_scan_code(text.c_str(), text.size(), false, &scanner, collect, &found);
+    CHECK(found.spans.empty());
+    CHECK(scanner.in_block);
+    CHECK_STR(std::string(text.c_str() + scanner.current.code_offset, scanner.current.code_length), "line one\n");
+    CHECK(scanner.position == text.size() - strlen("line tw"));
+
+    text += "o\n```\n";
+    markdown_scan_code(text.c_str(), text.size(), false, &scanner, collect, &found);
+    CHECK(found.spans.size() == 1);
+    CHECK(!scanner.in_block);
+    if (!found.spans.empty()) CHECK_STR(describe(text.c_str(), found.spans[0]), "py|line one\nline two\n");
+}
+
+int main() {
+    test_fences();
+    test_unterminated();
+    test_incremental_open_block();
+    return BERDCORE_TEST_RESULT();
+}
@@ -0,0 +1,113 @@
+// HTML extraction: the text must not depend on how the page was split into
+// chunks, and a budget must never cut a character in half
+#include "berdcore_html.h"
+#include "berdcore_test.h"
+#include <cstring>
+
+// Helper: Extract with the page fed chunk bytes at a time
+static std::string extract(const std::string& html, size_t chunk, size_t budget = 0) {
+    BerdCoreHtmlExtractor extractor(budget);
+    for (size_t i = 0; i < html.size(); i += chunk) {
+        if (!extractor.feed(html.data() + i, std::min(chunk, html.size() - i))) break;
+    }
+    return extractor.finish();
+}
+
+// Helper: Check the text at every chunk size
+static void check_text(const std::string& html, const std::string& expected) {
+    for (size_t chunk : {1, 2, 3, 7, 64, 1 << 20}) {
+        std::string text = extract(html, chunk);
+        if (text != expected) fprintf(stderr, "chunk %zu\n", chunk);
+        CHECK_STR(text, expected);
+    }
+}
+
+// Helper: Whether text is well-formed UTF-8
+static bool valid_utf8(const std::string& text) {
+    for (size_t i = 0; i < text.size();) {
+        unsigned char c = (unsigned char)text[i];
+        size_t n = c < 0x80 ? 1 : (c >> 5) == 0x6 ? 2 : (c >> 4) == 0xE ? 3 : (c >> 3) == 0x1E ? 4 : 0;
+        if (n == 0 || i + n > text.size()) return false;
+        for (size_t k = 1; k < n; k++) {
+            if (((unsigned char)text[i + k] & 0xC0) != 0x80) return false;
+        }
+        i += n;
+    }
+    return true;
+}
+
+static void test_tags_and_whitespace() {
+    check_text("<p>Hello   <b>big</b>\n\n world</p><p>next</p>", "Hello big world\nnext");
+    check_text("<div>a<br>b<br/>c</div>", "a\nb\nc");
+    check_text("<ul><li>one</li><li>two</li></ul>", "one\ntwo");
+    // A '<' that cannot open a tag is text
+    check_text("<p>1 < 2 and a<>b</p>", "1 < 2 and a<>b");
+    check_text("<P CLASS=\"x\">upper</P>", "upper");
+    // An unclosed tag at the end of the page is dropped
+    check_text("text<a href=\"x", "text");
+}
+
+static void test_skipped_content() {
+    check_text("<script>var a = '<p>no</p>';</script>yes", "yes");
+    check_text("<SCRIPT type=x>if (a </b) {}</SCRIPT >after", "after");
+    check_text("<style>p { color: red }</style><nav><a>menu</a></nav>body", "body");
+    check_text("a<!-- hidden <p>x</p> -- still -->b", "ab");
+    check_text("a<!---->b<!-- unterminated", "ab");
+    // A page header is chrome, an article's own header is content
+    check_text("<header>site</header><article><header>Title</header>Body</article>", "Title\nBody");
+}
+
+static void test_entities() {
+    check_text("&amp; &lt;b&gt; &quot;q&quot; &#65;&#x42;&#X43;", "& <b> \"q\" ABC");
+    check_text("caf&eacute; &mdash; &hellip;", "caf\xC3\xA9 \xE2\x80\x94 \xE2\x80\xA6");
+    check_text("a&nbsp;&nbsp;b", "a b");
+    // Unknown, unterminated and out-of-range references
+    check_text("&bogus; & &amp", "&bogus; & &amp");
+    check_text("&#128512;&#xD800;&#0;", "\xF0\x9F\x98\x80\xEF\xBF\xBD\xEF\xBF\xBD");
+}
+
+static void test_main_content() {
+    std::string body(250, 'x');
+    check_text("<div>chrome</div><main><p>" + body + "</p></main><div>more</div>", body);
+    // Too little main content: the whole page is used
+    check_text("<div>chrome</div><main>short</main>", "chrome\nshort");
+}
+
+static void test_budget() {
+    std::string page = "<p>" + std::string(100, 'a') + "</p><p>" + std::string(100, 'b') + "</p>";
+    BerdCoreHtmlExtractor extractor(50);
+    CHECK(!extractor.feed(page.data(), page.size()));
+    CHECK(extractor.full());
+    CHECK(!extractor.feed("more", 4));
+    CHECK(extractor.finish() == std::string(50, 'a'));
+
+    // Whatever the budget and however the page is split, the text is whole
+    // characters only
+    std::string utf8;
+    for (int i = 0; i < 20; i++) utf8 += "\xC3\xA9\xE2\x82\xAC\xF0\x9F\x98\x80 ";
+    for (size_t budget = 1; budget < 40; budget++) {
+        for (size_t chunk : {1, 2, 3, 5, 1000}) {
+            std::string text = extract("<p>" + utf8 + "</p>", chunk, budget);
+            CHECK(text.size() <= budget);
+            CHECK(valid_utf8(text));
+        }
+    }
+}
+
+static void test_is_markup() {
+    CHECK(html_is_markup("text/html; charset=utf-8", "", 0));
+    CHECK(html_is_markup("application/xhtml+xml", "", 0));
+    CHECK(!html_is_markup("text/plain", "<p>", 3));
+    CHECK(html_is_markup(nullptr, "  \n<!doctype html>", 18));
+    CHECK(!html_is_markup("", "plain", 5));
+}
+
+int main() {
+    test_tags_and_whitespace();
+    test_skipped_content();
+    test_entities();
+    test_main_content();
+    test_budget();
+    test_is_markup();
+    return BERDCORE_TEST_RESULT();
+}
@@ -0,0 +1,149 @@
+// JSON writer: exact output for each value kind, and documents that parse
+// back whatever bytes the strings held
+#include "berdcore_json.h"
+#include "berdcore_test.h"
+#include <json/json.h>
+#include <cmath>
+#include <limits>
+#include <memory>
+
+// Helper: s as a quoted JSON string
+static std::string quoted(const std::string& s) {
+    std::string out;
+    json_append_quoted(&out, s.data(), s.size());
+    return out;
+}
+
+// Helper: Whether jsoncpp (strict mode, so an object or array) accepts the
+// document
+static bool parses(const std::string& json, Json::Value* value = nullptr) {
+    Json::CharReaderBuilder builder;
+    Json::CharReaderBuilder::strictMode(&builder.settings_);
+    std::unique_ptr<Json::CharReader> reader(builder.newCharReader());
+    Json::Value root;
+    std::string errors;
+    bool ok = reader->parse(json.data(), json.data() + json.size(), &root, &errors);
+    if (value) *value = root;
+    return ok;
+}
+
+static void test_escapes() {
+    CHECK_STR(quoted(""), "\"\"");
+    CHECK_STR(quoted("plain text"), "\"plain text\"");
+    CHECK_STR(quoted("a\"b\\c/d"), "\"a\\\"b\\\\c/d\"");
+    CHECK_STR(quoted("\b\f\n\r\t"), "\"\\b\\f\\n\\r\\t\"");
+    CHECK_STR(quoted(std::string("\x01\x1f\x7f", 3)), "\"\\u0001\\u001f\x7f\"");
+    CHECK_STR(quoted(std::string("nul\0byte", 8)), "\"nul\\u0000byte\"");
+
+    Json::Value value;
+    std::string all;
+    for (int c = 1; c < 0x80; c++) all.push_back((char)c);
+    CHECK(parses("[" + quoted(all) + "]", &value));
+    CHECK(value[0].asString() == all);
+}
+
+static void test_utf8() {
+    // Well-formed text is copied as it is
+    const std::string text = "caf\xC3\xA9 \xE2\x82\xAC \xF0\x9F\x98\x80 \xED\x9F\xBF \xF4\x8F\xBF\xBF";
+    CHECK_STR(quoted(text), "\"" + text + "\"");
+
+    // Malformed bytes become U+FFFD, one per byte
+    const std::string fffd = "\xEF\xBF\xBD";
+    CHECK_STR(quoted("cut \xE2\x82"), "\"cut " + fffd + fffd + "\"");
+    CHECK_STR(quoted("\xC3"), "\"" + fffd + "\"");
+    CHECK_STR(quoted("a\x80z"), "\"a" + fffd + "z\"");
+    CHECK_STR(quoted("\xC0\xAF"), "\"" + fffd + fffd + "\"");             // overlong
+    CHECK_STR(quoted("\xE0\x80\xAF"), "\"" + fffd + fffd + fffd + "\"");  // overlong
+    CHECK_STR(quoted("\xED\xA0\x80"), "\"" + fffd + fffd + fffd + "\"");  // surrogate
+    CHECK_STR(quoted("\xF4\x90\x80\x80"), "\"" + fffd + fffd + fffd + fffd + "\"");
+    CHECK_STR(quoted("\xC3\xA9\xC3"), "\"\xC3\xA9" + fffd + "\"");
+
+    for (const char* bad : {"\xE2\x82", "\xFF\xFE", "x\xF0\x9F\x98", "\xC3\"\\"}) {
+        CHECK(parses("[" + quoted(bad) + "]"));
+    }
+}
+
+static void test_structure() {
+    std::string out;
+    BerdCoreJsonWriter json(&out);
+    json.begin_object();
+    json.key("a");
+    json.integer(1);
+    json.key("list");
+    json.begin_array();
+    json.string("x");
+    json.begin_object();
+    json.end_object();
+    json.begin_array();
+    json.end_array();
+    json.null();
+    json.end_array();
+    json.key("nested");
+    json.begin_object();
+    json.key("t");
+    json.boolean(true);
+    json.key("f");
+    json.boolean(false);
+    json.end_object();
+    json.key("raw");
+    json.raw("[1,2]");
+    json.key("none");
+    json.string(nullptr);
+    json.end_object();
+    CHECK_STR(out, "{\"a\":1,\"list\":[\"x\",{},[],null],\"nested\":{\"t\":true,\"f\":false},"
+                   "\"raw\":[1,2],\"none\":null}");
+    CHECK(parses(out));
+
+    // A reused buffer: clear() and write again
+    out.clear();
+    BerdCoreJsonWriter again(&out);
+    again.begin_array();
+    again.string(std::string("k\"ey"));
+    again.end_array();
+    CHECK_STR(out, "[\"k\\\"ey\"]");
+
+    // Nesting to the documented limit of 64 levels
+    out.clear();
+    BerdCoreJsonWriter deep(&out);
+    for (int i = 0; i < 64; i++) {
+        deep.begin_array();
+        deep.integer(i);
+    }
+    for (int i = 0; i < 64; i++) deep.end_array();
+    Json::Value value;
+    CHECK(parses(out, &value));
+    CHECK(value[0].asInt() == 0 && value[1][0].asInt() == 1);
+}
+
+static void test_numbers() {
+    auto write = [](double d) {
+        std::string out;
+        BerdCoreJsonWriter json(&out);
+        json.number(d);
+        return out;
+    };
+    CHECK_STR(write(0.5), "0.5");
+    CHECK_STR(write(-3), "-3");
+    CHECK_STR(write(0.7f), "0.699999988");
+    CHECK_STR(write(1e21), "1e+21");
+    CHECK_STR(write(NAN), "null");
+    CHECK_STR(write(INFINITY), "null");
+    CHECK_STR(write(-INFINITY), "null");
+
+    std::string out;
+    BerdCoreJsonWriter json(&out);
+    json.begin_array();
+    json.integer(std::numeric_limits<int64_t>::min());
+    json.integer(std::numeric_limits<int64_t>::max());
+    json.integer(0);
+    json.end_array();
+    CHECK_STR(out, "[-9223372036854775808,9223372036854775807,0]");
+}
+
+int main() {
+    test_escapes();
+    test_utf8();
+    test_structure();
+    test_numbers();
+    return BERDCORE_TEST_RESULT();
+}
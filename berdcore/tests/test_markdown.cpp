@@ -0,0 +1,133 @@
+// Markdown rendering: the incremental stream must always agree with a
+// whole-document render of the same text
+#include "berdcore_markdown.h"
+#include "berdcore_test.h"
+#include <map>
+
+// Helper: Render through the stream, chunk bytes at a time, and join the
+// latest HTML of every block the way markdown_render() does
+static std::string render_streamed(const std::string& markdown, size_t chunk) {
+    BerdCoreMarkdownStream stream;
+    std::map<size_t, std::string> blocks;
+    std::map<size_t, bool> final_blocks;
+    std::vector<BerdCoreMarkdownStream::Block> updates;
+    for (size_t i = 0; i < markdown.size(); i += chunk) {
+        updates.clear();
+        stream.append(markdown.data() + i, std::min(chunk, markdown.size() - i), &updates);
+        for (const auto& block : updates) {
+            // A final block is never reported again
+            CHECK(!final_blocks[block.index]);
+            blocks[block.index] = block.html;
+            final_blocks[block.index] = block.final;
+        }
+    }
+    updates.clear();
+    stream.finish(&updates);
+    for (const auto& block : updates) {
+        CHECK(block.final);
+        blocks[block.index] = block.html;
+    }
+
+    std::string html;
+    for (size_t i = 0; i < stream.block_count(); i++) {
+        if (i > 0) html.push_back('\n');
+        html += blocks[i];
+    }
+    if (!html.empty()) html.push_back('\n');
+    return html;
+}
+
+// Helper: Check every chunking of the stream against the whole render
+static void check_streamed(const std::string& markdown) {
+    std::string whole = markdown_render(markdown);
+    for (size_t chunk : {1, 2, 3, 5, 13, 4096}) {
+        std::string streamed = render_streamed(markdown, chunk);
+        if (streamed != whole) {
+            fprintf(stderr, "chunk %zu of \"%s\"\n", chunk, markdown.c_str());
+        }
+        CHECK_STR(streamed, whole);
+    }
+}
+
+static void test_quotes() {
+    // Lazy continuation keeps the paragraph inside the quote
+    CHECK_STR(markdown_render("> q\nlazy"), "<blockquote>\n<p>q\nlazy</p>\n</blockquote>\n");
+    CHECK_STR(markdown_render("> > a\nb"), "<blockquote>\n<blockquote>\n<p>a\nb</p>\n</blockquote>\n</blockquote>\n");
+    CHECK_STR(markdown_render("> - a\nb"), "<blockquote>\n<ul>\n<li>a\nb</li>\n</ul>\n</blockquote>\n");
+
+    // but not after a blank line, in code, or when the line starts a block
+    CHECK_STR(markdown_render("> q\n>\nnot"), "<blockquote>\n<p>q</p>\n</blockquote>\n<p>not</p>\n");
+    CHECK_STR(markdown_render("> q\n\nnot"), "<blockquote>\n<p>q</p>\n</blockquote>\n<p>not</p>\n");
+    CHECK_STR(markdown_render("> ```\n> code\nnot"),
+              "<blockquote>\n<pre><code>code\n</code></pre>\n</blockquote>\n<p>not</p>\n");
+    CHECK_STR(markdown_render("> a\n---"), "<blockquote>\n<p>a</p>\n</blockquote>\n<hr />\n");
+    CHECK_STR(markdown_render("> a\n- b"), "<blockquote>\n<p>a</p>\n</blockquote>\n<ul>\n<li>b</li>\n</ul>\n");
+    CHECK_STR(markdown_render("> # h\nnot"), "<blockquote>\n<h1>h</h1>\n</blockquote>\n<p>not</p>\n");
+
+    check_streamed("> q\nlazy");
+    check_streamed("> q\nlazy\nlazier\n\nafter\n");
+    check_streamed("> q\n>\nnot\n");
+    check_streamed("> ```\n> code\nnot\n");
+    check_streamed("> > a\nb\n> c\n\n> d\n");
+    check_streamed("> - a\nb\n- c\n");
+    check_streamed("> a\n---\n> b\n# c\n");
+}
+
+static void test_lists() {
+    CHECK_STR(markdown_render("- a\n- b\n"), "<ul>\n<li>a</li>\n<li>b</li>\n</ul>\n");
+    CHECK_STR(markdown_render("- a\n\n- b\n"), "<ul>\n<li>\n<p>a</p>\n</li>\n<li>\n<p>b</p>\n</li>\n</ul>\n");
+    CHECK_STR(markdown_render("- a\n  - b\n"), "<ul>\n<li>a\n<ul>\n<li>b</li>\n</ul></li>\n</ul>\n");
+    // An ordered list only interrupts a paragraph when it starts at 1
+    CHECK_STR(markdown_render("text\n2. no\n"), "<p>text\n2. no</p>\n");
+
+    check_streamed("- a\n- b\n");
+    check_streamed("- a\n  b\n\n  c\n- d\n");
+    check_streamed("1. a\n2. b\n   - c\n     d\n3. e\n\nafter\n");
+    check_streamed("- a\nlazy\n* other list\n");
+    check_streamed("- ```\n  code\n  ```\n- b\n");
+}
+
+static void test_fences() {
+    CHECK_STR(markdown_render("```py\nx = 1\n```\n"), "<pre><code class=\"language-py\">x = 1\n</code></pre>\n");
+    // An unterminated fence runs to the end of the document
+    CHECK_STR(markdown_render("```\nx\n\ny"), "<pre><code>x\n\ny\n</code></pre>\n");
+    // A closing fence must be at least as long as the opening one
+    CHECK_STR(markdown_render("````\n```\n````\n"), "<pre><code>```\n</code></pre>\n");
+
+    check_streamed("```py\nx = 1\n```\nafter\n");
+    check_streamed("```\nx\n\n# not a heading\ny");
+    check_streamed("~~~\n```\n~~~\n> quote\n");
+    check_streamed("text\n```\ncode\n```\n- item\n");
+    check_streamed("```` md\n```\ninner\n```\n````\n");
+}
+
+static void test_inline() {
+    CHECK_STR(markdown_render("*a* **b** `c<d`"),
+              "<p><em>a</em> <strong>b</strong> <code>c&lt;d</code></p>\n");
+    CHECK_STR(markdown_render("<script>x</script>"), "<p>&lt;script&gt;x&lt;/script&gt;</p>\n");
+    // Script links keep their text and lose the link
+    CHECK_STR(markdown_render("[x](javascript:alert(1))"), "<p>x</p>\n");
+    // Only relative, http, https and mailto URLs link, however the scheme
+    // is disguised
+    CHECK_STR(markdown_render("[x](<java\tscript:alert(1)>)"), "<p>x</p>\n");
+    CHECK_STR(markdown_render("[x](< javascript:alert(1)>)"), "<p>x</p>\n");
+    CHECK_STR(markdown_render("[x](<\x01JavaScript:alert(1)>)"), "<p>x</p>\n");
+    CHECK_STR(markdown_render("![i](<\tjavascript:alert(1)>)"), "<p>i</p>\n");
+    CHECK_STR(markdown_render("![i](data:image/png;base64,AA)"), "<p>i</p>\n");
+    CHECK_STR(markdown_render("[x](vbscript:msgbox)"), "<p>x</p>\n");
+    CHECK_STR(markdown_render("[x](https://a.b/c:d)"), "<p><a href=\"https://a.b/c:d\">x</a></p>\n");
+    CHECK_STR(markdown_render("[x](mailto:a@b.c)"), "<p><a href=\"mailto:a@b.c\">x</a></p>\n");
+    CHECK_STR(markdown_render("[x](docs/a:b.html)"), "<p><a href=\"docs/a:b.html\">x</a></p>\n");
+    CHECK_STR(markdown_render("[x](#top)"), "<p><a href=\"#top\">x</a></p>\n");
+
+    check_streamed("a **bold\nline** and `code\nspan` end\n");
+    check_streamed("| a | b |\n|---|:-:|\n| 1 | 2 |\n\nafter\n");
+}
+
+int main() {
+    test_quotes();
+    test_lists();
+    test_fences();
+    test_inline();
+    return BERDCORE_TEST_RESULT();
+}
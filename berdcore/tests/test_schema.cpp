@@ -0,0 +1,185 @@
+// JSON schema validation: every byte that breaks the grammar or the schema
+// is rejected where it appears, whether the reply arrives at once or in
+// single bytes
+#include "berdcore_schema.h"
+#include "berdcore_test.h"
+#include <cstring>
+
+typedef BerdCoreSchemaValidator V;
+
+// Helper: Validate text against a schema, chunk bytes per feed
+static V::Status validate(const char* schema_json, const std::string& text, size_t chunk, size_t* offset = nullptr) {
+    std::string error;
+    auto schema = schema_compile(schema_json, &error);
+    CHECK(schema != nullptr);
+    if (!schema) return V::INVALID;
+    V v(schema);
+    for (size_t i = 0; i < text.size() && v.status() == V::MORE; i += chunk) {
+        v.feed(text.data() + i, std::min(chunk, text.size() - i));
+    }
+    if (v.status() == V::MORE) v.finish();
+    if (offset) *offset = v.offset();
+    return v.status();
+}
+
+// Helper: Check the outcome is the same whole and byte by byte
+static void check(const char* schema_json, const std::string& text, V::Status expected) {
+    V::Status whole = validate(schema_json, text, text.size() + 1);
+    V::Status bytes = validate(schema_json, text, 1);
+    if (whole != expected || bytes != expected) {
+        fprintf(stderr, "  schema %s, text \"%s\": %d/%d, expected %d\n", schema_json, text.c_str(),
+                (int)whole, (int)bytes, (int)expected);
+    }
+    CHECK(whole == expected);
+    CHECK(bytes == expected);
+}
+
+static void test_compile() {
+    std::string error;
+    CHECK(schema_compile("{\"type\":", &error) == nullptr);
+    CHECK(error.find("Invalid JSON schema") == 0);
+    CHECK(schema_compile("[1]", &error) == nullptr);
+    CHECK(schema_compile("{\"type\":\"bogus\"}", &error) == nullptr);
+
+    // The same text is compiled once
+    auto a = schema_compile("{\"type\":\"string\"}", &error);
+    auto b = schema_compile("{\"type\":\"string\"}", &error);
+    CHECK(a != nullptr && a == b);
+}
+
+static void test_numbers() {
+    const char* any = "{}";
+    for (const char* ok : {"0", "-0", "7", "10", "0.5", "-1.25", "1e5", "1E+2", "-1.5e-3", "0e0"}) {
+        check(any, ok, V::COMPLETE);
+        check(any, std::string("[") + ok + "]", V::COMPLETE);
+    }
+    // No leading zeros, bare signs, missing digits or hex
+    for (const char* bad : {"01", "-01", "00", "0.5.1", "1.", ".5", "-", "1e", "1e+", "+1", "0x1", "--1"}) {
+        check(any, bad, V::INVALID);
+        check(any, std::string("[") + bad + "]", V::INVALID);
+        check(any, std::string("{\"k\":") + bad + "}", V::INVALID);
+    }
+    check("{\"type\":\"integer\"}", "42", V::COMPLETE);
+    check("{\"type\":\"integer\"}", "4.2", V::INVALID);
+    check("{\"type\":\"integer\"}", "4e2", V::INVALID);
+    check("{\"type\":\"integer\"}", "\"4\"", V::INVALID);
+}
+
+static void test_strings() {
+    const char* str = "{\"type\":\"string\"}";
+    check(str, "\"plain\"", V::COMPLETE);
+    check(str, "\"\\\" \\\\ \\/ \\b \\f \\n \\r \\t\"", V::COMPLETE);
+    check(str, "\"\\u00e9\\uD83D\\uDE00\"", V::COMPLETE);
+    check(str, "\"\\x\"", V::INVALID);
+    check(str, "\"\\u12g4\"", V::INVALID);
+    check(str, "\"\\u12\"", V::INVALID);
+    check(str, "\"tab\there\"", V::INVALID);
+    check(str, "\"unterminated", V::INVALID);
+    check(str, "\"ends in escape\\", V::INVALID);
+
+    // UTF-8 must be well formed, including a sequence cut short
+    check(str, "\"\xC3\xA9\"", V::COMPLETE);
+    check(str, "\"\xF0\x9F\x98\x80\"", V::COMPLETE);
+    check(str, "\"\xC3\"", V::INVALID);
+    check(str, "\"\xE2\x82\"", V::INVALID);
+    check(str, "\"\x80\"", V::INVALID);
+    check(str, "\"\xC0\xAF\"", V::INVALID);
+    check(str, "\"\xF5\x80\x80\x80\"", V::INVALID);
+    check(str, "\"\xC3", V::INVALID);
+
+    // Lengths count code points, with an escape as one
+    const char* two = "{\"type\":\"string\",\"minLength\":2,\"maxLength\":2}";
+    check(two, "\"\xC3\xA9\xC3\xA9\"", V::COMPLETE);
+    check(two, "\"\\n\\u0041\"", V::COMPLETE);
+    check(two, "\"\xC3\xA9\"", V::INVALID);
+    check(two, "\"abc\"", V::INVALID);
+}
+
+static void test_literals_and_enums() {
+    check("{\"type\":\"boolean\"}", "true", V::COMPLETE);
+    check("{\"type\":\"boolean\"}", "tru", V::INVALID);
+    check("{\"type\":\"boolean\"}", "null", V::INVALID);
+    check("{\"type\":[\"string\",\"null\"]}", "null", V::COMPLETE);
+    check("{\"enum\":[\"red\",\"green\"]}", "\"green\"", V::COMPLETE);
+    check("{\"enum\":[\"red\",\"green\"]}", "\"gree\"", V::INVALID);
+    check("{\"enum\":[10,2]}", "2", V::COMPLETE);
+    check("{\"enum\":[10,2]}", "1", V::INVALID);
+    check("{\"const\":\"x\"}", "\"y\"", V::INVALID);
+}
+
+static void test_containers() {
+    const char* person =
+        "{\"type\":\"object\",\"properties\":{\"name\":{\"type\":\"string\"},"
+        "\"tags\":{\"type\":\"array\",\"items\":{\"type\":\"string\"},\"maxItems\":2}},"
+        "\"required\":[\"name\"],\"additionalProperties\":false}";
+    check(person, "{\"name\":\"a\"}", V::COMPLETE);
+    check(person, " {\n  \"tags\": [\"x\", \"y\"],\n  \"name\": \"a\"\n}", V::COMPLETE);
+    check(person, "{\"tags\":[]}", V::INVALID);                          // name is required
+    check(person, "{\"name\":\"a\",\"age\":1}", V::INVALID);             // no other keys
+    check(person, "{\"name\":\"a\",\"name\":\"b\"}", V::INVALID);        // no duplicates
+    check(person, "{\"name\":\"a\",\"tags\":[\"x\",\"y\",\"z\"]}", V::INVALID);
+    check(person, "{\"name\":\"a\",\"tags\":[1]}", V::INVALID);
+    check(person, "{\"name\":\"a\",}", V::INVALID);
+    check(person, "{\"name\" \"a\"}", V::INVALID);
+    check(person, "{\"name\":\"a\"", V::INVALID);
+
+    const char* matrix = "{\"type\":\"array\",\"minItems\":1,\"items\":"
+                         "{\"type\":\"array\",\"items\":{\"type\":\"number\"}}}";
+    check(matrix, "[[1,2],[],[3.5]]", V::COMPLETE);
+    check(matrix, "[]", V::INVALID);
+    check(matrix, "[[1,[2]]]", V::INVALID);
+    check(matrix, "[[1,2],]", V::INVALID);
+    check(matrix, "[[1,2]", V::INVALID);
+
+    // Deep nesting stops at the depth limit instead of growing without bound
+    check("{}", std::string(32, '[') + std::string(32, ']'), V::COMPLETE);
+    check("{}", std::string(100, '[') + std::string(100, ']'), V::INVALID);
+}
+
+static void test_reply_framing() {
+    // A fence line and whitespace before the value are skipped, and nothing
+    // after it is looked at
+    check("{\"type\":\"object\"}", "```json\n{\"a\":1}\n```\nDone!", V::COMPLETE);
+    check("{\"type\":\"integer\"}", "  42 and more", V::COMPLETE);
+    check("{\"type\":\"object\"}", "Sure! {\"a\":1}", V::INVALID);
+
+    size_t offset = 0;
+    CHECK(validate("{\"type\":\"integer\"}", "\n12\nx", 1, &offset) == V::COMPLETE);
+    CHECK(offset == 3);
+    CHECK(validate("{\"type\":\"integer\"}", "12x", 1, &offset) == V::INVALID);
+    CHECK(validate("{\"type\":\"array\",\"items\":{\"type\":\"integer\"}}", "[1,2,x]", 1, &offset) == V::INVALID);
+    CHECK(offset == 5);
+}
+
+static void test_forced() {
+    std::string error;
+    auto schema = schema_compile(
+        "{\"type\":\"object\",\"properties\":{\"mood\":{\"enum\":[\"positive\",\"negative\"]}},"
+        "\"additionalProperties\":false}", &error);
+    V v(schema);
+    v.feed("{\"mood\":\"p", 10);
+    // The only candidate left, then the object has nothing else to take
+    CHECK_STR(v.forced(), "ositive\"}");
+
+    V keys(schema);
+    keys.feed("{", 1);
+    CHECK_STR(keys.forced(), "");   // a key still has to be written
+
+    V literal(schema_compile("{\"type\":\"array\",\"items\":{\"type\":\"boolean\"},\"maxItems\":1}", &error));
+    literal.feed("[tr", 3);
+    CHECK_STR(literal.forced(), "ue]");
+    literal.feed("ue]", 3);
+    CHECK(literal.status() == V::COMPLETE);
+    CHECK_STR(literal.value(), "[true]");
+}
+
+int main() {
+    test_compile();
+    test_numbers();
+    test_strings();
+    test_literals_and_enums();
+    test_containers();
+    test_reply_framing();
+    test_forced();
+    return BERDCORE_TEST_RESULT();
+}